@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2025 Conny Marco Menebröcker
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+"""Decode the audit log exported with the console command 'a'.
+
+Reads a console capture (file or stdin), extracts the pages between
+"AUDIT <pages> <dropped>" and "AUDIT END", checks the CRC of every page and
+prints the events in sequence order with their RTC time. --csv writes the
+events as CSV instead.
+"""
+
+import argparse
+import csv
+import datetime
+import re
+import struct
+import sys
+
+# Reihenfolge wie audit_event_t in src/audit.h
+EVENTS = [
+    'boot',
+    'open_brief',
+    'open_paket',
+    'lockout',
+    'motor_timeout',
+    'motor_stop',
+    'rfid_accept',
+    'rfid_reject',
+    'uid_add',
+    'uid_remove',
+    'uid_sync',
+]
+
+PAGE_SIZE = 64
+RECORDS = 7
+HEADER = struct.Struct('<IBBH')
+RECORD = struct.Struct('<IBBH')
+
+HEADER_RE = re.compile(r'AUDIT (\d+) pages, dropped (\d+)')
+PAGE_RE = re.compile(r'^([0-9a-f]{%d})$' % (PAGE_SIZE * 2))
+
+
+def crc16_ccitt(data, crc=0xffff):
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xffff
+    return crc
+
+
+def parse(lines):
+    """Return (dropped, [(seq, [(time, event, result, uid_hash), ...]), ...])."""
+    pages = []
+    dropped = 0
+    it = iter(lines)
+    for line in it:
+        m = HEADER_RE.search(line)
+        if not m:
+            continue
+        dropped = int(m.group(2))
+        for line in it:
+            line = line.strip()
+            if line == 'AUDIT END':
+                break
+            m = PAGE_RE.match(line)
+            if not m:
+                continue
+            raw = bytes.fromhex(m.group(1))
+            seq, count, _, crc = HEADER.unpack_from(raw)
+            if count == 0 or count > RECORDS:
+                continue
+            body = raw[HEADER.size:HEADER.size + count * RECORD.size]
+            if crc16_ccitt(body, crc16_ccitt(bytes([count]))) != crc:
+                sys.stderr.write(f'page {seq}: CRC error, skipped\n')
+                continue
+            pages.append((seq, [RECORD.unpack_from(body, i * RECORD.size)
+                                for i in range(count)]))
+    pages.sort(key=lambda p: p[0])
+    return dropped, pages
+
+
+def event_name(event):
+    return EVENTS[event] if event < len(EVENTS) else f'event_{event}'
+
+
+# Ereignisse mit AUDIT_FACH in result: Fach in Bit 4..7, Zustand in Bit 0..3
+FACH_EVENTS = {'open_brief', 'open_paket', 'lockout'}
+
+# AUDIT_TIME_UNKNOWN in src/audit.h: Uhr nicht gestellt, Sekunden seit Start
+TIME_UNKNOWN = 1 << 31
+
+
+def format_time(t):
+    if t == 0:
+        return 'no rtc'
+    if t & TIME_UNKNOWN:
+        return f'unknown +{t & ~TIME_UNKNOWN}s'
+    return datetime.datetime.fromtimestamp(
+        t, datetime.timezone.utc).strftime('%Y-%m-%d %H:%M:%S')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('capture', nargs='?', type=argparse.FileType('r'),
+                        default=sys.stdin)
+    parser.add_argument('--csv', action='store_true',
+                        help='write CSV instead of a table')
+    args = parser.parse_args()
+
+    dropped, pages = parse(args.capture)
+    if dropped:
+        sys.stderr.write(f'{dropped} events were dropped\n')
+
+    writer = csv.writer(sys.stdout) if args.csv else None
+    if writer:
+        writer.writerow(['seq', 'time', 'event', 'uid_hash', 'result'])
+    for seq, records in pages:
+        for t, event, result, uid_hash in records:
+            name = event_name(event)
+            if name in FACH_EVENTS:
+                result = f'fach {result >> 4} state {result & 0x0f}'
+            row = [seq, format_time(t), name, f'{uid_hash:04x}', result]
+            if writer:
+                writer.writerow(row)
+            else:
+                print(f'{row[0]:>6}  {row[1]:<19}  {row[2]:<14} '
+                      f'{row[3]}  {row[4]}')
+
+
+if __name__ == '__main__':
+    main()
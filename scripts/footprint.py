@@ -0,0 +1,242 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2025 Conny Marco Menebröcker
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+"""Per-module RAM/stack/flash breakdown from the GNU ld map file.
+
+Every input section of the map is assigned to a module: application
+sources by file name (motor.c, rfid.c, ...), Zephyr and toolchain
+libraries by archive name (kernel, drivers__eeprom, c_nano, ...).
+Thread stacks are reported separately from other static RAM.
+
+With --budget the sizes are checked against a JSON file and the script
+exits with 1 if any budget is exceeded, which fails the build.
+
+With --write-budget the module budgets of the application sources are
+generated from the map instead: the measured size plus --margin percent,
+rounded up. Stacks are declared sizes and get no margin. The "total"
+limits of an existing budget file are kept.
+"""
+
+import argparse
+import json
+import math
+import os
+import re
+import sys
+from collections import defaultdict
+
+MEMORY_RE = re.compile(r'^(\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)')
+OUTPUT_RE = re.compile(
+    r'^(\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)(?:\s+load address 0x([0-9a-fA-F]+))?')
+INPUT_RE = re.compile(r'^ (\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$')
+INPUT_NAME_RE = re.compile(r'^ (\S+)$')
+INPUT_ADDR_RE = re.compile(r'^\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$')
+SYMBOL_RE = re.compile(r'^\s+0x([0-9a-fA-F]+)\s+([A-Za-z_][A-Za-z0-9_.]*)$')
+
+
+def module_name(obj):
+    m = re.match(r'.*?([^/\\]+)\.a\((.+)\)$', obj)
+    if m:
+        lib, member = m.group(1), m.group(2)
+        if lib == 'libapp':
+            return member.replace('.obj', '')
+        return lib[3:] if lib.startswith('lib') else lib
+    return os.path.basename(obj).replace('.obj', '')
+
+
+def parse_map(path):
+    memories = {}
+    sections = []
+    with open(path, encoding='utf-8', errors='replace') as f:
+        lines = f.read().splitlines()
+
+    i = 0
+    # Memory regions
+    while i < len(lines) and not lines[i].startswith('Memory Configuration'):
+        i += 1
+    while i < len(lines) and not lines[i].startswith('Linker script and memory map'):
+        m = MEMORY_RE.match(lines[i])
+        if m and m.group(1) not in ('Name', '*default*'):
+            memories[m.group(1)] = (int(m.group(2), 16), int(m.group(3), 16))
+        i += 1
+
+    load = False
+    pending = None
+    current = None
+    for line in lines[i:]:
+        if not line.startswith(' '):
+            m = OUTPUT_RE.match(line)
+            if m:
+                load = m.group(4) is not None and m.group(4) != m.group(2)
+            current = None
+            pending = None
+            continue
+
+        if pending is not None:
+            m = INPUT_ADDR_RE.match(line)
+            pending_name = pending
+            pending = None
+            if m:
+                current = add_section(sections, pending_name, m.group(1),
+                                      m.group(2), m.group(3), load)
+                continue
+
+        m = INPUT_RE.match(line)
+        if m:
+            current = add_section(sections, m.group(1), m.group(2), m.group(3),
+                                  m.group(4), load)
+            continue
+
+        m = INPUT_NAME_RE.match(line)
+        if m and not line.startswith(' *'):
+            pending = m.group(1)
+            continue
+
+        m = SYMBOL_RE.match(line)
+        if m and current is not None:
+            current['symbols'].append(m.group(2))
+
+    return memories, sections
+
+
+def add_section(sections, name, addr, size, obj, load):
+    sec = {
+        'name': name,
+        'addr': int(addr, 16),
+        'size': int(size, 16),
+        'module': module_name(obj.strip()),
+        'load': load,
+        'symbols': [],
+    }
+    if sec['size'] > 0 and sec['addr'] > 0:
+        sections.append(sec)
+    return sec
+
+
+def region_of(memories, addr):
+    for name, (origin, length) in memories.items():
+        if origin <= addr < origin + length:
+            return name
+    return None
+
+
+def breakdown(memories, sections, ram_region, flash_region):
+    modules = defaultdict(lambda: {'ram': 0, 'stack': 0, 'flash': 0})
+    for sec in sections:
+        region = region_of(memories, sec['addr'])
+        mod = modules[sec['module']]
+        if region == flash_region:
+            mod['flash'] += sec['size']
+        elif region == ram_region:
+            if sec['name'].startswith('.noinit') and \
+                    any('stack' in s for s in sec['symbols']):
+                mod['stack'] += sec['size']
+            else:
+                mod['ram'] += sec['size']
+            if sec['load']:
+                # Initialisierte Daten liegen zusätzlich im Flash
+                mod['flash'] += sec['size']
+    return modules
+
+
+def check_budget(modules, totals, budget):
+    errors = []
+    for name, limits in budget.get('modules', {}).items():
+        used = modules.get(name, {'ram': 0, 'stack': 0, 'flash': 0})
+        for key, limit in limits.items():
+            if used[key] > limit:
+                errors.append(f'{name}: {key} {used[key]} > budget {limit}')
+    for key, limit in budget.get('total', {}).items():
+        if totals[key] > limit:
+            errors.append(f'total: {key} {totals[key]} > budget {limit}')
+    return errors
+
+
+def round_up(value, step):
+    return int(math.ceil(value / step)) * step
+
+
+def write_budget(modules, path, margin):
+    total = {}
+    if os.path.exists(path):
+        with open(path, encoding='utf-8') as f:
+            total = json.load(f).get('total', {})
+
+    rows = []
+    for name in sorted(modules):
+        # Nur die eigenen Quellen, Zephyr-Bibliotheken wachsen mit Updates
+        if not name.endswith('.c'):
+            continue
+        mod = modules[name]
+        limits = {'ram': round_up(mod['ram'] * (100 + margin) / 100, 32)}
+        if mod['stack']:
+            limits['stack'] = mod['stack']
+        limits['flash'] = round_up(mod['flash'] * (100 + margin) / 100, 256)
+        fields = ', '.join(f'"{k}": {v}' for k, v in limits.items())
+        rows.append(f'    "{name}": {{{fields}}}')
+
+    with open(path, 'w', encoding='utf-8') as f:
+        f.write('{\n  "total": ')
+        f.write(json.dumps(total, indent=4).replace('\n}', '\n  }'))
+        f.write(',\n  "modules": {\n')
+        f.write(',\n'.join(rows))
+        f.write('\n  }\n}\n')
+    print(f'budget for {len(rows)} modules written to {path}')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--map', required=True, help='linker map file')
+    parser.add_argument('--budget', help='JSON file with budgets')
+    parser.add_argument('--ram-region', default='RAM')
+    parser.add_argument('--flash-region', default='FLASH')
+    parser.add_argument('--all', action='store_true',
+                        help='list all modules, not only the largest ones')
+    parser.add_argument('--write-budget', action='store_true',
+                        help='generate the module budgets in --budget from '
+                        'the map instead of checking them')
+    parser.add_argument('--margin', type=int, default=10,
+                        help='headroom in percent for --write-budget')
+    args = parser.parse_args()
+
+    memories, sections = parse_map(args.map)
+    modules = breakdown(memories, sections, args.ram_region, args.flash_region)
+
+    totals = {'ram': 0, 'stack': 0, 'flash': 0}
+    for mod in modules.values():
+        for key in totals:
+            totals[key] += mod[key]
+    totals['ram_all'] = totals['ram'] + totals['stack']
+
+    rows = sorted(modules.items(),
+                  key=lambda kv: kv[1]['ram'] + kv[1]['stack'] + kv[1]['flash'],
+                  reverse=True)
+    if not args.all:
+        rows = rows[:20]
+
+    print(f'{"module":<28}{"ram":>8}{"stack":>8}{"flash":>9}')
+    for name, mod in rows:
+        print(f'{name:<28}{mod["ram"]:>8}{mod["stack"]:>8}{mod["flash"]:>9}')
+    print(f'{"total":<28}{totals["ram"]:>8}{totals["stack"]:>8}{totals["flash"]:>9}')
+
+    if args.write_budget:
+        if not args.budget:
+            parser.error('--write-budget needs --budget')
+        write_budget(modules, args.budget, args.margin)
+    elif args.budget:
+        with open(args.budget, encoding='utf-8') as f:
+            budget = json.load(f)
+        errors = check_budget(modules, totals, budget)
+        if errors:
+            for err in errors:
+                print(f'footprint budget exceeded: {err}', file=sys.stderr)
+            return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,314 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2025 Conny Marco Menebröcker
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+"""Receive and decode the binary telemetry stream (src/telemetry.c).
+
+Reads from a serial port (--port, needs pyserial) or a raw binary capture
+(file or stdin). Frames are COBS encoded and terminated by 0x00, every frame
+carries channel, sequence number, uptime in ms and a CRC16. Console text
+between frames is passed through with a leading '#'. Lost frames are
+detected from gaps in the sequence number. --csv writes the frames as CSV.
+
+Log messages (channel 'log') are dictionary encoded. They are decoded with
+the log parser from $ZEPHYR_BASE/scripts/logging/dictionary and the
+database of the running firmware (--db, default
+build/zephyr/log_dictionary.json). Without a database they are printed as
+hex.
+"""
+
+import argparse
+import csv
+import logging
+import os
+import struct
+import sys
+
+HEADER = struct.Struct('<BBI')
+
+# Reihenfolge wie state_t in src/states.c
+STATES = [
+    'geschlossen',
+    'paket_offen',
+    'brief_offen',
+    'paket_gesperrt',
+    'paket_sicher_offen',
+    'warten',
+    'rfid_programmieren',
+]
+
+# Reihenfolge wie enum rfid_phase in src/rfid.c
+RFID_PHASES = ['detect', 'protocol', 'request', 'sdd', 'lookup']
+
+MOTOR_DIRECTIONS = ['stop', 'vor', 'zur']
+
+
+def name(names, i):
+    return names[i] if i < len(names) else str(i)
+
+
+def decode_motor(payload):
+    strom, exec_us, richtung, fach = struct.unpack('<HHBB', payload)
+    return {'fach': fach, 'strom_ma': strom, 'exec_us': exec_us,
+            'richtung': name(MOTOR_DIRECTIONS, richtung)}
+
+
+def decode_state(payload):
+    old, new, fach = struct.unpack('<BBB', payload)
+    return {'fach': fach, 'from': name(STATES, old), 'to': name(STATES, new)}
+
+
+def decode_rfid(payload):
+    time, phase, ret = struct.unpack('<IBb', payload)
+    return {'phase': name(RFID_PHASES, phase), 'time': time, 'ret': ret}
+
+
+# Reihenfolge wie telemetry_channel_t in src/telemetry.h
+CHANNELS = [
+    ('motor', decode_motor),
+    ('state', decode_state),
+    ('rfid', decode_rfid),
+    ('log', None),
+]
+LOG_CHANNEL = 3
+# TELEMETRY_DATA_MAX, ein kürzerer Log-Rahmen beendet eine Meldung
+DATA_MAX = 48
+
+# struct log_dict_output_normal_msg_hdr_t (32 Bit Ziel, 32 Bit Zeitstempel):
+# type, domain:4 level:4 package_len:16 data_len:16, source, timestamp
+LOG_MSG_NORMAL = 0
+LOG_MSG_DROPPED = 1
+LOG_HDR_SIZE = 14
+LOG_DROPPED_SIZE = 3
+
+
+class LogDecoder:
+    """Reassemble dictionary log messages from the log frames."""
+
+    def __init__(self, db_path, out):
+        self.out = out
+        self.buf = bytearray()
+        self.synced = True
+        self.parser = None
+        if db_path and os.path.exists(db_path):
+            self.parser = self.load_parser(db_path)
+
+    @staticmethod
+    def load_parser(db_path):
+        zephyr = os.environ.get('ZEPHYR_BASE')
+        if not zephyr:
+            sys.stderr.write('ZEPHYR_BASE not set, log messages as hex\n')
+            return None
+        sys.path.insert(0, os.path.join(zephyr, 'scripts', 'logging',
+                                        'dictionary'))
+        import dictionary_parser
+        from dictionary_parser.log_database import LogDatabase
+
+        logging.basicConfig(format='%(message)s', level=logging.INFO)
+        database = LogDatabase.read_json_database(db_path)
+        return dictionary_parser.get_parser(database)
+
+    def lost(self):
+        """Frames were lost, wait for the end of the current message."""
+        self.buf.clear()
+        self.synced = False
+
+    def feed(self, payload):
+        if not self.synced:
+            self.synced = len(payload) < DATA_MAX
+            return
+        self.buf += payload
+        while self.buf:
+            size = self.message_size()
+            if size is None or size > len(self.buf):
+                return
+            msg = bytes(self.buf[:size])
+            del self.buf[:size]
+            self.message(msg)
+
+    def message_size(self):
+        if self.buf[0] == LOG_MSG_DROPPED:
+            return LOG_DROPPED_SIZE
+        if self.buf[0] != LOG_MSG_NORMAL:
+            self.lost()
+            return None
+        if len(self.buf) < LOG_HDR_SIZE:
+            return None
+        bits = int.from_bytes(self.buf[1:6], 'little')
+        package_len = (bits >> 8) & 0xffff
+        data_len = (bits >> 24) & 0xffff
+        return LOG_HDR_SIZE + package_len + data_len
+
+    def message(self, msg):
+        if self.parser is not None:
+            try:
+                if self.parser.parse_log_data(msg):
+                    return
+            except Exception:  # pylint: disable=broad-except
+                pass
+        self.out.write(f'# log {msg.hex()}\n')
+
+
+def crc16_ccitt(data, crc=0xffff):
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xffff
+    return crc
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xff and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def parse_frame(data):
+    """Return (channel, seq, time_ms, payload) or None if the CRC fails."""
+    raw = cobs_decode(data)
+    if raw is None or len(raw) < HEADER.size + 2:
+        return None
+    crc = struct.unpack_from('<H', raw, len(raw) - 2)[0]
+    if crc16_ccitt(raw[:-2]) != crc:
+        return None
+    channel, seq, time_ms = HEADER.unpack_from(raw)
+    return channel, seq, time_ms, raw[HEADER.size:-2]
+
+
+def split_chunk(chunk):
+    """Split the bytes before a 0x00 into console text and a frame.
+
+    printk text has no delimiter of its own, so it ends up in front of the
+    next frame. The frame starts after one of the line feeds.
+    """
+    frame = parse_frame(chunk)
+    if frame:
+        return b'', frame
+    pos = chunk.find(b'\n')
+    while pos >= 0:
+        frame = parse_frame(chunk[pos + 1:])
+        if frame:
+            return chunk[:pos + 1], frame
+        pos = chunk.find(b'\n', pos + 1)
+    return chunk, None
+
+
+class Receiver:
+    def __init__(self, out, writer, log):
+        self.out = out
+        self.writer = writer
+        self.log = log
+        self.buf = bytearray()
+        self.last_seq = None
+        self.frames = 0
+        self.lost = 0
+        self.crc_errors = 0
+
+    def feed(self, data):
+        self.buf += data
+        while True:
+            end = self.buf.find(b'\0')
+            if end < 0:
+                return
+            chunk = bytes(self.buf[:end])
+            del self.buf[:end + 1]
+            self.chunk(chunk)
+
+    def chunk(self, chunk):
+        text, frame = split_chunk(chunk)
+        if text:
+            printable = text.decode('ascii', errors='replace')
+            if frame is None and not printable.endswith('\n'):
+                # Weder Text noch gültiger Rahmen
+                self.crc_errors += 1
+            for line in printable.splitlines():
+                self.out.write(f'# {line}\n')
+        if frame:
+            self.frame(*frame)
+
+    def frame(self, channel, seq, time_ms, payload):
+        if self.last_seq is not None:
+            gap = (seq - self.last_seq - 1) & 0xff
+            if gap:
+                self.lost += gap
+                self.log.lost()
+        self.last_seq = seq
+        self.frames += 1
+
+        if channel == LOG_CHANNEL:
+            self.out.flush()
+            self.log.feed(payload)
+            return
+        if channel < len(CHANNELS):
+            ch_name, decode = CHANNELS[channel]
+            try:
+                fields = decode(payload)
+            except struct.error:
+                fields = {'raw': payload.hex()}
+        else:
+            ch_name, fields = f'channel_{channel}', {'raw': payload.hex()}
+
+        if self.writer:
+            self.writer.writerow([time_ms, seq, ch_name] +
+                                 [f'{k}={v}' for k, v in fields.items()])
+        else:
+            values = ' '.join(f'{k}={v}' for k, v in fields.items())
+            self.out.write(f'{time_ms:10} ms  {seq:3}  {ch_name:<6} {values}\n')
+
+    def summary(self):
+        return (f'{self.frames} frames, {self.lost} lost, '
+                f'{self.crc_errors} CRC errors')
+
+
+def open_input(args):
+    if args.port:
+        import serial  # pyserial
+        return serial.Serial(args.port, args.baud, timeout=0.1)
+    if args.capture:
+        return open(args.capture, 'rb')
+    return sys.stdin.buffer
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('capture', nargs='?', help='raw capture (default stdin)')
+    parser.add_argument('--port', help='serial port, e.g. /dev/ttyUSB0')
+    parser.add_argument('--baud', type=int, default=115200)
+    parser.add_argument('--csv', action='store_true',
+                        help='write CSV instead of a table')
+    parser.add_argument('--db', default='build/zephyr/log_dictionary.json',
+                        help='log dictionary of the firmware')
+    args = parser.parse_args()
+
+    writer = csv.writer(sys.stdout) if args.csv else None
+    rx = Receiver(sys.stdout, writer, LogDecoder(args.db, sys.stdout))
+    src = open_input(args)
+    try:
+        while True:
+            data = src.read(256)
+            if not data:
+                if args.port:
+                    continue
+                break
+            rx.feed(data)
+            sys.stdout.flush()
+    except KeyboardInterrupt:
+        pass
+    sys.stderr.write(rx.summary() + '\n')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
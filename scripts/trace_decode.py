@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2025 Conny Marco Menebröcker
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+"""Decode the binary event trace dumped with the console command 't'.
+
+Reads a console capture (file or stdin), extracts the block between
+"TRACE <hz> <count> <overrun>" and "TRACE END" and prints a timeline with
+absolute and delta times. With --ctf DIR a CTF 1.8 trace is written that can
+be opened with babeltrace2 or Trace Compass.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+# Reihenfolge wie trace_id_t in src/trace.h
+EVENTS = [
+    'motor_cycle',
+    'adc_done',
+    'hall_edge',
+    'cmd_push',
+    'cmd_pop',
+    'rfid_detect',
+    'rfid_reset',
+    'rfid_protocol',
+    'rfid_request',
+    'rfid_sdd',
+    'rfid_lookup',
+    'power_sleep',
+    'power_wakeup',
+    'rfid_removed',
+    'rfid_parked',
+]
+
+HEADER_RE = re.compile(r'TRACE (\d+) (\d+) (\d+)')
+RECORD_RE = re.compile(r'\b([0-9a-f]{8})([0-9a-f]{2})([0-9a-f]{8})\b')
+
+
+def parse(lines):
+    """Yield (hz, overrun, [(cycles64, id, arg), ...]) for every dump."""
+    it = iter(lines)
+    for line in it:
+        m = HEADER_RE.search(line)
+        if not m:
+            continue
+        hz, overrun = int(m.group(1)), int(m.group(3))
+        records = []
+        last = None
+        high = 0
+        for line in it:
+            if 'TRACE END' in line:
+                break
+            for ts, eid, arg in RECORD_RE.findall(line):
+                ts = int(ts, 16)
+                # 32 Bit Zykluszähler läuft über
+                if last is not None and ts < last:
+                    high += 1 << 32
+                last = ts
+                records.append((high + ts, int(eid, 16), int(arg, 16)))
+        yield hz, overrun, records
+
+
+def event_name(eid):
+    return EVENTS[eid] if eid < len(EVENTS) else f'event_{eid}'
+
+
+def print_timeline(hz, overrun, records, out):
+    if overrun:
+        out.write(f'# {overrun} older records were overwritten\n')
+    if not records:
+        return
+    t0 = records[0][0]
+    prev = t0
+    for cycles, eid, arg in records:
+        t = (cycles - t0) * 1e3 / hz
+        dt = (cycles - prev) * 1e3 / hz
+        prev = cycles
+        out.write(f'{t:12.3f} ms  +{dt:9.3f} ms  {event_name(eid):<14} '
+                  f'{arg:#010x} ({arg if arg < 0x80000000 else arg - (1 << 32)})\n')
+
+
+CTF_METADATA = '''/* CTF 1.8 */
+typealias integer {{ size = 8; align = 8; signed = false; }} := uint8_t;
+typealias integer {{ size = 32; align = 8; signed = false; }} := uint32_t;
+
+trace {{
+  major = 1;
+  minor = 8;
+  byte_order = le;
+  packet.header := struct {{ uint32_t magic; }};
+}};
+
+clock {{
+  name = cycles;
+  freq = {hz};
+}};
+
+typealias integer {{
+  size = 64; align = 8; signed = false;
+  map = clock.cycles.value;
+}} := cycles_t;
+
+stream {{
+  event.header := struct {{ uint8_t id; cycles_t timestamp; }};
+}};
+'''
+
+CTF_EVENT = '''
+event {{
+  name = "{name}";
+  id = {id};
+  fields := struct {{ uint32_t arg; }};
+}};
+'''
+
+
+def write_ctf(path, hz, records):
+    os.makedirs(path, exist_ok=True)
+    with open(os.path.join(path, 'metadata'), 'w', encoding='utf-8') as f:
+        f.write(CTF_METADATA.format(hz=hz))
+        for eid, name in enumerate(EVENTS):
+            f.write(CTF_EVENT.format(name=name, id=eid))
+    with open(os.path.join(path, 'stream'), 'wb') as f:
+        f.write(struct.pack('<I', 0xC1FC1FC1))
+        for cycles, eid, arg in records:
+            f.write(struct.pack('<BQI', eid, cycles, arg))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('capture', nargs='?', help='console capture (default stdin)')
+    parser.add_argument('--ctf', metavar='DIR', help='write a CTF trace to DIR')
+    args = parser.parse_args()
+
+    if args.capture:
+        with open(args.capture, encoding='utf-8', errors='replace') as f:
+            lines = f.readlines()
+    else:
+        lines = sys.stdin.readlines()
+
+    dumps = list(parse(lines))
+    if not dumps:
+        print('no trace dump found', file=sys.stderr)
+        return 1
+
+    for n, (hz, overrun, records) in enumerate(dumps):
+        if len(dumps) > 1:
+            print(f'# dump {n}')
+        print_timeline(hz, overrun, records, sys.stdout)
+
+    if args.ctf:
+        hz, _, records = dumps[-1]
+        write_ctf(args.ctf, hz, records)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
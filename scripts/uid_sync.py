@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2025 Conny Marco Menebröcker
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+"""Replace the card list of a box with a complete list (src/uidsync.c).
+
+Reads a card list with one UID per line as hex, optionally followed by the
+compartment mask in hex (default ff = all compartments). Empty lines and
+lines starting with '#' are ignored. The output of the console command
+'sync export' is accepted as well, so the list of one box can be copied to
+another one.
+
+Without --port the console commands are printed. With --port they are sent
+and every data line waits for the acknowledgement of the box. The records
+are sorted by hash bucket of the UID table, so consecutive changes mostly
+hit the same EEPROM page and are written in one page access.
+"""
+
+import argparse
+import re
+import sys
+import zlib
+
+UID_MAX_LEN = 10
+# UID_PAGES in src/eeprom.c: 32 KB EEPROM, 64 byte pages, one header page
+UID_PAGES = 32768 // 64 - 1
+# Nutzdaten einer Zeile "sync <hex>" in CONSOLE_LINE_MAX
+LINE_BYTES = 21
+
+EXPORT_RE = re.compile(r'^sync ([0-9a-f]+)$')
+
+
+def bucket(uid):
+    """FNV-1a as uid_bucket() in src/eeprom.c."""
+    h = 2166136261
+    for b in uid:
+        h = ((h ^ b) * 16777619) & 0xffffffff
+    return h % UID_PAGES
+
+
+def parse_export(data):
+    records = []
+    pos = 0
+    while pos + 2 <= len(data):
+        length = data[pos]
+        records.append((data[pos + 2:pos + 2 + length], data[pos + 1]))
+        pos += 2 + length
+    return records
+
+
+def read_cards(f):
+    cards = {}
+    for n, line in enumerate(f, 1):
+        line = line.strip().lower()
+        if not line or line.startswith('#') or line.startswith('sync b') \
+                or line == 'sync end':
+            continue
+        m = EXPORT_RE.match(line)
+        if m:
+            for uid, mask in parse_export(bytes.fromhex(m.group(1))):
+                cards[uid] = mask
+            continue
+        fields = line.split()
+        uid = bytes.fromhex(fields[0])
+        mask = int(fields[1], 16) if len(fields) > 1 else 0xff
+        if not 1 <= len(uid) <= UID_MAX_LEN or not 1 <= mask <= 0xff:
+            raise ValueError(f'line {n}: invalid card "{line}"')
+        cards[uid] = mask
+    return cards
+
+
+def sync_lines(cards, version):
+    records = [bytes([len(uid), mask]) + uid
+               for uid, mask in sorted(cards.items(),
+                                       key=lambda c: (bucket(c[0]), c[0]))]
+    crc = zlib.crc32(b''.join(records))
+    lines = [f'sync begin {version} {len(records)} {crc:08x}']
+    line = b''
+    for rec in records:
+        # Nur ganze Datensätze in einer Zeile
+        if len(line) + len(rec) > LINE_BYTES:
+            lines.append(f'sync {line.hex()}')
+            line = b''
+        line += rec
+    if line:
+        lines.append(f'sync {line.hex()}')
+    lines.append('sync end')
+    return lines
+
+
+def send(port, baud, lines):
+    import serial  # pyserial
+
+    ser = serial.Serial(port, baud, timeout=5)
+    for line in lines:
+        ser.write(line.encode() + b'\n')
+        # Jede Zeile wird beantwortet, Text dazwischen überspringen
+        while True:
+            reply = ser.readline().decode('ascii', errors='replace').strip()
+            if not reply:
+                sys.stderr.write(f'no reply to "{line}"\n')
+                return 1
+            if reply.startswith('sync ') or reply.startswith('usage'):
+                break
+        print(reply)
+        if 'failed' in reply or reply.startswith('usage'):
+            return 1
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('cards', nargs='?', help='card list (default stdin)')
+    parser.add_argument('--version', type=int, required=True,
+                        help='list version reported by the box afterwards')
+    parser.add_argument('--port', help='serial port, e.g. /dev/ttyUSB0')
+    parser.add_argument('--baud', type=int, default=115200)
+    args = parser.parse_args()
+
+    src = open(args.cards) if args.cards else sys.stdin
+    lines = sync_lines(read_cards(src), args.version)
+    if args.port:
+        return send(args.port, args.baud, lines)
+    print('\n'.join(lines))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,691 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Controller und eine Flotte von Kästen am selben Bus, alle im Prozess.
+ * Die Kästen benutzen den Protokollkern der Firmware (bus_proto.c) mit
+ * nachgebildetem Zustandsautomaten und UID-Tabelle. Die Leitung wird nicht
+ * in Echtzeit betrieben, die Zeit ergibt sich aus den übertragenen Bytes
+ * (10 Bit pro Byte), der Umschaltzeit und den Timeouts. Gestörte Rahmen
+ * werden zufällig erzeugt. */
+
+#include "bus_proto.h"
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+#define SIM_NODES 48
+#define SIM_BAUD 115200
+#define SIM_TURNAROUND_US 300 // Antwort des Kastens nach Rahmenende
+#define SIM_GAP_US 100        // Pause zwischen zwei Rahmen des Controllers
+#define SIM_TIMEOUT_US 5000   // Controller wartet auf die Antwort
+#define SIM_RETRIES 3
+#define SIM_ERROR_PERMILLE 10 // gestörte Rahmen
+#define SIM_POLL_ROUNDS 50
+#define SIM_EVENT_PERCENT 20 // Kästen mit neuen Ereignissen je Runde
+#define SIM_UIDS 256         // UID-Tabelle eines Kastens
+#define SIM_UID_LEN 7
+#define SIM_ROLLOUT 200 // neue Karten
+#define SIM_REVOKE 20   // davon wieder gesperrt
+#define SIM_SYNC_FIRST 50 // Abgleich auf rollout[50..249]
+#define SIM_SYNC_COUNT 200
+#define SIM_CARDS (SIM_SYNC_FIRST + SIM_SYNC_COUNT)
+#define SIM_UID_FRAMES 64
+#define SIM_UID_PASSES 8
+#define SIM_UID_UNICAST_MAX 2 // mehr Kästen zurück, erneut per Broadcast
+
+struct sim_uid {
+  uint8_t len;
+  uint8_t faecher;
+  uint8_t uid[SIM_UID_LEN];
+  bool seen; // im laufenden Abgleich übertragen
+};
+
+struct sim_node {
+  struct bus_node bus;
+  struct sim_uid uids[SIM_UIDS];
+  uint16_t uid_count;
+  uint16_t uid_version;
+  uint32_t opens;
+  uint32_t events; // erzeugte Ereignisse
+  struct {
+    bool active;
+    uint16_t version;
+    uint16_t count;
+    uint16_t received;
+    uint32_t crc;
+    uint32_t crc_received;
+  } sync;
+};
+
+/* Sicht des Controllers auf einen Kasten */
+struct sim_remote {
+  uint8_t event_next;
+  uint16_t uid_version;
+  uint32_t events;
+};
+
+/* Verkettete Änderungen der UID-Liste, Rahmen i führt von Version
+   uid_base + i nach uid_base + i + 1 */
+struct sim_uid_frame {
+  uint8_t len;
+  uint8_t data[BUS_PAYLOAD_MAX];
+};
+
+static struct sim_node nodes[SIM_NODES];
+static struct sim_remote remotes[SIM_NODES];
+static struct sim_uid rollout[SIM_CARDS];
+static struct sim_uid_frame uid_frames[SIM_UID_FRAMES];
+
+static uint32_t sim_time_us;
+static uint32_t sim_seed = 0x2545f491;
+static uint8_t ctrl_seq;
+static uint16_t ctrl_uid_version;
+/* Nächste Antwort verwerfen, für den Test der Wiederholung */
+static bool sim_lose_response;
+
+static struct {
+  uint32_t frames;
+  uint32_t bytes;
+  uint32_t corrupted;
+  uint32_t timeouts;
+  uint32_t crc_errors;
+  uint32_t failed;
+  uint32_t collisions;
+} sim_stats;
+
+static uint32_t sim_rand(void) {
+  sim_seed ^= sim_seed << 13;
+  sim_seed ^= sim_seed >> 17;
+  sim_seed ^= sim_seed << 5;
+  return sim_seed;
+}
+
+static struct sim_node *sim_node_get(struct bus_node *bus) {
+  return CONTAINER_OF(bus, struct sim_node, bus);
+}
+
+static void node_status(struct bus_node *bus, struct bus_status *status) {
+  struct sim_node *node = sim_node_get(bus);
+
+  status->uptime_s = sim_time_us / USEC_PER_SEC;
+  status->uid_count = node->uid_count;
+  status->uid_version = node->uid_version;
+  status->faecher = 1;
+}
+
+static int node_open(struct bus_node *bus, uint8_t fach, uint8_t cmd) {
+  if (fach != 0) {
+    return -EINVAL;
+  }
+  sim_node_get(bus)->opens++;
+  return 0;
+}
+
+static struct sim_uid *node_uid_find(struct sim_node *node,
+                                     const uint8_t *uid, size_t len) {
+  for (uint16_t i = 0; i < node->uid_count; i++) {
+    if (node->uids[i].len == len && memcmp(node->uids[i].uid, uid, len) == 0) {
+      return &node->uids[i];
+    }
+  }
+  return NULL;
+}
+
+static int node_uid(struct bus_node *bus, const uint8_t *uid, size_t len,
+                    uint8_t faecher, bool remove) {
+  struct sim_node *node = sim_node_get(bus);
+  struct sim_uid *u = node_uid_find(node, uid, len);
+
+  if (u != NULL) {
+    if (remove) {
+      *u = node->uids[--node->uid_count];
+    } else {
+      u->faecher = faecher;
+    }
+    return 0;
+  }
+  if (remove) {
+    return -ENOENT;
+  }
+  if (node->uid_count == SIM_UIDS || len > SIM_UID_LEN) {
+    return -ENOSPC;
+  }
+  u = &node->uids[node->uid_count++];
+  u->len = len;
+  u->faecher = faecher;
+  u->seen = false;
+  memcpy(u->uid, uid, len);
+  return 0;
+}
+
+static uint16_t node_uid_version_get(struct bus_node *bus) {
+  return sim_node_get(bus)->uid_version;
+}
+
+static void node_uid_version_set(struct bus_node *bus, uint16_t version) {
+  sim_node_get(bus)->uid_version = version;
+}
+
+/* Abgleich mit denselben Regeln wie uidsync.c */
+static int node_sync_begin(struct bus_node *bus, uint16_t version,
+                           uint16_t count, uint32_t crc) {
+  struct sim_node *node = sim_node_get(bus);
+
+  if (node->sync.active && node->sync.version == version &&
+      node->sync.count == count && node->sync.crc == crc) {
+    return 0;
+  }
+  for (uint16_t i = 0; i < node->uid_count; i++) {
+    node->uids[i].seen = false;
+  }
+  node->sync.active = true;
+  node->sync.version = version;
+  node->sync.count = count;
+  node->sync.crc = crc;
+  node->sync.received = 0;
+  node->sync.crc_received = 0;
+  return 0;
+}
+
+static int node_sync_data(struct bus_node *bus, uint16_t first,
+                          const uint8_t *data, size_t len) {
+  struct sim_node *node = sim_node_get(bus);
+  struct sim_uid *u;
+  size_t pos;
+
+  if (!node->sync.active) {
+    return -EINVAL;
+  }
+  if (first != node->sync.received) {
+    return first < node->sync.received ? node->sync.received : -EAGAIN;
+  }
+  node->sync.crc_received =
+      crc32_ieee_update(node->sync.crc_received, data, len);
+  for (pos = 0; pos + 2 <= len; pos += 2 + data[pos]) {
+    if (node_uid(bus, &data[pos + 2], data[pos], data[pos + 1], false) < 0) {
+      return -ENOSPC;
+    }
+    u = node_uid_find(node, &data[pos + 2], data[pos]);
+    u->seen = true;
+    node->sync.received++;
+  }
+  return node->sync.received;
+}
+
+static int node_sync_end(struct bus_node *bus) {
+  struct sim_node *node = sim_node_get(bus);
+
+  if (!node->sync.active) {
+    return node->uid_version == node->sync.version ? 0 : -EINVAL;
+  }
+  node->sync.active = false;
+  if (node->sync.received != node->sync.count ||
+      node->sync.crc_received != node->sync.crc) {
+    return -EBADMSG;
+  }
+  for (int i = node->uid_count - 1; i >= 0; i--) {
+    if (!node->uids[i].seen) {
+      node->uids[i] = node->uids[--node->uid_count];
+    }
+  }
+  node->uid_version = node->sync.version;
+  return 0;
+}
+
+static const struct bus_node_ops node_ops = {
+    .status = node_status,
+    .open = node_open,
+    .uid = node_uid,
+    .uid_version_get = node_uid_version_get,
+    .uid_version_set = node_uid_version_set,
+    .sync_begin = node_sync_begin,
+    .sync_data = node_sync_data,
+    .sync_end = node_sync_end,
+};
+
+/* Rahmen auf die Leitung legen, gibt die Länge bis zum ersten 0x00 zurück */
+static size_t sim_wire(uint8_t *frame, size_t len) {
+  uint8_t *end;
+
+  sim_time_us += len * 10 * USEC_PER_SEC / SIM_BAUD;
+  sim_stats.frames++;
+  sim_stats.bytes += len;
+
+  if (sim_rand() % 1000 < SIM_ERROR_PERMILLE) {
+    frame[sim_rand() % len] ^= 1 + sim_rand() % 0xff;
+    sim_stats.corrupted++;
+  }
+  /* Ein gestörtes Byte kann zum Rahmenende werden */
+  end = memchr(frame, 0, len);
+  return end != NULL ? end - frame : len;
+}
+
+/* Alle Kästen empfangen den Rahmen, höchstens einer darf antworten. Die
+   Antwort ersetzt wie in bus.c den empfangenen Rahmen. */
+static size_t sim_deliver(const uint8_t *frame, size_t len, uint8_t *resp) {
+  uint8_t buf[BUS_FRAME_MAX];
+  struct bus_header hdr;
+  uint8_t *payload;
+  size_t resp_len = 0;
+  size_t n;
+  int plen;
+
+  for (int i = 0; i < SIM_NODES; i++) {
+    memcpy(buf, frame, len);
+    plen = bus_frame_decode(buf, len, &hdr, &payload);
+    if (plen < 0) {
+      continue;
+    }
+    n = bus_node_handle(&nodes[i].bus, &hdr, payload, plen, buf);
+    if (n == 0) {
+      continue;
+    }
+    if (resp_len > 0) {
+      sim_stats.collisions++;
+    }
+    memcpy(resp, buf, n);
+    resp_len = n;
+  }
+  return resp_len;
+}
+
+/**
+ * @brief Anfrage senden und auf die Antwort warten, mit Wiederholungen
+ *
+ * @return Länge der Antwortdaten, 0 bei Broadcasts, -ETIMEDOUT
+ */
+static int sim_request(uint8_t addr, uint8_t type, const void *data,
+                       size_t len, uint8_t *resp_payload) {
+  struct bus_header hdr = {.addr = addr, .type = type, .seq = ctrl_seq++};
+  struct bus_header rhdr;
+  uint8_t frame[BUS_FRAME_MAX];
+  uint8_t resp[BUS_FRAME_MAX];
+  uint8_t *payload;
+  size_t n;
+  int plen;
+
+  for (int attempt = 0; attempt <= SIM_RETRIES; attempt++) {
+    n = bus_frame_encode(&hdr, data, len, frame);
+    n = sim_wire(frame, n);
+    n = sim_deliver(frame, n, resp);
+    sim_time_us += SIM_GAP_US;
+    if (addr == BUS_ADDR_BROADCAST) {
+      return 0;
+    }
+    if (n == 0 || sim_lose_response) {
+      sim_lose_response = false;
+      sim_time_us += SIM_TIMEOUT_US;
+      sim_stats.timeouts++;
+      continue;
+    }
+
+    sim_time_us += SIM_TURNAROUND_US;
+    n = sim_wire(resp, n);
+    plen = bus_frame_decode(resp, n, &rhdr, &payload);
+    if (plen < 0 || rhdr.addr != addr || rhdr.type != (type | BUS_RESPONSE) ||
+        rhdr.seq != hdr.seq) {
+      sim_stats.crc_errors++;
+      continue;
+    }
+    memcpy(resp_payload, payload, plen);
+    return plen;
+  }
+  sim_stats.failed++;
+  return -ETIMEDOUT;
+}
+
+static void sim_events(void) {
+  struct sim_node *node;
+  int n;
+
+  for (int i = 0; i < SIM_NODES; i++) {
+    if (sim_rand() % 100 >= SIM_EVENT_PERCENT) {
+      continue;
+    }
+    node = &nodes[i];
+    /* Eine Öffnung erzeugt ein bis drei Ereignisse */
+    n = 1 + sim_rand() % 3;
+    for (int e = 0; e < n; e++) {
+      bus_node_event(&node->bus, 6 + e % 3, sim_rand(), 1,
+                     sim_time_us / USEC_PER_SEC);
+      node->events++;
+    }
+  }
+}
+
+/* Ein Kasten, Ereignisse übernehmen und Stand der UID-Liste merken */
+static int sim_poll(int i) {
+  struct sim_remote *r = &remotes[i];
+  uint8_t resp[BUS_PAYLOAD_MAX];
+  struct bus_poll poll = {.event_next = r->event_next};
+  struct bus_status *status = (struct bus_status *)resp;
+  struct bus_event *e = (struct bus_event *)(status + 1);
+  int len;
+
+  len = sim_request(nodes[i].bus.addr, BUS_POLL, &poll, sizeof(poll), resp);
+  if (len < (int)sizeof(*status)) {
+    return -ETIMEDOUT;
+  }
+  r->uid_version = status->uid_version;
+  for (uint8_t k = 0; k < status->event_count; k++) {
+    /* Nach verlorener Antwort kommen schon bekannte Ereignisse erneut */
+    if ((uint8_t)(e[k].seq - r->event_next) >= 128) {
+      continue;
+    }
+    r->event_next = e[k].seq + 1;
+    r->events++;
+  }
+  return 0;
+}
+
+static void sim_poll_rounds(void) {
+  uint32_t start = sim_time_us;
+  uint32_t generated = 0;
+  uint32_t received = 0;
+  uint32_t lost = 0;
+  uint32_t t;
+
+  for (int round = 0; round < SIM_POLL_ROUNDS; round++) {
+    sim_events();
+    for (int i = 0; i < SIM_NODES; i++) {
+      sim_poll(i);
+    }
+  }
+  /* Restliche Ereignisse abholen, dabei kommen keine neuen hinzu */
+  for (int round = 0; round < 4; round++) {
+    for (int i = 0; i < SIM_NODES; i++) {
+      sim_poll(i);
+    }
+  }
+  t = sim_time_us - start;
+
+  for (int i = 0; i < SIM_NODES; i++) {
+    generated += nodes[i].events;
+    received += remotes[i].events;
+    lost += nodes[i].bus.events_lost;
+  }
+  printk("poll: %u nodes, %u rounds in %u ms, %u us per node, "
+         "round %u ms\n",
+         SIM_NODES, SIM_POLL_ROUNDS + 4, t / USEC_PER_MSEC,
+         t / ((SIM_POLL_ROUNDS + 4) * SIM_NODES),
+         t / (SIM_POLL_ROUNDS + 4) / USEC_PER_MSEC);
+  printk("poll: events generated %u, received %u, lost %u, %u events/s\n",
+         generated, received, lost,
+         (uint32_t)((uint64_t)received * USEC_PER_SEC / t));
+}
+
+/* Änderungen in Rahmen mit je einem Versionsschritt packen */
+static int sim_uid_pack(const struct sim_uid *list, int count, bool remove,
+                        uint16_t base) {
+  struct sim_uid_frame *f = NULL;
+  struct bus_uid *upd = NULL;
+  struct bus_uid_record *rec;
+  int frames = 0;
+
+  for (int i = 0; i < count; i++) {
+    size_t need = sizeof(*rec) + list[i].len;
+
+    if (f == NULL || f->len + need > BUS_PAYLOAD_MAX) {
+      if (frames == SIM_UID_FRAMES) {
+        return -ENOMEM;
+      }
+      f = &uid_frames[frames];
+      upd = (struct bus_uid *)f->data;
+      upd->base = base + frames;
+      upd->version = base + frames + 1;
+      upd->count = 0;
+      f->len = sizeof(*upd);
+      frames++;
+    }
+    rec = (struct bus_uid_record *)(f->data + f->len);
+    rec->len = list[i].len | (remove ? BUS_UID_DELETE : 0);
+    rec->faecher = list[i].faecher;
+    memcpy(rec->uid, list[i].uid, list[i].len);
+    f->len += need;
+    upd->count++;
+  }
+  return frames;
+}
+
+/* Ab Rahmen first per Broadcast, Kästen mit neuerem Stand ignorieren die
+   älteren Rahmen */
+static void sim_uid_broadcast(int first, int frames) {
+  uint8_t resp[BUS_PAYLOAD_MAX];
+
+  for (int k = first; k < frames; k++) {
+    sim_request(BUS_ADDR_BROADCAST, BUS_UID, uid_frames[k].data,
+                uid_frames[k].len, resp);
+  }
+}
+
+/* Alle Rahmen per Broadcast, dann den Stand abfragen. Fehlt vielen Kästen
+   etwas, wird ab dem ältesten Stand wiederholt, sonst einzeln nachversorgt. */
+static void sim_uid_update(const char *name, const struct sim_uid *list,
+                           int count, bool remove) {
+  uint8_t resp[BUS_PAYLOAD_MAX];
+  uint32_t start = sim_time_us;
+  uint16_t base = ctrl_uid_version;
+  uint32_t unicast = 0;
+  int behind = 0;
+  int frames;
+  int first;
+  int pass;
+  int k;
+
+  frames = sim_uid_pack(list, count, remove, base);
+  if (frames < 0) {
+    printk("%s: too many changes\n", name);
+    return;
+  }
+  ctrl_uid_version = base + frames;
+  sim_uid_broadcast(0, frames);
+
+  for (pass = 0; pass < SIM_UID_PASSES; pass++) {
+    behind = 0;
+    first = frames;
+    for (int i = 0; i < SIM_NODES; i++) {
+      if (sim_poll(i) == 0 && remotes[i].uid_version != ctrl_uid_version) {
+        behind++;
+        first = MIN(first, (uint16_t)(remotes[i].uid_version - base));
+      }
+    }
+    if (behind == 0) {
+      break;
+    }
+    if (behind > SIM_UID_UNICAST_MAX) {
+      sim_uid_broadcast(first, frames);
+      continue;
+    }
+    for (int i = 0; i < SIM_NODES; i++) {
+      /* Ab dem Stand des Kastens weiter, eine Antwort bestätigt ihn */
+      k = (uint16_t)(remotes[i].uid_version - base);
+      for (; k < frames; k++) {
+        unicast++;
+        if (sim_request(nodes[i].bus.addr, BUS_UID, uid_frames[k].data,
+                        uid_frames[k].len, resp) < 0) {
+          break;
+        }
+      }
+    }
+  }
+
+  printk("%s: %d cards in %d frames, %u ms, %d passes, %u unicast, "
+         "%d nodes behind\n",
+         name, count, frames, (sim_time_us - start) / USEC_PER_MSEC, pass,
+         unicast, behind);
+}
+
+/* Vollständige Liste als Rahmenfolge Start, Daten, Ende */
+static int sim_sync_pack(const struct sim_uid *list, int count,
+                         uint16_t version) {
+  struct sim_uid_frame *f = &uid_frames[0];
+  struct bus_sync_begin *begin = (struct bus_sync_begin *)f->data;
+  struct bus_sync_data *data = NULL;
+  uint32_t crc = 0;
+  int frames = 1;
+
+  for (int i = 0; i < count; i++) {
+    size_t need = 2 + list[i].len;
+
+    if (data == NULL || f->len + need > BUS_PAYLOAD_MAX) {
+      if (frames == SIM_UID_FRAMES - 1) {
+        return -ENOMEM;
+      }
+      f = &uid_frames[frames++];
+      data = (struct bus_sync_data *)f->data;
+      data->hdr.op = BUS_SYNC_DATA;
+      data->first = i;
+      f->len = sizeof(*data);
+    }
+    f->data[f->len] = list[i].len;
+    f->data[f->len + 1] = list[i].faecher;
+    memcpy(&f->data[f->len + 2], list[i].uid, list[i].len);
+    crc = crc32_ieee_update(crc, &f->data[f->len], need);
+    f->len += need;
+  }
+
+  begin->hdr.op = BUS_SYNC_BEGIN;
+  begin->version = version;
+  begin->count = count;
+  begin->crc = crc;
+  uid_frames[0].len = sizeof(*begin);
+  uid_frames[frames].data[0] = BUS_SYNC_END;
+  uid_frames[frames].len = sizeof(struct bus_sync);
+  return frames + 1;
+}
+
+static void sim_sync_send(uint8_t addr, int frames) {
+  uint8_t resp[BUS_PAYLOAD_MAX];
+
+  for (int k = 0; k < frames; k++) {
+    if (sim_request(addr, BUS_SYNC, uid_frames[k].data, uid_frames[k].len,
+                    resp) < 0) {
+      return;
+    }
+  }
+}
+
+/* Neue Kartenliste per Broadcast, Kästen ohne die neue Version bekommen
+   die ganze Folge noch einmal */
+static void sim_uid_sync(const struct sim_uid *list, int count) {
+  uint32_t start = sim_time_us;
+  uint32_t resent = 0;
+  int behind = 0;
+  int frames;
+  int pass;
+
+  frames = sim_sync_pack(list, count, ctrl_uid_version + 1);
+  if (frames < 0) {
+    printk("sync: too many cards\n");
+    return;
+  }
+  ctrl_uid_version++;
+  sim_sync_send(BUS_ADDR_BROADCAST, frames);
+
+  for (pass = 0; pass < SIM_UID_PASSES; pass++) {
+    behind = 0;
+    for (int i = 0; i < SIM_NODES; i++) {
+      if (sim_poll(i) == 0 && remotes[i].uid_version != ctrl_uid_version) {
+        behind++;
+      }
+    }
+    if (behind == 0) {
+      break;
+    }
+    if (behind > SIM_UID_UNICAST_MAX) {
+      sim_sync_send(BUS_ADDR_BROADCAST, frames);
+      resent++;
+      continue;
+    }
+    for (int i = 0; i < SIM_NODES; i++) {
+      if (remotes[i].uid_version != ctrl_uid_version) {
+        sim_sync_send(nodes[i].bus.addr, frames);
+        resent++;
+      }
+    }
+  }
+
+  printk("sync: %d cards in %d frames, %u ms, %d passes, %u resent, "
+         "%d nodes behind\n",
+         count, frames, (sim_time_us - start) / USEC_PER_MSEC, pass, resent,
+         behind);
+}
+
+static void sim_uid_check(uint16_t expected) {
+  int wrong = 0;
+
+  for (int i = 0; i < SIM_NODES; i++) {
+    if (nodes[i].uid_count != expected ||
+        nodes[i].uid_version != ctrl_uid_version) {
+      wrong++;
+    }
+  }
+  printk("uid: version %u, %u cards, %d nodes differ\n", ctrl_uid_version,
+         expected, wrong);
+}
+
+/* Öffnen mit verlorener Antwort, die Wiederholung darf nicht erneut öffnen.
+   Danach eine Abfrage und ein neues Öffnen mit derselben Folgenummer wie
+   nach 256 Rahmen an andere Kästen, das muss wieder öffnen. */
+static void sim_open(void) {
+  uint8_t resp[BUS_PAYLOAD_MAX];
+  struct bus_open open = {.fach = 0, .cmd = 0};
+  struct bus_ack *ack = (struct bus_ack *)resp;
+  int i = SIM_NODES / 2;
+  struct sim_node *node = &nodes[i];
+  uint32_t start = sim_time_us;
+  uint8_t seq = ctrl_seq;
+  int ret;
+
+  sim_lose_response = true;
+  ret = sim_request(node->bus.addr, BUS_OPEN, &open, sizeof(open), resp);
+  printk("open: node %u, ret %d, ack %d, opened %u times, %u us\n",
+         node->bus.addr, ret, ret > 0 ? ack->ret : 0, node->opens,
+         sim_time_us - start);
+
+  sim_poll(i);
+  ctrl_seq = seq;
+  ret = sim_request(node->bus.addr, BUS_OPEN, &open, sizeof(open), resp);
+  printk("open: same seq after poll, ret %d, ack %d, opened %u times\n", ret,
+         ret > 0 ? ack->ret : 0, node->opens);
+}
+
+int main(void) {
+  for (int i = 0; i < SIM_NODES; i++) {
+    nodes[i].bus.ops = &node_ops;
+    nodes[i].bus.addr = i + 1;
+  }
+  for (int i = 0; i < SIM_CARDS; i++) {
+    rollout[i].len = SIM_UID_LEN;
+    rollout[i].faecher = BIT(0);
+    for (int b = 0; b < SIM_UID_LEN; b++) {
+      rollout[i].uid[b] = sim_rand();
+    }
+  }
+
+  printk("bus sim: %u baud, %u permille corrupted frames, payload %u, "
+         "%u events per poll\n",
+         SIM_BAUD, SIM_ERROR_PERMILLE, BUS_PAYLOAD_MAX,
+         (uint32_t)BUS_POLL_EVENTS);
+
+  sim_poll_rounds();
+  sim_uid_update("rollout", rollout, SIM_ROLLOUT, false);
+  sim_uid_check(SIM_ROLLOUT);
+  sim_uid_update("revoke", rollout, SIM_REVOKE, true);
+  sim_uid_check(SIM_ROLLOUT - SIM_REVOKE);
+  sim_uid_sync(&rollout[SIM_SYNC_FIRST], SIM_SYNC_COUNT);
+  sim_uid_check(SIM_SYNC_COUNT);
+  sim_open();
+
+  printk("wire: %u frames, %u bytes, %u corrupted, %u timeouts, "
+         "%u crc errors, %u failed, %u collisions\n",
+         sim_stats.frames, sim_stats.bytes, sim_stats.corrupted,
+         sim_stats.timeouts, sim_stats.crc_errors, sim_stats.failed,
+         sim_stats.collisions);
+  return 0;
+}
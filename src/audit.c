@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "audit.h"
+#include "bus.h"
+#include "storage_io.h"
+#include "writeback.h"
+#include <time.h>
+#include <zephyr/drivers/eeprom.h>
+#include <zephyr/drivers/rtc.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/timeutil.h>
+
+/* Ring in der oberen Hälfte von eeprom1 (Seiten 256..510, siehe
+   logstore.c, Seite 511 ist Kopie A der Konfiguration). Jede Seite enthält einen Kopf mit Sequenznummer und sieben
+   Ereignisse. Die aktuelle Seite liegt im RAM und wird zurückgestellt
+   geschrieben, mehrere Ereignisse einer Öffnung kosten so einen
+   Seitenzugriff. */
+#define AUDIT_NODE DT_NODELABEL(eeprom1)
+#define AUDIT_PAGE_SIZE DT_PROP(AUDIT_NODE, pagesize)
+#define AUDIT_FIRST_PAGE 256
+#define AUDIT_PAGES 255
+#define AUDIT_PAGE_OFFSET(p) ((AUDIT_FIRST_PAGE + (p)) * AUDIT_PAGE_SIZE)
+#define AUDIT_RECORDS 7
+
+/* Seiten pro Aufruf von audit_process, gelesen wird im Block (storage_io) */
+#define AUDIT_EXPORT_BURST 2
+
+#define AUDIT_RTC_NODE DT_NODELABEL(rtc)
+
+struct audit_record {
+  uint32_t time; // RTC, Sekunden seit 1970
+  uint8_t event;
+  uint8_t result;
+  uint16_t uid_hash;
+} __packed;
+
+struct audit_page_header {
+  uint32_t seq;
+  uint8_t count;
+  uint8_t reserved;
+  uint16_t crc; // CRC16 (ITU-T) über count und die Ereignisse
+} __packed;
+
+struct audit_page {
+  struct audit_page_header hdr;
+  struct audit_record rec[AUDIT_RECORDS];
+} __packed;
+
+BUILD_ASSERT(sizeof(struct audit_page) == AUDIT_PAGE_SIZE,
+             "struct audit_page must fill one EEPROM page");
+
+static const struct device *audit_dev = DEVICE_DT_GET(AUDIT_NODE);
+static const struct device *audit_rtc = DEVICE_DT_GET(AUDIT_RTC_NODE);
+
+/* Seite im RAM, wird an Position audit_head geschrieben */
+static struct audit_page audit_buf;
+static uint16_t audit_head;
+static uint32_t audit_dropped;
+static bool audit_ready;
+static struct k_spinlock audit_spin;
+static struct writeback audit_wb;
+
+/* Laufende Ausgabe, audit_export_left == 0 wenn keine */
+static uint16_t audit_export_page;
+static uint16_t audit_export_left;
+
+static uint16_t audit_crc(const struct audit_page *page) {
+  uint16_t crc = crc16_itu_t(0xffff, &page->hdr.count, 1);
+
+  return crc16_itu_t(crc, (const uint8_t *)page->rec,
+                     page->hdr.count * sizeof(struct audit_record));
+}
+
+uint32_t audit_time(void) {
+  struct rtc_time t;
+
+  /* Die RTC liefert -ENODATA, bis sie einmal gestellt wurde */
+  if (!device_is_ready(audit_rtc) || rtc_get_time(audit_rtc, &t) < 0) {
+    return AUDIT_TIME_UNKNOWN |
+           ((uint32_t)(k_uptime_get() / MSEC_PER_SEC) & ~AUDIT_TIME_UNKNOWN);
+  }
+  return (uint32_t)timeutil_timegm(rtc_time_to_tm(&t));
+}
+
+int audit_set_time(uint32_t time) {
+  struct rtc_time t = {0};
+  time_t secs = time;
+
+  if (time & AUDIT_TIME_UNKNOWN) {
+    return -EINVAL;
+  }
+  if (!device_is_ready(audit_rtc)) {
+    return -ENODEV;
+  }
+  if (gmtime_r(&secs, rtc_time_to_tm(&t)) == NULL) {
+    return -EINVAL;
+  }
+  return rtc_set_time(audit_rtc, &t);
+}
+
+static int audit_commit(struct writeback *wb) {
+  struct audit_page page;
+  k_spinlock_key_t key;
+  bool full;
+  int ret;
+
+  key = k_spin_lock(&audit_spin);
+  page = audit_buf;
+  k_spin_unlock(&audit_spin, key);
+
+  page.hdr.crc = audit_crc(&page);
+  ret = storage_io_write(audit_dev, AUDIT_PAGE_OFFSET(audit_head), &page,
+                     sizeof(page));
+  if (ret < 0) {
+    return ret;
+  }
+
+  key = k_spin_lock(&audit_spin);
+  full = audit_buf.hdr.count == AUDIT_RECORDS;
+  if (full && page.hdr.count == AUDIT_RECORDS) {
+    /* Nächste Seite beginnen */
+    audit_head = (audit_head + 1) % AUDIT_PAGES;
+    audit_buf.hdr.seq++;
+    audit_buf.hdr.count = 0;
+  }
+  k_spin_unlock(&audit_spin, key);
+
+  return 0;
+}
+
+int audit_init(void) {
+  struct audit_page_header hdr;
+  uint32_t max_seq = 0;
+  bool empty = true;
+  int ret;
+
+  if (!device_is_ready(audit_dev)) {
+    return -ENODEV;
+  }
+
+  writeback_register(&audit_wb, audit_commit);
+
+  /* Nur die Seitenköpfe lesen, die neueste Seite ist der Kopf */
+  for (uint16_t p = 0; p < AUDIT_PAGES; p++) {
+    ret = storage_io_read(audit_dev, AUDIT_PAGE_OFFSET(p), &hdr, sizeof(hdr));
+    if (ret < 0) {
+      return ret;
+    }
+    if (hdr.count == 0 || hdr.count > AUDIT_RECORDS) {
+      continue;
+    }
+    if (empty || hdr.seq > max_seq) {
+      max_seq = hdr.seq;
+      audit_head = p;
+      empty = false;
+    }
+  }
+
+  if (!empty) {
+    ret = storage_io_read(audit_dev, AUDIT_PAGE_OFFSET(audit_head), &audit_buf,
+                      sizeof(audit_buf));
+    if (ret < 0) {
+      return ret;
+    }
+    if (audit_buf.hdr.crc != audit_crc(&audit_buf) ||
+        audit_buf.hdr.count == AUDIT_RECORDS) {
+      /* Volle oder beschädigte Seite nicht fortsetzen */
+      audit_head = (audit_head + 1) % AUDIT_PAGES;
+      audit_buf.hdr.seq = max_seq + 1;
+      audit_buf.hdr.count = 0;
+    }
+  } else {
+    memset(&audit_buf, 0, sizeof(audit_buf));
+  }
+
+  audit_ready = true;
+  audit_log(AUDIT_BOOT, 0, 0);
+  return 0;
+}
+
+void audit_log(audit_event_t event, uint16_t uid_hash, uint8_t result) {
+  struct audit_record rec = {
+      .time = audit_time(),
+      .event = event,
+      .result = result,
+      .uid_hash = uid_hash,
+  };
+  k_spinlock_key_t key;
+
+  /* Der Controller bekommt die Ereignisse auch ohne EEPROM */
+  bus_event(event, uid_hash, result, rec.time);
+
+  if (!audit_ready) {
+    return;
+  }
+
+  key = k_spin_lock(&audit_spin);
+  if (audit_buf.hdr.count < AUDIT_RECORDS) {
+    audit_buf.rec[audit_buf.hdr.count++] = rec;
+  } else {
+    /* Die volle Seite ist noch nicht geschrieben */
+    audit_dropped++;
+  }
+  k_spin_unlock(&audit_spin, key);
+
+  writeback_mark(&audit_wb);
+}
+
+uint16_t audit_uid_hash(const uint8_t *uid, size_t len) {
+  return crc16_itu_t(0xffff, uid, len);
+}
+
+void audit_export_start(void) {
+  if (!audit_ready) {
+    printk("AUDIT not available\n");
+    return;
+  }
+  /* Gepufferte Ereignisse zuerst schreiben */
+  writeback_flush();
+  /* Älteste Seite zuerst, Seiten ohne Ereignisse überspringt der Decoder */
+  audit_export_page = (audit_head + 1) % AUDIT_PAGES;
+  audit_export_left = AUDIT_PAGES;
+  printk("AUDIT %u pages, dropped %u\n", AUDIT_PAGES, audit_dropped);
+}
+
+void audit_process(void) {
+  static uint8_t buf[AUDIT_EXPORT_BURST * AUDIT_PAGE_SIZE];
+  uint16_t pages;
+
+  if (audit_export_left == 0) {
+    return;
+  }
+
+  /* Nicht über das Ende des Rings */
+  pages = MIN(MIN(audit_export_left, AUDIT_EXPORT_BURST),
+              AUDIT_PAGES - audit_export_page);
+  if (storage_io_read(audit_dev, AUDIT_PAGE_OFFSET(audit_export_page), buf,
+                  pages * AUDIT_PAGE_SIZE) < 0) {
+    printk("AUDIT read failed\n");
+    audit_export_left = 0;
+    return;
+  }
+
+  for (uint16_t p = 0; p < pages; p++) {
+    for (int i = 0; i < AUDIT_PAGE_SIZE; i++) {
+      printk("%02x", buf[p * AUDIT_PAGE_SIZE + i]);
+    }
+    printk("\n");
+  }
+
+  audit_export_page = (audit_export_page + pages) % AUDIT_PAGES;
+  audit_export_left -= pages;
+  if (audit_export_left == 0) {
+    printk("AUDIT END\n");
+  }
+}
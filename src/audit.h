@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef AUDIT_H
+#define AUDIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Zeit eines Ereignisses: Sekunden seit 1970 aus der RTC. Ist die Uhr noch
+   nicht gestellt, ist Bit 31 gesetzt und der Rest sind Sekunden seit dem
+   Start. */
+#define AUDIT_TIME_UNKNOWN 0x80000000U
+
+/* Muss mit EVENTS in scripts/audit_decode.py übereinstimmen */
+typedef enum {
+  AUDIT_BOOT,
+  AUDIT_OPEN_BRIEF,   // result: AUDIT_FACH
+  AUDIT_OPEN_PAKET,   // result: AUDIT_FACH
+  AUDIT_LOCKOUT,      // Paketfach gesperrt, result: AUDIT_FACH
+  AUDIT_MOTOR_TIMEOUT,
+  AUDIT_MOTOR_STOP,   // Stopp nach verpassten Deadlines
+  AUDIT_RFID_ACCEPT,  // result: berechtigte Fächer
+  AUDIT_RFID_REJECT,
+  AUDIT_UID_ADD,
+  AUDIT_UID_REMOVE,
+  AUDIT_UID_SYNC,     // uid_hash: neue Listenversion, result: Änderungen
+} audit_event_t;
+
+/* result der Fach-Ereignisse: Fach in Bit 4..7, Zustand davor in Bit 0..3 */
+#define AUDIT_FACH(fach, state) ((uint8_t)(((fach) << 4) | ((state) & 0x0f)))
+
+/**
+ * @brief Audit-Log einhängen
+ *
+ * Liest nur die Seitenköpfe des Rings und setzt eine angefangene Seite fort.
+ *
+ * @return 0 bei Erfolg, sonst negativer Fehler
+ */
+int audit_init(void);
+
+/**
+ * @brief Ereignis protokollieren
+ *
+ * Schreibt nur in den RAM-Puffer und kann deshalb auch in der Workqueue der
+ * Motorregelung aufgerufen werden. Die Seite wird zurückgestellt geschrieben.
+ *
+ * @param event Ereignis
+ * @param uid_hash Kurzform der UID (audit_uid_hash) oder 0
+ * @param result Ergebnis oder Zusatzwert
+ */
+void audit_log(audit_event_t event, uint16_t uid_hash, uint8_t result);
+
+/* Aktuelle Zeit im Format der Ereignisse (AUDIT_TIME_UNKNOWN) */
+uint32_t audit_time(void);
+
+/**
+ * @brief Uhr stellen
+ *
+ * @param time Sekunden seit 1970 (UTC)
+ * @return 0 bei Erfolg, sonst negativer Fehler
+ */
+int audit_set_time(uint32_t time);
+
+/* 16 Bit Hash einer UID, die UID selbst wird nicht protokolliert */
+uint16_t audit_uid_hash(const uint8_t *uid, size_t len);
+
+/* Ausgabe des gesamten Rings starten, läuft mit audit_process() weiter */
+void audit_export_start(void);
+
+/* Gibt einen Teil der laufenden Ausgabe aus, aus der Hauptschleife */
+void audit_process(void);
+
+#endif // AUDIT_H
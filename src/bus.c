@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "bus.h"
+#include "audit.h"
+#include "bus_proto.h"
+#include "compartment.h"
+#include "config.h"
+#include "eeprom.h"
+#include "motor.h"
+#include "powermanager.h"
+#include "states.h"
+#include "uidsync.h"
+#include "writeback.h"
+#include <string.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(bus, CONFIG_PAKETKASTEN_LOG_LEVEL);
+
+#define BUS_NODE DT_COMPAT_GET_ANY_STATUS_OKAY(dhl_paketkasten_bus)
+
+/* Längste Antwort bei 115200 Baud etwa 7 ms */
+#define BUS_TX_TIMEOUT_MS 50
+
+static const struct device *bus_uart =
+    DEVICE_DT_GET(DT_PHANDLE(BUS_NODE, uart));
+static const struct gpio_dt_spec bus_de =
+    GPIO_DT_SPEC_GET_OR(BUS_NODE, de_gpios, {0});
+
+/* Ein Puffer für Empfang und Antwort. Der UART-ISR füllt ihn, bis ein
+   Rahmen an diesen Kasten vollständig ist. Danach gehört er bus_work in der
+   Speicher-Workqueue, bis die Antwort gesendet ist, Rahmen in dieser Zeit
+   werden verworfen. Der Controller sendet ohnehin erst nach der Antwort
+   oder seinem Timeout weiter. */
+static uint8_t bus_buf[BUS_FRAME_MAX];
+static size_t bus_rx_len;
+static bool bus_rx_overflow;
+static bool bus_rx_skip; // Rest des Rahmens bis zum Abschluss verwerfen
+static atomic_t bus_busy;
+
+/* Laufende Antwort in bus_buf, wird im ISR in den FIFO geschrieben */
+static size_t bus_tx_len;
+static size_t bus_tx_pos;
+static K_SEM_DEFINE(bus_tx_done, 0, 1);
+
+static void bus_handler(struct k_work *work);
+static K_WORK_DEFINE(bus_work, bus_handler);
+
+static struct {
+  uint32_t frames;
+  uint32_t responses;
+  uint32_t crc_errors;
+  uint32_t foreign; // an andere Kästen, im ISR verworfen
+  uint32_t dropped; // während der Bearbeitung des vorherigen Rahmens
+  uint32_t too_long;
+  uint32_t tx_timeouts;
+} bus_stats;
+
+static void bus_status(struct bus_node *node, struct bus_status *status) {
+  status->uptime_s = k_uptime_get() / MSEC_PER_SEC;
+  status->uid_count = eeprom_uid_count();
+  status->uid_version = config_get()->uid_version;
+  status->flags = motor_is_running() ? BUS_STATUS_MOTOR : 0;
+  status->faecher = COMPARTMENT_COUNT;
+  for (uint8_t fach = 0; fach < COMPARTMENT_COUNT; fach++) {
+    status->state[fach] = states_get(fach);
+  }
+}
+
+static int bus_open(struct bus_node *node, uint8_t fach, uint8_t cmd) {
+  if (cmd != CMD_OEFFNE_PAKET && cmd != CMD_OEFFNE_BRIEF) {
+    return -EINVAL;
+  }
+  return push_command(fach, cmd);
+}
+
+static int bus_uid(struct bus_node *node, const uint8_t *uid, size_t len,
+                   uint8_t faecher, bool remove) {
+  int ret;
+
+  if (remove) {
+    ret = eeprom_remove_uid(uid, len);
+  } else {
+    ret = eeprom_add_uid(uid, len, faecher);
+  }
+  if (ret == 0) {
+    audit_log(remove ? AUDIT_UID_REMOVE : AUDIT_UID_ADD,
+              audit_uid_hash(uid, len), remove ? 0 : faecher);
+  }
+  return ret;
+}
+
+static uint16_t bus_uid_version_get(struct bus_node *node) {
+  return config_get()->uid_version;
+}
+
+static void bus_uid_version_set(struct bus_node *node, uint16_t version) {
+  config_set_uid_version(version);
+}
+
+static int bus_sync_begin(struct bus_node *node, uint16_t version,
+                          uint16_t count, uint32_t crc) {
+  return uidsync_begin(version, count, crc);
+}
+
+static int bus_sync_data(struct bus_node *node, uint16_t first,
+                         const uint8_t *data, size_t len) {
+  return uidsync_data(first, data, len);
+}
+
+static int bus_sync_end(struct bus_node *node) { return uidsync_end(); }
+
+static const struct bus_node_ops bus_ops = {
+    .status = bus_status,
+    .open = bus_open,
+    .uid = bus_uid,
+    .uid_version_get = bus_uid_version_get,
+    .uid_version_set = bus_uid_version_set,
+    .sync_begin = bus_sync_begin,
+    .sync_data = bus_sync_data,
+    .sync_end = bus_sync_end,
+};
+
+static struct bus_node bus_node = {
+    .ops = &bus_ops,
+};
+
+/* Adresse steht im ersten COBS-Block, ein Block der Länge 1 bedeutet 0x00 */
+static bool bus_rx_for_us(void) {
+  uint8_t addr = bus_buf[0] > 1 ? bus_buf[1] : 0;
+
+  return addr == bus_node.addr || addr == BUS_ADDR_BROADCAST;
+}
+
+static void bus_rx_end(void) {
+  if (bus_rx_skip) {
+    /* Eigenes Echo während der Antwort zählt nicht */
+    if (bus_tx_len == 0) {
+      bus_stats.dropped++;
+    }
+    bus_rx_skip = false;
+    return;
+  }
+  if (bus_rx_overflow) {
+    bus_stats.too_long++;
+  } else if (bus_rx_len < 2) {
+    /* Leerer Rahmen, z.B. Abschluss nach einer Störung */
+  } else if (!bus_rx_for_us()) {
+    bus_stats.foreign++;
+  } else {
+    atomic_set(&bus_busy, 1);
+    if (writeback_submit(&bus_work) >= 0) {
+      return;
+    }
+    /* Speicher-Workqueue wird gerade vor dem Schlafen geleert */
+    atomic_clear(&bus_busy);
+    bus_stats.dropped++;
+  }
+  bus_rx_len = 0;
+  bus_rx_overflow = false;
+}
+
+static void bus_isr(const struct device *dev, void *user_data) {
+  uint8_t buf[8];
+  int n;
+
+  while (uart_irq_update(dev) && uart_irq_is_pending(dev)) {
+    if (uart_irq_rx_ready(dev)) {
+      n = uart_fifo_read(dev, buf, sizeof(buf));
+      for (int i = 0; i < n; i++) {
+        if (buf[i] == 0) {
+          bus_rx_end();
+        } else if (bus_rx_skip || atomic_get(&bus_busy)) {
+          bus_rx_skip = true;
+        } else if (bus_rx_len < sizeof(bus_buf)) {
+          bus_buf[bus_rx_len++] = buf[i];
+        } else {
+          bus_rx_overflow = true;
+        }
+      }
+    }
+
+    if (uart_irq_tx_ready(dev) && bus_tx_pos < bus_tx_len) {
+      bus_tx_pos += uart_fifo_fill(dev, bus_buf + bus_tx_pos,
+                                   bus_tx_len - bus_tx_pos);
+    }
+    if (bus_tx_pos == bus_tx_len && bus_tx_len > 0 &&
+        uart_irq_tx_complete(dev)) {
+      /* Letztes Bit ist draußen, Leitung für den nächsten freigeben */
+      uart_irq_tx_disable(dev);
+      if (bus_de.port != NULL) {
+        gpio_pin_set_dt(&bus_de, 0);
+      }
+      bus_tx_len = 0;
+      k_sem_give(&bus_tx_done);
+    }
+  }
+}
+
+static void bus_send(size_t len) {
+  bus_tx_len = len;
+  bus_tx_pos = 0;
+  if (bus_de.port != NULL) {
+    gpio_pin_set_dt(&bus_de, 1);
+  }
+  uart_irq_tx_enable(bus_uart);
+
+  if (k_sem_take(&bus_tx_done, K_MSEC(BUS_TX_TIMEOUT_MS)) < 0) {
+    uart_irq_tx_disable(bus_uart);
+    if (bus_de.port != NULL) {
+      gpio_pin_set_dt(&bus_de, 0);
+    }
+    bus_tx_len = 0;
+    bus_stats.tx_timeouts++;
+  }
+}
+
+/* Läuft in der Speicher-Workqueue, die auch die UID-Tabelle schreibt. Die
+   Antwort ersetzt den Rahmen in bus_buf. */
+static void bus_handler(struct k_work *work) {
+  struct bus_header hdr;
+  uint8_t *payload;
+  size_t n;
+  int len;
+
+  bus_stats.frames++;
+  len = bus_frame_decode(bus_buf, bus_rx_len, &hdr, &payload);
+  if (len < 0) {
+    bus_stats.crc_errors++;
+  } else if (hdr.type & BUS_RESPONSE) {
+    /* Antwort eines anderen Kastens mit zufällig passendem Anfang */
+  } else {
+    powermanager_wakeup();
+    n = bus_node_handle(&bus_node, &hdr, payload, len, bus_buf);
+    if (n > 0) {
+      bus_stats.responses++;
+      bus_send(n);
+    }
+  }
+
+  bus_rx_len = 0;
+  bus_rx_overflow = false;
+  atomic_clear(&bus_busy);
+}
+
+int bus_init(void) {
+  bus_node.addr = config_get()->bus_addr;
+  if (bus_node.addr == BUS_ADDR_NONE || bus_node.addr > BUS_ADDR_MAX) {
+    LOG_INF("No bus address, bus disabled");
+    bus_node.addr = BUS_ADDR_NONE;
+    return 0;
+  }
+  if (!device_is_ready(bus_uart)) {
+    LOG_ERR("Bus UART not ready");
+    return -ENODEV;
+  }
+  if (bus_de.port != NULL) {
+    if (!gpio_is_ready_dt(&bus_de)) {
+      return -ENODEV;
+    }
+    gpio_pin_configure_dt(&bus_de, GPIO_OUTPUT_INACTIVE);
+  }
+
+  uart_irq_callback_set(bus_uart, bus_isr);
+  uart_irq_rx_enable(bus_uart);
+  LOG_INF("Bus address %u", bus_node.addr);
+  return 0;
+}
+
+void bus_event(uint8_t event, uint16_t uid_hash, uint8_t result,
+               uint32_t time) {
+  bus_node_event(&bus_node, event, uid_hash, result, time);
+}
+
+void bus_print_stats(void) {
+  printk("Bus: address %u, frames %u, responses %u, crc errors %u, "
+         "foreign %u, dropped %u, too long %u, tx timeouts %u, "
+         "events %u pending %u lost\n",
+         bus_node.addr, bus_stats.frames, bus_stats.responses,
+         bus_stats.crc_errors, bus_stats.foreign, bus_stats.dropped,
+         bus_stats.too_long, bus_stats.tx_timeouts, bus_node.event_count,
+         bus_node.events_lost);
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef BUS_H
+#define BUS_H
+
+#include <stdint.h>
+
+#ifdef CONFIG_PAKETKASTEN_BUS
+/**
+ * @brief Busanschluss starten
+ *
+ * Empfängt auf dem Bus-UART aus dem devicetree (dhl,paketkasten-bus) und
+ * beantwortet Rahmen an die Adresse aus der Konfiguration. Mit Adresse 0
+ * bleibt der Kasten stumm.
+ *
+ * @return 0 bei Erfolg, sonst negativer Fehler
+ */
+int bus_init(void);
+
+/* Ereignis für die nächste Abfrage durch den Controller vormerken */
+void bus_event(uint8_t event, uint16_t uid_hash, uint8_t result,
+               uint32_t time);
+
+void bus_print_stats(void);
+#else
+static inline int bus_init(void) { return 0; }
+static inline void bus_event(uint8_t event, uint16_t uid_hash, uint8_t result,
+                             uint32_t time) {}
+static inline void bus_print_stats(void) {}
+#endif
+
+#endif // BUS_H
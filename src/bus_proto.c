@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "bus_proto.h"
+#include <errno.h>
+#include <string.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+BUILD_ASSERT(sizeof(struct bus_status) + sizeof(struct bus_event) <=
+             BUS_PAYLOAD_MAX);
+BUILD_ASSERT(BUS_EVENTS <= 128, "event window must fit into half of seq");
+
+size_t bus_frame_encode(const struct bus_header *hdr, const void *payload,
+                        size_t len, uint8_t *out) {
+  uint8_t raw[BUS_RAW_MAX];
+  uint16_t crc;
+
+  memcpy(raw, hdr, sizeof(*hdr));
+  memcpy(raw + sizeof(*hdr), payload, len);
+  len += sizeof(*hdr);
+  crc = crc16_itu_t(0xffff, raw, len);
+  raw[len++] = crc & 0xff;
+  raw[len++] = crc >> 8;
+  return cobs_encode(raw, len, out);
+}
+
+int bus_frame_decode(uint8_t *frame, size_t len, struct bus_header *hdr,
+                     uint8_t **payload) {
+  int n = cobs_decode(frame, len, frame);
+  uint16_t crc;
+
+  if (n < (int)(sizeof(*hdr) + sizeof(crc))) {
+    return -EBADMSG;
+  }
+  n -= sizeof(crc);
+  crc = frame[n] | (frame[n + 1] << 8);
+  if (crc16_itu_t(0xffff, frame, n) != crc) {
+    return -EBADMSG;
+  }
+  memcpy(hdr, frame, sizeof(*hdr));
+  *payload = frame + sizeof(*hdr);
+  return n - sizeof(*hdr);
+}
+
+void bus_node_event(struct bus_node *node, uint8_t event, uint16_t uid_hash,
+                    uint8_t result, uint32_t time) {
+  k_spinlock_key_t key = k_spin_lock(&node->lock);
+  struct bus_event *e;
+
+  if (node->event_count == BUS_EVENTS) {
+    /* Ältestes verwerfen, der Controller sieht die Lücke in seq */
+    node->event_head = (node->event_head + 1) % BUS_EVENTS;
+    node->event_count--;
+    if (node->events_lost < UINT8_MAX) {
+      node->events_lost++;
+    }
+  }
+  e = &node->events[(node->event_head + node->event_count) % BUS_EVENTS];
+  e->seq = node->event_seq++;
+  e->event = event;
+  e->result = result;
+  e->uid_hash = uid_hash;
+  e->time = time;
+  node->event_count++;
+  k_spin_unlock(&node->lock, key);
+}
+
+/* Ereignisse vor event_next sind beim Controller angekommen. Ein Wert
+   außerhalb der vorgehaltenen Ereignisse (z.B. nach einem Neustart des
+   Controllers) quittiert nichts. */
+static void bus_node_ack_events(struct bus_node *node, uint8_t event_next) {
+  uint8_t acked;
+
+  if (node->event_count == 0) {
+    return;
+  }
+  acked = event_next - node->events[node->event_head].seq;
+  if (acked <= node->event_count) {
+    node->event_head = (node->event_head + acked) % BUS_EVENTS;
+    node->event_count -= acked;
+  }
+}
+
+static size_t bus_node_poll(struct bus_node *node,
+                            const struct bus_poll *poll, uint8_t *resp) {
+  struct bus_status *status = (struct bus_status *)resp;
+  struct bus_event *events = (struct bus_event *)(status + 1);
+  k_spinlock_key_t key;
+  uint8_t n;
+
+  memset(status, 0, sizeof(*status));
+  node->ops->status(node, status);
+
+  key = k_spin_lock(&node->lock);
+  bus_node_ack_events(node, poll->event_next);
+  n = MIN(node->event_count, BUS_POLL_EVENTS);
+  for (uint8_t i = 0; i < n; i++) {
+    events[i] = node->events[(node->event_head + i) % BUS_EVENTS];
+  }
+  status->event_count = n;
+  status->events_lost = node->events_lost;
+  k_spin_unlock(&node->lock, key);
+
+  return sizeof(*status) + n * sizeof(struct bus_event);
+}
+
+static int bus_node_open(struct bus_node *node, const struct bus_header *hdr,
+                         const struct bus_open *open) {
+  /* Wiederholung nach verlorener Antwort, nicht noch einmal öffnen */
+  if (node->open_valid && node->open_seq == hdr->seq &&
+      memcmp(&node->open_last, open, sizeof(*open)) == 0) {
+    return node->open_ret;
+  }
+  node->open_ret = node->ops->open(node, open->fach, open->cmd);
+  node->open_seq = hdr->seq;
+  node->open_last = *open;
+  /* Nach einem Fehler (z.B. -EBUSY) darf die Wiederholung neu versuchen */
+  node->open_valid = node->open_ret == 0;
+  return node->open_ret;
+}
+
+/* Prüft zuerst alle Datensätze, damit kein halber Rahmen übernommen wird */
+static int bus_node_uid(struct bus_node *node, const uint8_t *payload,
+                        size_t len) {
+  const struct bus_uid *upd = (const struct bus_uid *)payload;
+  const struct bus_uid_record *rec;
+  uint16_t version = node->ops->uid_version_get(node);
+  size_t pos = sizeof(*upd);
+  int ret;
+
+  if (len < sizeof(*upd)) {
+    return -EINVAL;
+  }
+  for (uint8_t i = 0; i < upd->count; i++) {
+    rec = (const struct bus_uid_record *)(payload + pos);
+    if (pos + sizeof(*rec) > len ||
+        pos + sizeof(*rec) + (rec->len & ~BUS_UID_DELETE) > len) {
+      return -EINVAL;
+    }
+    pos += sizeof(*rec) + (rec->len & ~BUS_UID_DELETE);
+  }
+  if (pos != len) {
+    return -EINVAL;
+  }
+
+  if (version == upd->version) {
+    /* Schon übernommen, z.B. Wiederholung eines Broadcasts */
+    return 0;
+  }
+  if (version != upd->base) {
+    return -EAGAIN;
+  }
+
+  pos = sizeof(*upd);
+  for (uint8_t i = 0; i < upd->count; i++) {
+    rec = (const struct bus_uid_record *)(payload + pos);
+    ret = node->ops->uid(node, rec->uid, rec->len & ~BUS_UID_DELETE,
+                         rec->faecher, rec->len & BUS_UID_DELETE);
+    if (ret < 0 && ret != -ENOENT) {
+      /* Version bleibt, der Controller schickt die Änderung erneut */
+      return ret;
+    }
+    pos += sizeof(*rec) + (rec->len & ~BUS_UID_DELETE);
+  }
+  node->ops->uid_version_set(node, upd->version);
+  return 0;
+}
+
+static int bus_node_sync(struct bus_node *node, const uint8_t *payload,
+                         size_t len) {
+  const struct bus_sync_begin *begin = (const struct bus_sync_begin *)payload;
+  const struct bus_sync_data *data = (const struct bus_sync_data *)payload;
+  int ret;
+
+  if (node->ops->sync_begin == NULL) {
+    return -ENOTSUP;
+  }
+  if (len < sizeof(struct bus_sync)) {
+    return -EINVAL;
+  }
+
+  switch (payload[0]) {
+  case BUS_SYNC_BEGIN:
+    if (len != sizeof(*begin)) {
+      return -EINVAL;
+    }
+    return node->ops->sync_begin(node, begin->version, begin->count,
+                                 begin->crc);
+  case BUS_SYNC_DATA:
+    if (len < sizeof(*data)) {
+      return -EINVAL;
+    }
+    ret = node->ops->sync_data(node, data->first, payload + sizeof(*data),
+                               len - sizeof(*data));
+    return MIN(ret, 0);
+  case BUS_SYNC_END:
+    return node->ops->sync_end(node);
+  default:
+    return -EINVAL;
+  }
+}
+
+size_t bus_node_handle(struct bus_node *node, const struct bus_header *hdr,
+                       const uint8_t *payload, size_t len, uint8_t *out) {
+  uint8_t resp[BUS_PAYLOAD_MAX];
+  struct bus_ack *ack = (struct bus_ack *)resp;
+  struct bus_header rhdr = {
+      .addr = node->addr,
+      .type = hdr->type | BUS_RESPONSE,
+      .seq = hdr->seq,
+  };
+  size_t n = sizeof(*ack);
+  int ret;
+
+  if ((hdr->type & BUS_RESPONSE) ||
+      (hdr->addr != node->addr && hdr->addr != BUS_ADDR_BROADCAST)) {
+    return 0;
+  }
+  /* Öffnen und Abfragen nur einzeln adressiert */
+  if (hdr->addr == BUS_ADDR_BROADCAST && hdr->type != BUS_UID &&
+      hdr->type != BUS_SYNC) {
+    return 0;
+  }
+
+  /* Ein anderer Rahmen dazwischen: die Folgenummer kann nach 256 Rahmen an
+     andere Kästen wieder dieselbe sein, ein neues Öffnen ist dann keine
+     Wiederholung */
+  if (hdr->type != BUS_OPEN) {
+    node->open_valid = false;
+  }
+
+  switch (hdr->type) {
+  case BUS_POLL:
+    if (len != sizeof(struct bus_poll)) {
+      return 0;
+    }
+    n = bus_node_poll(node, (const struct bus_poll *)payload, resp);
+    break;
+  case BUS_OPEN:
+    if (len != sizeof(struct bus_open)) {
+      return 0;
+    }
+    ret = bus_node_open(node, hdr, (const struct bus_open *)payload);
+    ack->ret = ret;
+    ack->uid_version = node->ops->uid_version_get(node);
+    break;
+  case BUS_UID:
+    ret = bus_node_uid(node, payload, len);
+    ack->ret = ret;
+    ack->uid_version = node->ops->uid_version_get(node);
+    break;
+  case BUS_SYNC:
+    ret = bus_node_sync(node, payload, len);
+    ack->ret = ret;
+    ack->uid_version = node->ops->uid_version_get(node);
+    break;
+  default:
+    return 0;
+  }
+
+  /* Auf Broadcasts antwortet niemand, sonst gäbe es Kollisionen */
+  if (hdr->addr == BUS_ADDR_BROADCAST) {
+    return 0;
+  }
+  return bus_frame_encode(&rhdr, resp, n, out);
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef BUS_PROTO_H
+#define BUS_PROTO_H
+
+#include "cobs.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#include <zephyr/toolchain.h>
+
+/* Protokollkern des Busses ohne Hardware, wird von bus.c und der Simulation
+ * in sim/bus benutzt.
+ *
+ * Rahmen vor der Kodierung:
+ *   Adresse (1), Typ (1), Folgenummer (1), Nutzdaten, CRC16 (2)
+ * CRC und COBS wie bei der Telemetrie. Nur der Controller sendet von sich
+ * aus, ein Kasten antwortet ausschließlich auf einen an ihn adressierten
+ * Rahmen. So kann es auf der Leitung keine Kollision geben. */
+
+/* 1..BUS_ADDR_MAX sind Kästen, auf Broadcasts antwortet keiner */
+#define BUS_ADDR_NONE 0
+#define BUS_ADDR_MAX 247
+#define BUS_ADDR_BROADCAST 0xff
+
+#define BUS_PAYLOAD_MAX 64
+#define BUS_RAW_MAX                                                            \
+  (sizeof(struct bus_header) + BUS_PAYLOAD_MAX + sizeof(uint16_t))
+#define BUS_FRAME_MAX COBS_ENCODED_MAX(BUS_RAW_MAX)
+
+/* Ereignisse, die ein Kasten bis zur Quittung aufhebt */
+#define BUS_EVENTS 16
+
+/* Rahmentypen, Antworten haben zusätzlich BUS_RESPONSE gesetzt */
+enum bus_type {
+  BUS_POLL = 0x01, // struct bus_poll, Antwort bus_status und bus_event[]
+  BUS_OPEN = 0x02, // struct bus_open, Antwort bus_ack
+  BUS_UID = 0x03,  // struct bus_uid und Datensätze, Antwort bus_ack
+  BUS_SYNC = 0x04, // struct bus_sync, Antwort bus_ack
+  BUS_RESPONSE = 0x80,
+};
+
+struct bus_header {
+  uint8_t addr; // Ziel, bei Antworten der Absender
+  uint8_t type;
+  uint8_t seq; // Wiederholungen tragen dieselbe Nummer
+} __packed;
+
+struct bus_poll {
+  uint8_t event_next; // nächste erwartete Ereignisnummer, ältere quittiert
+} __packed;
+
+#define BUS_STATUS_MOTOR BIT(0)
+
+struct bus_status {
+  uint32_t uptime_s;
+  uint16_t uid_count;
+  uint16_t uid_version;
+  uint8_t flags;
+  uint8_t faecher;
+  uint8_t state[8]; // state_t je Fach
+  uint8_t events_lost;
+  uint8_t event_count; // Anzahl folgender struct bus_event
+} __packed;
+
+struct bus_event {
+  uint8_t seq;
+  uint8_t event; // audit_event_t
+  uint8_t result;
+  uint16_t uid_hash;
+  uint32_t time; // wie im Audit-Log, Bit 31: Uhr nicht gestellt
+} __packed;
+
+#define BUS_POLL_EVENTS                                                        \
+  ((BUS_PAYLOAD_MAX - sizeof(struct bus_status)) / sizeof(struct bus_event))
+
+struct bus_open {
+  uint8_t fach;
+  uint8_t cmd; // command_t
+} __packed;
+
+/* Änderung der UID-Liste von Version base auf version. Ein Kasten mit einer
+   anderen Version ignoriert sie, der Controller sieht das im Status. */
+struct bus_uid {
+  uint16_t base;
+  uint16_t version;
+  uint8_t count; // Anzahl folgender struct bus_uid_record
+} __packed;
+
+#define BUS_UID_DELETE 0x80
+
+struct bus_uid_record {
+  uint8_t len; // Länge der UID, mit BUS_UID_DELETE löschen
+  uint8_t faecher;
+  uint8_t uid[];
+} __packed;
+
+/* Abgleich mit einer vollständigen Kartenliste (uidsync.h). Die Datensätze
+   haben das Format von struct bus_uid_record ohne BUS_UID_DELETE, jeder
+   Rahmen enthält nur ganze Datensätze. Wie BUS_UID auch als Broadcast. */
+enum bus_sync_op {
+  BUS_SYNC_BEGIN, // struct bus_sync_begin
+  BUS_SYNC_DATA,  // struct bus_sync_data und Datensätze
+  BUS_SYNC_END,
+};
+
+struct bus_sync {
+  uint8_t op;
+} __packed;
+
+struct bus_sync_begin {
+  struct bus_sync hdr;
+  uint16_t version;
+  uint16_t count;
+  uint32_t crc; // CRC32 (IEEE) über alle Datensätze
+} __packed;
+
+struct bus_sync_data {
+  struct bus_sync hdr;
+  uint16_t first; // Index des ersten Datensatzes
+} __packed;
+
+struct bus_ack {
+  int8_t ret;
+  uint16_t uid_version;
+} __packed;
+
+struct bus_node;
+
+/* Anbindung eines Kastens an Zustandsautomat und UID-Tabelle */
+struct bus_node_ops {
+  void (*status)(struct bus_node *node, struct bus_status *status);
+  int (*open)(struct bus_node *node, uint8_t fach, uint8_t cmd);
+  int (*uid)(struct bus_node *node, const uint8_t *uid, size_t len,
+             uint8_t faecher, bool remove);
+  uint16_t (*uid_version_get)(struct bus_node *node);
+  void (*uid_version_set)(struct bus_node *node, uint16_t version);
+  /* Abgleich, optional. Rückgabe wie bei uidsync_begin/data/end. */
+  int (*sync_begin)(struct bus_node *node, uint16_t version, uint16_t count,
+                    uint32_t crc);
+  int (*sync_data)(struct bus_node *node, uint16_t first,
+                   const uint8_t *data, size_t len);
+  int (*sync_end)(struct bus_node *node);
+};
+
+struct bus_node {
+  const struct bus_node_ops *ops;
+  uint8_t addr;
+  /* Letzter erfolgreicher Öffnen-Befehl, eine Wiederholung wird nicht
+     erneut ausgeführt.
+     Die Folgenummer zählt über alle Kästen, jeder andere Rahmen an diesen
+     Kasten beendet daher das Fenster für Wiederholungen. */
+  bool open_valid;
+  uint8_t open_seq;
+  struct bus_open open_last;
+  int8_t open_ret;
+  /* Ereignisse bis zur Quittung durch den Controller */
+  struct k_spinlock lock;
+  struct bus_event events[BUS_EVENTS];
+  uint8_t event_head; // Index des ältesten
+  uint8_t event_count;
+  uint8_t event_seq; // Nummer des nächsten Ereignisses
+  uint8_t events_lost;
+};
+
+/**
+ * @brief Rahmen mit CRC bilden und COBS-kodieren
+ *
+ * @param out mindestens BUS_FRAME_MAX Bytes
+ * @return Länge des kodierten Rahmens einschließlich Abschluss
+ */
+size_t bus_frame_encode(const struct bus_header *hdr, const void *payload,
+                        size_t len, uint8_t *out);
+
+/**
+ * @brief Empfangenen Rahmen (ohne Abschluss) an Ort und Stelle dekodieren
+ *
+ * @return Länge der Nutzdaten, -EBADMSG bei Kodier- oder CRC-Fehler
+ */
+int bus_frame_decode(uint8_t *frame, size_t len, struct bus_header *hdr,
+                     uint8_t **payload);
+
+/* Ereignis für die nächste Abfrage vormerken, aus jedem Kontext */
+void bus_node_event(struct bus_node *node, uint8_t event, uint16_t uid_hash,
+                    uint8_t result, uint32_t time);
+
+/**
+ * @brief Dekodierten Rahmen als Kasten verarbeiten
+ *
+ * @param out Antwort, mindestens BUS_FRAME_MAX Bytes. Darf der Puffer des
+ *            empfangenen Rahmens sein, payload wird vorher ausgewertet.
+ * @return Länge der kodierten Antwort, 0 wenn keine gesendet wird
+ */
+size_t bus_node_handle(struct bus_node *node, const struct bus_header *hdr,
+                       const uint8_t *payload, size_t len, uint8_t *out);
+
+#endif // BUS_PROTO_H
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "cobs.h"
+#include <errno.h>
+
+size_t cobs_encode(const uint8_t *in, size_t len, uint8_t *out) {
+  size_t code_pos = 0;
+  size_t n = 1;
+  uint8_t code = 1;
+
+  for (size_t i = 0; i < len; i++) {
+    if (in[i] != 0) {
+      out[n++] = in[i];
+      code++;
+    }
+    /* Ein Block umfasst höchstens 254 Bytes ohne 0x00 */
+    if (in[i] == 0 || code == 0xff) {
+      out[code_pos] = code;
+      code_pos = n++;
+      code = 1;
+    }
+  }
+  out[code_pos] = code;
+  out[n++] = 0;
+  return n;
+}
+
+int cobs_decode(const uint8_t *in, size_t len, uint8_t *out) {
+  size_t n = 0;
+  size_t i = 0;
+  uint8_t code;
+
+  while (i < len) {
+    code = in[i++];
+    if (code == 0 || i + code - 1 > len) {
+      return -EBADMSG;
+    }
+    for (uint8_t j = 1; j < code; j++) {
+      out[n++] = in[i++];
+    }
+    /* Auf einen vollen Block folgt keine 0x00 */
+    if (code < 0xff && i < len) {
+      out[n++] = 0;
+    }
+  }
+  return n;
+}
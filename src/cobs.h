@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef COBS_H
+#define COBS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Größe eines kodierten Rahmens mit abschließendem 0x00 */
+#define COBS_ENCODED_MAX(len) ((len) + (len) / 254 + 2)
+
+/**
+ * @brief Daten COBS-kodieren
+ *
+ * Die Ausgabe enthält kein 0x00 außer dem Abschluss, so findet der Empfänger
+ * nach Störungen den nächsten Rahmenanfang.
+ *
+ * @param out mindestens COBS_ENCODED_MAX(len) Bytes
+ * @return Anzahl geschriebener Bytes einschließlich Abschluss
+ */
+size_t cobs_encode(const uint8_t *in, size_t len, uint8_t *out);
+
+/**
+ * @brief Rahmen ohne Abschluss dekodieren, out darf gleich in sein
+ *
+ * @return Länge der Daten, -EBADMSG bei ungültiger Kodierung
+ */
+int cobs_decode(const uint8_t *in, size_t len, uint8_t *out);
+
+#endif // COBS_H
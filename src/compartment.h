@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef COMPARTMENT_H
+#define COMPARTMENT_H
+
+#include <zephyr/devicetree.h>
+
+/* Jedes Schlossfach ist ein Devicetree-Knoten mit compatible
+ * "dhl,paketkasten-compartment" (dts/bindings). Die Fächer sind in der
+ * Reihenfolge der Instanzen nummeriert, motor.c, inputs.c und states.c legen
+ * ihre Kontexte mit DT_INST_FOREACH_STATUS_OKAY an. */
+#define COMPARTMENT_COUNT DT_NUM_INST_STATUS_OKAY(dhl_paketkasten_compartment)
+
+#if COMPARTMENT_COUNT == 0
+#error "No dhl,paketkasten-compartment node in the devicetree"
+#endif
+
+/* Die berechtigten Fächer einer Karte sind eine 8 Bit Maske (eeprom.c) */
+#if COMPARTMENT_COUNT > 8
+#error "At most 8 compartments are supported"
+#endif
+
+#endif // COMPARTMENT_H
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "config.h"
+#include "motor.h"
+#include "storage_io.h"
+#include "writeback.h"
+#include <zephyr/drivers/eeprom.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/crc.h>
+
+LOG_MODULE_REGISTER(config, CONFIG_PAKETKASTEN_LOG_LEVEL);
+
+/* Die Konfiguration liegt dreifach vor:
+ * - im internen Flash (Settings mit NVS in storage_partition), wird beim
+ *   Start als einzige gelesen, ohne Peripherieversorgung und SPI
+ * - Kopie A auf der letzten Seite von eeprom1 (hinter dem Audit-Ring)
+ * - Kopie B auf Seite 0 von eeprom1
+ * Jede Kopie hat eine eigene Seite, ein abgebrochenes Schreiben trifft so
+ * keine anderen Daten. Auf eeprom0 gehört jede Seite der UID-Tabelle.
+ * Die EEPROM-Kopien werden nur gelesen, wenn das Flash keine gültige
+ * Konfiguration enthält. Generation g liegt in Kopie g % 2, die andere Kopie
+ * enthält immer die vorherige Generation. */
+#define CFG_COPIES 2
+#define CFG_PAGE_SIZE DT_PROP(DT_NODELABEL(eeprom1), pagesize)
+#define CFG_OFFSET_A (DT_PROP(DT_NODELABEL(eeprom1), size) - CFG_PAGE_SIZE)
+#define CFG_OFFSET_B 0
+#define CFG_MAGIC 0x46434b50 // "PKCF"
+#define CFG_VERSION 1
+#define CFG_SETTINGS_KEY "pk/cfg"
+
+/* Standardwerte für nicht gesetzte (0) Felder */
+#define CFG_DEFAULT_MOTOR_TIMEOUT_S 3
+#define CFG_DEFAULT_MOTOR_DUTY 50
+
+struct config_record {
+  uint32_t magic;
+  uint32_t generation;
+  uint16_t version;
+  uint16_t len;
+  struct config_data data;
+  uint32_t crc; // CRC32 über alle Felder davor
+} __packed;
+
+BUILD_ASSERT(sizeof(struct config_record) == 32,
+             "config record must fit into half an EEPROM page");
+
+static const struct {
+  const struct device *dev;
+  uint32_t offset;
+} config_copies[CFG_COPIES] = {
+    {DEVICE_DT_GET(DT_NODELABEL(eeprom1)), CFG_OFFSET_A},
+    {DEVICE_DT_GET(DT_NODELABEL(eeprom1)), CFG_OFFSET_B},
+};
+
+static struct config_data config;
+static struct writeback config_wb;
+static uint32_t config_generation;
+/* Herkunft der geladenen Konfiguration für config_print */
+static char config_source = '-';
+
+K_MUTEX_DEFINE(config_lock);
+
+static uint32_t config_crc(const struct config_record *rec) {
+  return crc32_ieee((const uint8_t *)rec, offsetof(struct config_record, crc));
+}
+
+static bool config_record_valid(const struct config_record *rec) {
+  return rec->magic == CFG_MAGIC && rec->version == CFG_VERSION &&
+         rec->len == sizeof(rec->data) && rec->crc == config_crc(rec);
+}
+
+static void config_use(const struct config_record *rec, char source) {
+  if (config_source == '-' || rec->generation > config_generation) {
+    config = rec->data;
+    config_generation = rec->generation;
+    config_source = source;
+  }
+}
+
+static void config_apply_defaults(struct config_data *data) {
+  if (data->motor_timeout_s == 0) {
+    data->motor_timeout_s = CFG_DEFAULT_MOTOR_TIMEOUT_S;
+  }
+  if (data->motor_duty == 0 || data->motor_duty > 100) {
+    data->motor_duty = CFG_DEFAULT_MOTOR_DUTY;
+  }
+}
+
+static int config_settings_set(const char *name, size_t len,
+                               settings_read_cb read_cb, void *cb_arg) {
+  struct config_record rec;
+
+  if (!settings_name_steq(name, "cfg", NULL) || len != sizeof(rec)) {
+    return -ENOENT;
+  }
+  if (read_cb(cb_arg, &rec, sizeof(rec)) == sizeof(rec) &&
+      config_record_valid(&rec)) {
+    config_use(&rec, 'F');
+  }
+  return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(pk, "pk", NULL, config_settings_set, NULL,
+                               NULL);
+
+static bool config_read_copy(int copy, struct config_record *rec) {
+  if (!device_is_ready(config_copies[copy].dev) ||
+      storage_io_read(config_copies[copy].dev, config_copies[copy].offset, rec,
+                      sizeof(*rec)) < 0) {
+    return false;
+  }
+  return config_record_valid(rec);
+}
+
+/* Schreibt den aktuellen Stand aus der Speicher-Workqueue */
+static int config_commit(struct writeback *wb) {
+  struct config_record rec = {
+      .magic = CFG_MAGIC,
+      .version = CFG_VERSION,
+      .len = sizeof(rec.data),
+  };
+  int copy;
+  int ret;
+
+  /* Beim Flash-Schreiben hält der STM32L1 die Befehlsausführung an, das
+     würde die Motorregelung stören */
+  if (motor_is_running()) {
+    return -EBUSY;
+  }
+
+  k_mutex_lock(&config_lock, K_FOREVER);
+  rec.generation = config_generation + 1;
+  rec.data = config;
+  rec.crc = config_crc(&rec);
+
+  /* Die ältere EEPROM-Kopie überschreiben, die andere bleibt als Rückfall */
+  copy = rec.generation % CFG_COPIES;
+  ret = storage_io_write(config_copies[copy].dev, config_copies[copy].offset,
+                         &rec, sizeof(rec));
+  if (ret == 0) {
+    ret = settings_save_one(CFG_SETTINGS_KEY, &rec, sizeof(rec));
+  }
+  if (ret == 0) {
+    config_generation = rec.generation;
+    config_source = 'F';
+  }
+  k_mutex_unlock(&config_lock);
+
+  return ret;
+}
+
+int config_init(void) {
+  struct config_record rec;
+  int ret;
+
+  writeback_register(&config_wb, config_commit);
+
+  k_mutex_lock(&config_lock, K_FOREVER);
+  ret = settings_subsys_init();
+  if (ret == 0) {
+    ret = settings_load_subtree("pk");
+  }
+  if (ret < 0) {
+    LOG_WRN("Settings load failed: %d", ret);
+  }
+
+  if (config_source == '-') {
+    /* Flash leer (z.B. nach einem Update), EEPROM-Kopien übernehmen */
+    for (int i = 0; i < CFG_COPIES; i++) {
+      if (config_read_copy(i, &rec)) {
+        config_use(&rec, 'A' + i);
+      } else {
+        LOG_WRN("Config copy %c invalid", 'A' + i);
+      }
+    }
+  }
+  config_apply_defaults(&config);
+  k_mutex_unlock(&config_lock);
+
+  if (config_source == '-') {
+    return -ENOENT;
+  }
+  if (config_source != 'F') {
+    /* Im Flash ablegen, damit der nächste Start ohne EEPROM auskommt */
+    writeback_mark(&config_wb);
+  }
+  return 0;
+}
+
+const struct config_data *config_get(void) { return &config; }
+
+int config_update(const struct config_data *data) {
+  k_mutex_lock(&config_lock, K_FOREVER);
+  config = *data;
+  config_apply_defaults(&config);
+  k_mutex_unlock(&config_lock);
+
+  writeback_mark(&config_wb);
+  return 0;
+}
+
+void config_set_uid_version(uint16_t version) {
+  k_mutex_lock(&config_lock, K_FOREVER);
+  config.uid_version = version;
+  k_mutex_unlock(&config_lock);
+
+  writeback_mark(&config_wb);
+}
+
+void config_set_dac_ref(uint8_t ref) {
+  k_mutex_lock(&config_lock, K_FOREVER);
+  config.rfid_dac_ref = ref;
+  k_mutex_unlock(&config_lock);
+
+  writeback_mark(&config_wb);
+}
+
+void config_print(void) {
+  printk("Config: generation %u from %c, dac ref 0x%02x, motor timeout %u s, "
+         "duty %u %%, bus address %u, uid version %u\n",
+         config_generation, config_source, config.rfid_dac_ref,
+         config.motor_timeout_s, config.motor_duty, config.bus_addr,
+         config.uid_version);
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+
+/* Gespeicherte Einstellungen. Neue Felder nur am Ende anfügen, die Größe
+   bleibt fest. */
+struct config_data {
+  uint8_t rfid_dac_ref;    // letzte Kalibrierung des Tag-Detektors, 0 = keine
+  uint8_t motor_timeout_s; // Zeit bis zum Motor-Timeout, 0 = Standard
+  uint8_t motor_duty;      // PWM-Tastverhältnis in %, 0 = Standard
+  uint8_t bus_addr;        // Adresse am Bus, 0 = kein Busbetrieb
+  uint16_t uid_version;    // Stand der UID-Liste, vom Controller gesetzt
+  uint8_t reserved[10];
+} __packed;
+
+/**
+ * @brief Konfiguration laden
+ *
+ * Liest die Konfiguration aus dem internen Flash, ohne SPI und
+ * Peripherieversorgung. Nur wenn dort keine gültige liegt, werden die Kopien
+ * auf eeprom0 und eeprom1 gelesen und die mit der höheren Generation
+ * übernommen. Nicht gesetzte Felder erhalten Standardwerte.
+ *
+ * @return 0 bei Erfolg, -ENOENT wenn keine gültige Kopie gefunden wurde
+ */
+int config_init(void);
+
+/* Aktuelle Konfiguration, Zugriff nur lesend */
+const struct config_data *config_get(void);
+
+/**
+ * @brief Konfiguration speichern
+ *
+ * Ersetzt alle Felder, für die Konsole. Module ändern einzelne Felder mit
+ * den config_set_* Funktionen, sonst überschriebe ein gleichzeitiges
+ * config_update deren Änderung. Übernimmt die Daten sofort, geschrieben
+ * wird verzögert in der Speicher-Workqueue, solange der Motor steht. Im
+ * EEPROM wird immer die ältere Kopie überschrieben. Bricht der
+ * Schreibvorgang ab, bleibt die andere Kopie gültig.
+ *
+ * @return 0
+ */
+int config_update(const struct config_data *data);
+
+/* Einzelne Felder unter der Sperre ändern, gespeichert wird wie bei
+   config_update */
+void config_set_uid_version(uint16_t version);
+void config_set_dac_ref(uint8_t ref);
+
+void config_print(void);
+
+#endif // CONFIG_H
@@ -0,0 +1,540 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "console.h"
+#include "audit.h"
+#include "bus.h"
+#include "bus_proto.h"
+#include "config.h"
+#include "eeprom.h"
+#include "health.h"
+#include "logstore.h"
+#include "motor.h"
+#include "powermanager.h"
+#include "rfid.h"
+#include "states.h"
+#include "storage_io.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "uidsync.h"
+#include "writeback.h"
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/debug/thread_analyzer.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+
+#define CONSOLE_STACK_SIZE 1024
+#define CONSOLE_PRIORITY 8
+
+/* Zwei DMA-Puffer: während einer ausgewertet wird, füllt der DMA den
+   anderen. Nach CONSOLE_RX_TIMEOUT_US ohne neues Zeichen (Idle-Line) werden
+   die bisher empfangenen Daten gemeldet. */
+#define CONSOLE_RX_BUF_SIZE 32
+#define CONSOLE_RX_TIMEOUT_US 1000
+#define CONSOLE_LINE_MAX 48
+#define CONSOLE_LINES 2
+#define CONSOLE_ARGS_MAX 5
+
+static const struct device *uart_dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_console));
+
+static uint8_t console_rx_buf[2][CONSOLE_RX_BUF_SIZE];
+static uint8_t console_rx_next;
+
+/* Zeile im Aufbau, nur im UART-ISR benutzt */
+static char console_line[CONSOLE_LINE_MAX];
+static uint8_t console_line_len;
+static bool console_line_overflow;
+
+K_MSGQ_DEFINE(console_lines, CONSOLE_LINE_MAX, CONSOLE_LINES, 1);
+
+K_THREAD_STACK_DEFINE(console_stack, CONSOLE_STACK_SIZE);
+static struct k_thread console_data;
+
+static struct {
+  uint32_t lines;
+  uint32_t dropped;
+  uint32_t too_long;
+  uint32_t rx_errors;
+} console_stats;
+
+static void storage_bench_handler(struct k_work *work) {
+  storage_io_benchmark();
+}
+
+/* Die Messung dauert einige Sekunden, sie läuft in der Speicher-Workqueue */
+static K_WORK_DEFINE(storage_bench_work, storage_bench_handler);
+
+static void console_line_end(void) {
+  if (console_line_overflow) {
+    console_stats.too_long++;
+  } else if (console_line_len > 0) {
+    console_line[console_line_len] = '\0';
+    if (k_msgq_put(&console_lines, console_line, K_NO_WAIT) < 0) {
+      console_stats.dropped++;
+    }
+  }
+  console_line_len = 0;
+  console_line_overflow = false;
+}
+
+static void console_rx(const uint8_t *data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    char c = data[i];
+
+    if (c == '\r' || c == '\n') {
+      console_line_end();
+    } else if (console_line_len < CONSOLE_LINE_MAX - 1) {
+      console_line[console_line_len++] = c;
+    } else {
+      console_line_overflow = true;
+    }
+  }
+}
+
+static void uart_cb(const struct device *dev, struct uart_event *evt,
+                    void *user_data) {
+  switch (evt->type) {
+  case UART_TX_DONE:
+  case UART_TX_ABORTED:
+    /* Telemetrie und printk teilen sich den Sendepuffer (telemetry.c) */
+    telemetry_tx_done(evt->data.tx.len);
+    break;
+
+  case UART_RX_RDY:
+    powermanager_wakeup();
+    console_rx(evt->data.rx.buf + evt->data.rx.offset, evt->data.rx.len);
+    break;
+
+  case UART_RX_BUF_REQUEST:
+    uart_rx_buf_rsp(dev, console_rx_buf[console_rx_next],
+                    sizeof(console_rx_buf[0]));
+    console_rx_next ^= 1;
+    break;
+
+  case UART_RX_STOPPED:
+    console_stats.rx_errors++;
+    break;
+
+  case UART_RX_DISABLED:
+    /* Nach einem Fehler (Rahmen, Überlauf) wieder einschalten */
+    uart_rx_enable(dev, console_rx_buf[console_rx_next],
+                   sizeof(console_rx_buf[0]), CONSOLE_RX_TIMEOUT_US);
+    console_rx_next ^= 1;
+    break;
+
+  default:
+    break;
+  }
+}
+
+/* Die Einzelzeichen öffnen Fach 0 */
+static int cmd_open_brief(int argc, char **argv) {
+  return push_command(0, CMD_OEFFNE_BRIEF);
+}
+
+static int cmd_open_paket(int argc, char **argv) {
+  return push_command(0, CMD_OEFFNE_PAKET);
+}
+
+static int cmd_open(int argc, char **argv) {
+  unsigned long fach = 0;
+  char *end;
+
+  if (argc == 3) {
+    fach = strtoul(argv[2], &end, 0);
+    if (*end != '\0' || fach > UINT8_MAX) {
+      return -EINVAL;
+    }
+  } else if (argc != 2) {
+    return -EINVAL;
+  }
+
+  if (strcmp(argv[1], "brief") == 0) {
+    return push_command(fach, CMD_OEFFNE_BRIEF);
+  }
+  if (strcmp(argv[1], "paket") == 0) {
+    return push_command(fach, CMD_OEFFNE_PAKET);
+  }
+  return -EINVAL;
+}
+
+static int cmd_status(int argc, char **argv) {
+  printk("Status: uptime %u s, motor %s, %u UIDs\n",
+         (uint32_t)(k_uptime_get() / MSEC_PER_SEC),
+         motor_is_running() ? "running" : "stopped", eeprom_uid_count());
+  states_print();
+  config_print();
+  printk("Console: lines %u, dropped %u, too long %u, rx errors %u\n",
+         console_stats.lines, console_stats.dropped, console_stats.too_long,
+         console_stats.rx_errors);
+  return 0;
+}
+
+static int cmd_stack(int argc, char **argv) {
+#ifdef CONFIG_THREAD_ANALYZER
+  thread_analyzer_print(0);
+#else
+  printk("Stack report needs overlay-stack.conf\n");
+#endif
+  return 0;
+}
+
+static int cmd_trace(int argc, char **argv) {
+  trace_dump();
+  return 0;
+}
+
+static int cmd_timing(int argc, char **argv) {
+  motor_print_timing();
+  return 0;
+}
+
+static int cmd_stats(int argc, char **argv) {
+  eeprom_print_stats();
+  storage_io_print_stats();
+  logstore_print_stats();
+  config_print();
+  writeback_print_stats();
+  return 0;
+}
+
+static int cmd_rfid(int argc, char **argv) {
+  rfid_print_timing();
+  return 0;
+}
+
+static int cmd_audit(int argc, char **argv) {
+  /* Die Ausgabe läuft in Teilen im Hauptthread */
+  audit_export_start();
+  return 0;
+}
+
+static int cmd_health(int argc, char **argv) {
+  health_print();
+  return 0;
+}
+
+static int cmd_bench(int argc, char **argv) {
+  return writeback_submit(&storage_bench_work);
+}
+
+static int cmd_uid_clear(int argc, char **argv) {
+  int ret = rfid_clear_uids();
+
+  if (ret < 0) {
+    printk("Clearing UIDs needs programming mode\n");
+  }
+  return ret;
+}
+
+static int cmd_uid(int argc, char **argv) {
+  uint8_t uid[UID_MAX_LEN];
+  unsigned long faecher = UID_ALL_COMPARTMENTS;
+  char *end;
+  size_t len = 0;
+  int ret;
+
+  if (argc == 2 && strcmp(argv[1], "count") == 0) {
+    printk("%u UIDs\n", eeprom_uid_count());
+    return 0;
+  }
+  if (argc == 2 && strcmp(argv[1], "clear") == 0) {
+    return cmd_uid_clear(argc, argv);
+  }
+  if (argc == 4 && strcmp(argv[1], "add") == 0) {
+    /* Fächer als Hex-Maske, z.B. "uid add 04a1b2c3d4e580 3" für 0 und 1 */
+    faecher = strtoul(argv[3], &end, 16);
+    if (*end != '\0' || faecher == 0 || faecher > UINT8_MAX) {
+      return -EINVAL;
+    }
+  } else if (argc != 3) {
+    return -EINVAL;
+  }
+
+  /* UID als Hex-String, z.B. "uid add 04a1b2c3d4e580" */
+  if (strlen(argv[2]) % 2 == 0) {
+    len = hex2bin(argv[2], strlen(argv[2]), uid, sizeof(uid));
+  }
+  if (len == 0) {
+    return -EINVAL;
+  }
+
+  if (strcmp(argv[1], "add") == 0) {
+    ret = eeprom_add_uid(uid, len, faecher);
+    audit_log(AUDIT_UID_ADD, audit_uid_hash(uid, len), ret < 0);
+  } else if (strcmp(argv[1], "del") == 0) {
+    ret = eeprom_remove_uid(uid, len);
+    audit_log(AUDIT_UID_REMOVE, audit_uid_hash(uid, len), ret < 0);
+  } else if (strcmp(argv[1], "check") == 0) {
+    faecher = eeprom_check_uid(uid, len);
+    if (faecher) {
+      printk("known, compartments 0x%02lx\n", faecher);
+    } else {
+      printk("unknown\n");
+    }
+    ret = 0;
+  } else {
+    ret = -EINVAL;
+  }
+  return ret;
+}
+
+/* Kartenliste abgleichen, siehe uidsync.h. Jede Datenzeile wird mit der
+   Anzahl empfangener Datensätze quittiert, erst dann sendet der Host die
+   nächste (scripts/uid_sync.py). */
+static int cmd_sync(int argc, char **argv) {
+  uint8_t data[(CONSOLE_LINE_MAX - 5) / 2];
+  unsigned long value[3];
+  char *end;
+  size_t len = 0;
+  int ret;
+
+  if (argc == 1) {
+    uidsync_print();
+    return 0;
+  }
+  if (argc == 5 && strcmp(argv[1], "begin") == 0) {
+    for (int i = 0; i < 3; i++) {
+      value[i] = strtoul(argv[i + 2], &end, i == 2 ? 16 : 10);
+      if (*end != '\0' || (i < 2 && value[i] > UINT16_MAX)) {
+        return -EINVAL;
+      }
+    }
+    ret = uidsync_begin(value[0], value[1], value[2]);
+    if (ret == 0) {
+      printk("sync %u\n", uidsync_received());
+    }
+    return ret;
+  }
+  if (argc != 2) {
+    return -EINVAL;
+  }
+  if (strcmp(argv[1], "end") == 0) {
+    ret = uidsync_end();
+    if (ret == 0) {
+      printk("sync done, version %u\n", config_get()->uid_version);
+    }
+    return ret;
+  }
+  if (strcmp(argv[1], "abort") == 0) {
+    uidsync_abort();
+    return 0;
+  }
+  if (strcmp(argv[1], "export") == 0) {
+    return uidsync_export();
+  }
+
+  if (strlen(argv[1]) % 2 == 0) {
+    len = hex2bin(argv[1], strlen(argv[1]), data, sizeof(data));
+  }
+  if (len == 0) {
+    return -EINVAL;
+  }
+  ret = uidsync_data(uidsync_received(), data, len);
+  if (ret >= 0) {
+    printk("sync %d\n", ret);
+  }
+  return ret;
+}
+
+static int cmd_config(int argc, char **argv) {
+  struct config_data data = *config_get();
+  char *end;
+  unsigned long value;
+
+  if (argc == 1) {
+    config_print();
+    return 0;
+  }
+  if (argc != 4 || strcmp(argv[1], "set") != 0) {
+    return -EINVAL;
+  }
+
+  value = strtoul(argv[3], &end, 0);
+  if (*end != '\0' || value > UINT8_MAX) {
+    return -EINVAL;
+  }
+
+  if (strcmp(argv[2], "dac") == 0) {
+    config_set_dac_ref(value);
+    config_print();
+    return 0;
+  } else if (strcmp(argv[2], "timeout") == 0) {
+    data.motor_timeout_s = value;
+  } else if (strcmp(argv[2], "duty") == 0) {
+    data.motor_duty = value;
+  } else if (strcmp(argv[2], "addr") == 0 && value <= BUS_ADDR_MAX) {
+    /* Gilt ab dem nächsten Start */
+    data.bus_addr = value;
+  } else {
+    return -EINVAL;
+  }
+
+  config_update(&data);
+  config_print();
+  return 0;
+}
+
+static int cmd_time(int argc, char **argv) {
+  char *end;
+  unsigned long value;
+  uint32_t now;
+  int ret;
+
+  if (argc == 2) {
+    value = strtoul(argv[1], &end, 0);
+    if (*end != '\0') {
+      return -EINVAL;
+    }
+    ret = audit_set_time(value);
+    if (ret < 0) {
+      printk("time set failed: %d\n", ret);
+      return 0;
+    }
+  }
+
+  now = audit_time();
+  if (now & AUDIT_TIME_UNKNOWN) {
+    printk("time unknown, uptime %u s\n", now & ~AUDIT_TIME_UNKNOWN);
+  } else {
+    printk("time %u\n", now);
+  }
+  return 0;
+}
+
+static int cmd_bus(int argc, char **argv) {
+  bus_print_stats();
+  return 0;
+}
+
+static int cmd_telemetry(int argc, char **argv) {
+  char *end;
+  unsigned long mask;
+
+  if (argc == 2) {
+    mask = strtoul(argv[1], &end, 16);
+    if (*end != '\0') {
+      return -EINVAL;
+    }
+    telemetry_set_channels(mask);
+  }
+  telemetry_print_stats();
+  return 0;
+}
+
+static int cmd_help(int argc, char **argv);
+
+/* Die Einzelzeichen entsprechen den früheren Tastenbefehlen */
+static const struct console_cmd {
+  const char *name;
+  const char *alias;
+  int (*handler)(int argc, char **argv);
+  const char *help;
+} console_cmds[] = {
+    {"open", NULL, cmd_open, "open brief|paket [compartment]"},
+    {"o", NULL, cmd_open_brief, "open brief"},
+    {"p", NULL, cmd_open_paket, "open paket"},
+    {"status", NULL, cmd_status, "uptime, motor, compartments, UIDs, config"},
+    {"uid", NULL, cmd_uid,
+     "uid add <hex> [mask], uid del|check <hex>, uid count|clear"},
+    {"sync", NULL, cmd_sync,
+     "sync [begin <version> <count> <crc hex>|<hex>|end|abort|export]"},
+    {"config", NULL, cmd_config,
+     "config [set dac|timeout|duty|addr <value>]"},
+    {"stats", "u", cmd_stats, "storage statistics"},
+    {"stack", "s", cmd_stack, "stack usage"},
+    {"trace", "t", cmd_trace, "dump event trace"},
+    {"timing", "j", cmd_timing, "motor loop timing and current budget"},
+    {"rfid", "r", cmd_rfid, "RFID phase timing"},
+    {"audit", "a", cmd_audit, "export audit log"},
+    {"health", NULL, cmd_health, "lifetime operating counters"},
+    {"bench", "b", cmd_bench, "storage benchmark"},
+    {"tele", NULL, cmd_telemetry, "tele [channel mask hex]"},
+    {"time", NULL, cmd_time, "time [unix seconds], set the clock (UTC)"},
+    {"bus", NULL, cmd_bus, "bus statistics"},
+    {"C", NULL, cmd_uid_clear, "uid clear"},
+    {"help", "?", cmd_help, "this list"},
+};
+
+static int cmd_help(int argc, char **argv) {
+  for (int i = 0; i < ARRAY_SIZE(console_cmds); i++) {
+    printk("%-8s %-3s %s\n", console_cmds[i].name,
+           console_cmds[i].alias ? console_cmds[i].alias : "",
+           console_cmds[i].help);
+  }
+  return 0;
+}
+
+static void console_execute(char *line) {
+  char *argv[CONSOLE_ARGS_MAX];
+  char *save;
+  int argc = 0;
+  int ret;
+
+  for (char *tok = strtok_r(line, " \t", &save);
+       tok != NULL && argc < CONSOLE_ARGS_MAX;
+       tok = strtok_r(NULL, " \t", &save)) {
+    argv[argc++] = tok;
+  }
+  if (argc == 0) {
+    return;
+  }
+
+  for (int i = 0; i < ARRAY_SIZE(console_cmds); i++) {
+    const struct console_cmd *cmd = &console_cmds[i];
+
+    if (strcmp(argv[0], cmd->name) == 0 ||
+        (cmd->alias != NULL && strcmp(argv[0], cmd->alias) == 0)) {
+      ret = cmd->handler(argc, argv);
+      if (ret == -EINVAL) {
+        printk("usage: %s\n", cmd->help);
+      } else if (ret < 0) {
+        printk("%s failed: %d\n", cmd->name, ret);
+      }
+      return;
+    }
+  }
+  printk("unknown command '%s', try help\n", argv[0]);
+}
+
+static void console_main(void *p1, void *p2, void *p3) {
+  char line[CONSOLE_LINE_MAX];
+
+  while (1) {
+    k_msgq_get(&console_lines, line, K_FOREVER);
+    console_stats.lines++;
+    console_execute(line);
+  }
+}
+
+int console_init(void) {
+  k_tid_t tid;
+  int ret;
+
+  if (!device_is_ready(uart_dev)) {
+    printk("UART device not ready\n");
+    return -ENODEV;
+  }
+
+  ret = uart_callback_set(uart_dev, uart_cb, NULL);
+  if (ret == 0) {
+    ret = uart_rx_enable(uart_dev, console_rx_buf[0], sizeof(console_rx_buf[0]),
+                         CONSOLE_RX_TIMEOUT_US);
+    console_rx_next = 1;
+  }
+  if (ret < 0) {
+    printk("UART async rx failed: %d\n", ret);
+    return ret;
+  }
+  telemetry_start();
+
+  tid = k_thread_create(&console_data, console_stack,
+                        K_THREAD_STACK_SIZEOF(console_stack), console_main,
+                        NULL, NULL, NULL, CONSOLE_PRIORITY, 0, K_NO_WAIT);
+  k_thread_name_set(tid, "console");
+  return 0;
+}
@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+/**
+ * @brief Befehlseingabe auf der Konsole starten
+ *
+ * Empfängt per DMA in zwei abwechselnd gefüllte Puffer. Vollständige Zeilen
+ * werden in einem eigenen Thread ausgewertet, "help" listet die Befehle.
+ *
+ * @return 0 bei Erfolg, sonst negativer Fehler
+ */
+int console_init(void);
+
+#endif // CONSOLE_H
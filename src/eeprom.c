@@ -3,97 +3,903 @@
  *
  * SPDX-License-Identifier: Apache-2.0
  */
+#include "eeprom.h"
+#include "config.h"
+#include "storage_io.h"
 #include <zephyr/drivers/eeprom.h>
 #include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/crc.h>
+
+LOG_MODULE_REGISTER(eeprom, CONFIG_PAKETKASTEN_LOG_LEVEL);
 
 #define EEPROM_NODE DT_NODELABEL(eeprom0)
 
-#define EEPROM_PAGE_SIZE 64
+#define EEPROM_PAGE_SIZE DT_PROP(EEPROM_NODE, pagesize)
+#define EEPROM_SIZE DT_PROP(EEPROM_NODE, size)
+
+/* UID-Tabelle:
+ * Seite 0 enthält den Header (die zweite Hälfte gehört Kopie A der
+ * Konfiguration, siehe config.c), alle weiteren Seiten sind Hash-Buckets mit je
+ * UID_SLOTS Einträgen. Eine UID liegt im Bucket hash(uid) % UID_PAGES, ist
+ * dieser voll, in einem der folgenden (lineares Sondieren). Im RAM steht pro
+ * Bucket nur die Anzahl belegter Slots (4 Bit), sodass eine Suche nur die
+ * Seiten liest, in denen die UID überhaupt liegen kann.
+ *
+ * Hinter den Slots liegt pro Slot ein Byte mit den Fächern, die die Karte
+ * öffnen darf (Bit n = Fach n). 0x00 und 0xff (Einträge von vor der
+ * Fachzuordnung) bedeuten alle Fächer.
+ *
+ * Eine Seite wird immer ganz geschrieben und endet mit einer CRC16. Eine
+ * belegte Seite mit falscher CRC wurde beim Schreiben unterbrochen, ihre
+ * Einträge werden beim Start verworfen (siehe uid_table_scan). */
+#define UID_TABLE_MAGIC 0x54554b50 // "PKUT"
+#define UID_TABLE_FORMAT 2
+/* Format 1: gleiche Seiten ohne CRC, wird beim Start übernommen */
+#define UID_TABLE_FORMAT_NO_CRC 1
+#define UID_PAGES (EEPROM_SIZE / EEPROM_PAGE_SIZE - 1)
+#define UID_SLOTS 5
+#define UID_PAGE_OFFSET(p) (((p) + 1) * EEPROM_PAGE_SIZE)
+
+/* Slotzustände im Längenbyte. 0x00 und 0xff (gelöschtes EEPROM) sind frei. */
+#define UID_SLOT_FREE 0x00
+#define UID_SLOT_ERASED 0xff
+#define UID_SLOT_DELETED 0xfe
+
+/* Altes Format: eine Liste mit 6 UIDs an Adresse 0 */
+#define UID_LEGACY_LIST_LEN 6
 
 static const struct device *eeprom_dev;
 
-#define UID_LIST_LEN 6
-#define UID_MAX_LEN 10
+struct uid_entry {
+  uint8_t len;
+  uint8_t uid[UID_MAX_LEN];
+} __packed;
 
-static struct uid_list {
-  uint8_t uid[UID_LIST_LEN][UID_MAX_LEN];
-  size_t uid_count;
-} uids;
+struct uid_page {
+  struct uid_entry entry[UID_SLOTS];
+  uint8_t faecher[UID_SLOTS];
+  uint8_t reserved[EEPROM_PAGE_SIZE -
+                   UID_SLOTS * (sizeof(struct uid_entry) + 1) - 2];
+  uint16_t crc; // CRC16 (ITU-T) über alle Bytes davor
+} __packed;
 
-BUILD_ASSERT(sizeof(struct uid_list) <= EEPROM_PAGE_SIZE,
-             "struct uid_list is to big for one EEPROM page");
+struct uid_table_header {
+  uint32_t magic;
+  uint8_t format;
+  uint8_t slots;
+  uint16_t pages;
+} __packed;
 
-int eeprom_init(void) {
+struct uid_legacy_list {
+  uint8_t uid[UID_LEGACY_LIST_LEN][UID_MAX_LEN];
+  uint32_t uid_count;
+};
+
+BUILD_ASSERT(sizeof(struct uid_page) == EEPROM_PAGE_SIZE,
+             "struct uid_page must fill one EEPROM page");
+BUILD_ASSERT(UID_SLOTS < 16, "slot count must fit into the 4 bit page index");
+
+/* Belegte Slots (gültig oder gelöscht) pro Bucket, 4 Bit pro Seite */
+static uint8_t page_fill[(UID_PAGES + 1) / 2];
+static uint16_t uid_count;
+
+/* Bloom-Filter über alle gespeicherten UIDs. Unbekannte UIDs werden meist
+   schon hier abgelehnt, ohne das EEPROM zu lesen. */
+#define UID_BLOOM_BITS CONFIG_PAKETKASTEN_UID_BLOOM_BITS
+#define UID_BLOOM_HASHES 3
+
+BUILD_ASSERT(IS_POWER_OF_TWO(UID_BLOOM_BITS),
+             "bloom filter size must be a power of two");
+
+static uint8_t uid_bloom[UID_BLOOM_BITS / 8];
+
+/* Zuletzt akzeptierte UIDs, vorne die neueste */
+static struct uid_cache_entry {
+  struct uid_entry e;
+  uint8_t faecher;
+} uid_cache[CONFIG_PAKETKASTEN_UID_CACHE_ENTRIES];
+
+static struct {
+  uint32_t lookups;
+  uint32_t bloom_rejects;
+  uint32_t cache_hits;
+  uint32_t table_hits;
+  uint32_t table_misses; // Falsch-Positive des Bloom-Filters
+  uint32_t page_reads;
+} uid_stats;
+
+/* Abgleich mit einer vollständigen Liste (eeprom_sync_*): Änderungen
+   sammeln sich in einer Seite im RAM und werden erst beim Wechsel auf eine
+   andere Seite in einem Zugriff geschrieben. seen markiert die Slots der
+   übertragenen UIDs, alle anderen werden am Ende gelöscht. */
+static struct {
+  bool active;
+  bool dirty;
+  uint16_t page;
+  struct uid_page buf;
+  uint8_t seen[(UID_PAGES * UID_SLOTS + 7) / 8];
+  uint32_t page_writes;
+} uid_sync;
+
+K_MUTEX_DEFINE(uid_lock);
+
+static uint8_t fill_get(uint16_t page) {
+  return (page_fill[page / 2] >> ((page % 2) * 4)) & 0x0f;
+}
+
+static void fill_set(uint16_t page, uint8_t fill) {
+  uint8_t shift = (page % 2) * 4;
+
+  page_fill[page / 2] =
+      (page_fill[page / 2] & ~(0x0f << shift)) | (fill << shift);
+}
+
+static bool slot_used(const struct uid_entry *e) {
+  return e->len != UID_SLOT_FREE && e->len != UID_SLOT_ERASED &&
+         (e->len <= UID_MAX_LEN || e->len == UID_SLOT_DELETED);
+}
+
+static bool slot_valid(const struct uid_entry *e) {
+  return e->len != UID_SLOT_FREE && e->len <= UID_MAX_LEN;
+}
+
+/* FNV-1a */
+static uint16_t uid_bucket(const uint8_t *uid, size_t len) {
+  uint32_t hash = 2166136261U;
+
+  for (size_t i = 0; i < len; i++) {
+    hash = (hash ^ uid[i]) * 16777619U;
+  }
+  return hash % UID_PAGES;
+}
+
+static void bloom_hashes(const uint8_t *uid, size_t len, uint32_t *h1,
+                         uint32_t *h2) {
+  uint32_t hash = 2166136261U;
+
+  for (size_t i = 0; i < len; i++) {
+    hash = (hash ^ uid[i]) * 16777619U;
+  }
+  *h1 = hash;
+  /* Zweiter Hash für Double-Hashing, ungerade damit alle Bits erreicht werden */
+  *h2 = ((hash >> 16) | (hash << 16)) * 0x9e3779b1U | 1U;
+}
+
+static void bloom_add(const uint8_t *uid, size_t len) {
+  uint32_t h1, h2, bit;
+
+  bloom_hashes(uid, len, &h1, &h2);
+  for (int i = 0; i < UID_BLOOM_HASHES; i++) {
+    bit = (h1 + i * h2) & (UID_BLOOM_BITS - 1);
+    uid_bloom[bit / 8] |= BIT(bit % 8);
+  }
+}
+
+static bool bloom_test(const uint8_t *uid, size_t len) {
+  uint32_t h1, h2, bit;
+
+  bloom_hashes(uid, len, &h1, &h2);
+  for (int i = 0; i < UID_BLOOM_HASHES; i++) {
+    bit = (h1 + i * h2) & (UID_BLOOM_BITS - 1);
+    if ((uid_bloom[bit / 8] & BIT(bit % 8)) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static uint8_t cache_lookup(const uint8_t *uid, size_t len) {
+  struct uid_cache_entry hit;
+
+  for (int i = 0; i < ARRAY_SIZE(uid_cache); i++) {
+    if (uid_cache[i].e.len == len &&
+        memcmp(uid_cache[i].e.uid, uid, len) == 0) {
+      /* Nach vorne holen */
+      hit = uid_cache[i];
+      memmove(&uid_cache[1], &uid_cache[0], i * sizeof(uid_cache[0]));
+      uid_cache[0] = hit;
+      return hit.faecher;
+    }
+  }
+  return 0;
+}
+
+static void cache_remove(const uint8_t *uid, size_t len) {
+  for (int i = 0; i < ARRAY_SIZE(uid_cache); i++) {
+    if (uid_cache[i].e.len == len &&
+        memcmp(uid_cache[i].e.uid, uid, len) == 0) {
+      memmove(&uid_cache[i], &uid_cache[i + 1],
+              (ARRAY_SIZE(uid_cache) - i - 1) * sizeof(uid_cache[0]));
+      memset(&uid_cache[ARRAY_SIZE(uid_cache) - 1], 0, sizeof(uid_cache[0]));
+      return;
+    }
+  }
+}
+
+static void cache_insert(const uint8_t *uid, size_t len, uint8_t faecher) {
+  memmove(&uid_cache[1], &uid_cache[0],
+          (ARRAY_SIZE(uid_cache) - 1) * sizeof(uid_cache[0]));
+  uid_cache[0].e.len = len;
+  memcpy(uid_cache[0].e.uid, uid, len);
+  uid_cache[0].faecher = faecher;
+}
+
+/* Fächer eines Slots, alte Einträge ohne Zuordnung gelten für alle */
+static uint16_t page_crc(const struct uid_page *buf) {
+  return crc16_itu_t(0xffff, (const uint8_t *)buf,
+                     offsetof(struct uid_page, crc));
+}
+
+static uint8_t slot_faecher(const struct uid_page *buf, int slot) {
+  uint8_t faecher = buf->faecher[slot];
+
+  return faecher == 0 ? UID_ALL_COMPARTMENTS : faecher;
+}
+
+/* Seite des laufenden Abgleichs mit noch nicht geschriebenen Änderungen */
+static bool sync_buffered(uint16_t page) {
+  return uid_sync.dirty && uid_sync.page == page;
+}
+
+static int page_read(uint16_t page, struct uid_page *buf) {
+  if (sync_buffered(page)) {
+    *buf = uid_sync.buf;
+    return 0;
+  }
+  uid_stats.page_reads++;
+  return storage_io_read(eeprom_dev, UID_PAGE_OFFSET(page), buf, sizeof(*buf));
+}
+
+/* Schreibt die ganze Seite mit neuer CRC, ein Seitenzugriff des AT25.
+   Änderungen an der gepufferten Seite auch im Puffer machen, sonst würden
+   sie beim Schreiben des Puffers überschrieben. */
+static int page_write(uint16_t page, struct uid_page *buf) {
+  buf->crc = page_crc(buf);
+  if (sync_buffered(page)) {
+    uid_sync.buf = *buf;
+  }
+  return storage_io_write(eeprom_dev, UID_PAGE_OFFSET(page), buf, sizeof(*buf));
+}
+
+static uint8_t page_count_used(const struct uid_page *buf) {
+  uint8_t used = 0;
+
+  for (int i = 0; i < UID_SLOTS; i++) {
+    if (slot_used(&buf->entry[i])) {
+      used++;
+    }
+  }
+  return used;
+}
+
+static int slot_find(const struct uid_page *buf, const uint8_t *uid,
+                     size_t len) {
+  for (int i = 0; i < UID_SLOTS; i++) {
+    if (buf->entry[i].len == len && memcmp(buf->entry[i].uid, uid, len) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* Sucht die UID entlang der Sondierungskette. Bei Erfolg enthält buf die
+   Seite und page, slot die Position. */
+static bool uid_lookup(const uint8_t *uid, size_t len, struct uid_page *buf,
+                       uint16_t *page, int *slot) {
+  uint16_t p = uid_bucket(uid, len);
+
+  for (uint16_t probe = 0; probe < UID_PAGES; probe++) {
+    uint8_t fill = fill_get(p);
+
+    if (fill == 0) {
+      return false;
+    }
+
+    if (page_read(p, buf) < 0) {
+      return false;
+    }
+
+    *slot = slot_find(buf, uid, len);
+    if (*slot >= 0) {
+      *page = p;
+      return true;
+    }
+
+    /* Nur volle Buckets sind in den nächsten übergelaufen */
+    if (fill < UID_SLOTS) {
+      return false;
+    }
+    p = (p + 1) % UID_PAGES;
+  }
+  return false;
+}
+
+/* Übernimmt die Liste des alten Formats in die neue Tabelle */
+static void uid_import_legacy(const struct uid_legacy_list *legacy) {
+  size_t len;
+
+  if (legacy->uid_count > UID_LEGACY_LIST_LEN) {
+    return;
+  }
+
+  for (uint32_t i = 0; i < legacy->uid_count; i++) {
+    /* Die Länge wurde nicht gespeichert: ISO14443A UIDs sind 4, 7 oder 10
+       Bytes lang, nicht benutzte Bytes sind 0 */
+    len = UID_MAX_LEN;
+    while (len > 4 && legacy->uid[i][len - 1] == 0) {
+      len--;
+    }
+    len = (len <= 4) ? 4 : (len <= 7) ? 7 : UID_MAX_LEN;
+    eeprom_add_uid(legacy->uid[i], len, UID_ALL_COMPARTMENTS);
+  }
+  LOG_INF("Imported %u UIDs from old list", legacy->uid_count);
+}
+
+/* Einträge einer unterbrochen geschriebenen Seite verwerfen. Sie werden als
+   gelöscht markiert, damit Sondierungsketten über die Seite erhalten
+   bleiben. */
+static int page_discard(uint16_t page, struct uid_page *buf) {
+  for (int i = 0; i < UID_SLOTS; i++) {
+    if (slot_used(&buf->entry[i])) {
+      memset(&buf->entry[i], 0, sizeof(buf->entry[i]));
+      buf->entry[i].len = UID_SLOT_DELETED;
+    }
+    buf->faecher[i] = 0;
+  }
+  return page_write(page, buf);
+}
+
+/* Baut den RAM-Index aus den Buckets auf und prüft die CRC jeder belegten
+   Seite. Mit add_crc (Format 1) bekommen die Seiten ihre erste CRC. Gibt
+   die Anzahl verworfener Seiten zurück. */
+static int uid_table_scan(bool add_crc) {
+  struct uid_page buf;
+  uint8_t used;
+  int discarded = 0;
+  int ret;
+
+  uid_count = 0;
+  for (uint16_t p = 0; p < UID_PAGES; p++) {
+    ret = page_read(p, &buf);
+    if (ret < 0) {
+      return ret;
+    }
+
+    used = page_count_used(&buf);
+    if (used > 0 && add_crc) {
+      ret = page_write(p, &buf);
+    } else if (used > 0 && buf.crc != page_crc(&buf)) {
+      LOG_ERR("UID page %u: CRC error, entries discarded", p);
+      ret = page_discard(p, &buf);
+      discarded++;
+    }
+    if (ret < 0) {
+      return ret;
+    }
+
+    fill_set(p, used);
+    for (int i = 0; i < UID_SLOTS; i++) {
+      if (slot_valid(&buf.entry[i])) {
+        uid_count++;
+        bloom_add(buf.entry[i].uid, buf.entry[i].len);
+      }
+    }
+  }
+  return discarded;
+}
+
+static int uid_table_header_write(void) {
+  struct uid_table_header header = {
+      .magic = UID_TABLE_MAGIC,
+      .format = UID_TABLE_FORMAT,
+      .slots = UID_SLOTS,
+      .pages = UID_PAGES,
+  };
+
+  return storage_io_write(eeprom_dev, 0, &header, sizeof(header));
+}
+
+/* Ungültiger Kopf: die Buckets entscheiden, nicht der Kopf. Ohne belegte
+   Seite ist es ein neues EEPROM oder das alte Format, die alte Liste wird
+   übernommen. Sonst wird der Index aus den Seiten aufgebaut. Hat keine
+   belegte Seite eine gültige CRC, stammen sie aus Format 1. Gelöscht wird
+   nur mit eeprom_clear_uid_list(). */
+static int uid_table_rebuild(void) {
+  struct uid_legacy_list legacy;
+  struct uid_page buf;
+  uint16_t used = 0;
+  uint16_t crc_ok = 0;
+  int discarded;
+  int ret;
+
+  for (uint16_t p = 0; p < UID_PAGES; p++) {
+    ret = page_read(p, &buf);
+    if (ret < 0) {
+      return ret;
+    }
+    if (page_count_used(&buf) > 0) {
+      used++;
+      crc_ok += buf.crc == page_crc(&buf);
+    }
+  }
+
+  if (used == 0) {
+    ret = storage_io_read(eeprom_dev, 0, &legacy, sizeof(legacy));
+    if (ret == 0) {
+      ret = uid_table_header_write();
+    }
+    if (ret < 0) {
+      return ret;
+    }
+    memset(page_fill, 0, sizeof(page_fill));
+    uid_count = 0;
+    uid_import_legacy(&legacy);
+    return 0;
+  }
+
+  LOG_WRN("UID table header invalid, rebuilding from %u pages", used);
+  discarded = uid_table_scan(crc_ok == 0);
+  if (discarded < 0) {
+    return discarded;
+  }
+  ret = uid_table_header_write();
+  return ret < 0 ? ret : discarded;
+}
 
+int eeprom_init(void) {
+  struct uid_table_header header;
   int ret;
 
   eeprom_dev = DEVICE_DT_GET(EEPROM_NODE);
 
   if (!device_is_ready(eeprom_dev)) {
-    printk("AT25 EEPROM not ready!\n");
+    LOG_ERR("AT25 EEPROM not ready!");
     return -1;
   }
 
-  ret = eeprom_read(eeprom_dev, 0, &uids, sizeof(uids));
+  ret = storage_io_read(eeprom_dev, 0, &header, sizeof(header));
+  if (ret < 0) {
+    LOG_ERR("Read failed: %d", ret);
+    return ret;
+  }
+
+  k_mutex_lock(&uid_lock, K_FOREVER);
+  if (header.magic != UID_TABLE_MAGIC || header.slots != UID_SLOTS ||
+      header.pages != UID_PAGES ||
+      (header.format != UID_TABLE_FORMAT &&
+       header.format != UID_TABLE_FORMAT_NO_CRC)) {
+    ret = uid_table_rebuild();
+  } else if (header.format == UID_TABLE_FORMAT_NO_CRC) {
+    ret = uid_table_scan(true);
+    if (ret >= 0) {
+      ret = uid_table_header_write();
+    }
+  } else {
+    ret = uid_table_scan(false);
+  }
+  k_mutex_unlock(&uid_lock);
+
   if (ret < 0) {
-    printk("Read failed: %d\n", ret);
+    LOG_ERR("UID table init failed: %d", ret);
     return ret;
   }
+  if (ret > 0) {
+    /* Die Liste ist unvollständig: Version zurücksetzen, damit der
+       Controller beim nächsten Abgleich die ganze Liste sendet */
+    config_set_uid_version(0);
+  }
 
+  LOG_INF("UID table: %u UIDs", uid_count);
   return 0;
 }
 
-int eeprom_write_uid_list(void) {
+uint16_t eeprom_uid_count(void) { return uid_count; }
+
+void eeprom_clear_uid_list(void) {
+  struct uid_page buf;
+
+  memset(&buf, 0, sizeof(buf));
 
+  k_mutex_lock(&uid_lock, K_FOREVER);
+  memset(uid_bloom, 0, sizeof(uid_bloom));
+  memset(uid_cache, 0, sizeof(uid_cache));
+
+  /* Nur belegte Buckets neu schreiben */
+  for (uint16_t p = 0; p < UID_PAGES; p++) {
+    if (fill_get(p) == 0) {
+      continue;
+    }
+    if (page_write(p, &buf) < 0) {
+      LOG_ERR("Clear of page %u failed", p);
+      continue;
+    }
+    fill_set(p, 0);
+  }
+  uid_count = 0;
+  /* Auch ein zuvor ungültiger Kopf ist danach wieder gültig */
+  if (uid_table_header_write() < 0) {
+    LOG_ERR("UID table header write failed");
+  }
+  k_mutex_unlock(&uid_lock);
+}
+
+int eeprom_add_uid(const uint8_t *uid, size_t len, uint8_t faecher) {
+  struct uid_page buf;
+  uint16_t p;
+  int slot;
   int ret;
 
-  ret = eeprom_write(eeprom_dev, 0, &uids, sizeof(uids));
-  if (ret < 0) {
-    printk("Write failed: %d\n", ret);
+  if (len == 0 || len > UID_MAX_LEN) {
+    LOG_ERR("Wrong UID size! Max 10 bytes allowed");
+    return -EINVAL;
+  }
+  if (faecher == 0) {
+    return -EINVAL;
+  }
+
+  k_mutex_lock(&uid_lock, K_FOREVER);
+
+  /* Bekannte UID: nur die Fächer ändern */
+  if (uid_lookup(uid, len, &buf, &p, &slot)) {
+    ret = 0;
+    if (buf.faecher[slot] != faecher) {
+      buf.faecher[slot] = faecher;
+      ret = page_write(p, &buf);
+      cache_remove(uid, len);
+    }
+    k_mutex_unlock(&uid_lock);
     return ret;
   }
 
-  for (size_t i = 0; i < uids.uid_count; i++) {
-    printk("UID[%d]: ", i);
-    for (size_t j = 0; j < UID_MAX_LEN; j++) {
-      printk("%02X ", uids.uid[i][j]);
+  /* Ersten freien oder gelöschten Slot entlang der Kette suchen */
+  ret = -ENOMEM;
+  p = uid_bucket(uid, len);
+  for (uint16_t probe = 0; probe < UID_PAGES; probe++) {
+    if (fill_get(p) == 0) {
+      /* Leerer Bucket muss nicht gelesen werden */
+      memset(&buf, 0, sizeof(buf));
+    } else if (page_read(p, &buf) < 0) {
+      ret = -EIO;
+      break;
     }
-    printk("\n");
+
+    for (slot = 0; slot < UID_SLOTS; slot++) {
+      if (!slot_valid(&buf.entry[slot])) {
+        break;
+      }
+    }
+
+    if (slot < UID_SLOTS) {
+      buf.entry[slot].len = len;
+      memcpy(buf.entry[slot].uid, uid, len);
+      memset(&buf.entry[slot].uid[len], 0, UID_MAX_LEN - len);
+      buf.faecher[slot] = faecher;
+
+      ret = page_write(p, &buf);
+      if (ret == 0) {
+        fill_set(p, page_count_used(&buf));
+        uid_count++;
+        bloom_add(uid, len);
+      }
+      break;
+    }
+    p = (p + 1) % UID_PAGES;
+  }
+
+  k_mutex_unlock(&uid_lock);
+
+  if (ret == -ENOMEM) {
+    LOG_WRN("UID List is full");
   }
+  return ret;
+}
+
+/* Der Slot wird als gelöscht markiert, damit Sondierungsketten über diesen
+   Bucket erhalten bleiben. Im Bloom-Filter bleibt die UID bis zum nächsten
+   Start stehen, das kostet höchstens einen Seitenzugriff. */
+int eeprom_remove_uid(const uint8_t *uid, size_t len) {
+  struct uid_page buf;
+  uint16_t p;
+  int slot;
+  int ret;
+
+  if (len == 0 || len > UID_MAX_LEN) {
+    return -EINVAL;
+  }
+
+  k_mutex_lock(&uid_lock, K_FOREVER);
+
+  if (!uid_lookup(uid, len, &buf, &p, &slot)) {
+    k_mutex_unlock(&uid_lock);
+    return -ENOENT;
+  }
+
+  memset(&buf.entry[slot], 0, sizeof(buf.entry[slot]));
+  buf.entry[slot].len = UID_SLOT_DELETED;
+
+  ret = page_write(p, &buf);
+  if (ret == 0) {
+    uid_count--;
+    cache_remove(uid, len);
+  }
+
+  k_mutex_unlock(&uid_lock);
+  return ret;
+}
+
+int eeprom_replace_uid(const uint8_t *old_uid, size_t old_len,
+                       const uint8_t *new_uid, size_t new_len) {
+  uint8_t faecher = eeprom_check_uid(old_uid, old_len);
+  int ret;
+
+  if (faecher == 0) {
+    return -ENOENT;
+  }
+
+  /* Erst die neue UID mit den Fächern der alten speichern, damit bei einem
+     Fehler die alte gilt */
+  ret = eeprom_add_uid(new_uid, new_len, faecher);
+  if (ret < 0) {
+    return ret;
+  }
+  return eeprom_remove_uid(old_uid, old_len);
+}
 
-  k_msleep(10);
+uint8_t eeprom_check_uid(const uint8_t *uid, size_t len) {
+  struct uid_page buf;
+  uint16_t page;
+  int slot;
+  uint8_t faecher;
 
+  if (len == 0 || len > UID_MAX_LEN) {
+    return 0;
+  }
+
+  k_mutex_lock(&uid_lock, K_FOREVER);
+  uid_stats.lookups++;
+
+  if (!bloom_test(uid, len)) {
+    uid_stats.bloom_rejects++;
+    faecher = 0;
+  } else if ((faecher = cache_lookup(uid, len)) != 0) {
+    uid_stats.cache_hits++;
+  } else if (uid_lookup(uid, len, &buf, &page, &slot)) {
+    uid_stats.table_hits++;
+    faecher = slot_faecher(&buf, slot);
+    cache_insert(uid, len, faecher);
+  } else {
+    uid_stats.table_misses++;
+  }
+  k_mutex_unlock(&uid_lock);
+
+  return faecher;
+}
+
+static void sync_mark_seen(uint16_t page, int slot) {
+  uint16_t i = page * UID_SLOTS + slot;
+
+  uid_sync.seen[i / 8] |= BIT(i % 8);
+}
+
+static bool sync_seen(uint16_t page, int slot) {
+  uint16_t i = page * UID_SLOTS + slot;
+
+  return uid_sync.seen[i / 8] & BIT(i % 8);
+}
+
+/* Gepufferte Seite schreiben */
+static int sync_flush(void) {
+  int ret;
+
+  if (!uid_sync.dirty) {
+    return 0;
+  }
+  uid_sync.buf.crc = page_crc(&uid_sync.buf);
+  ret = storage_io_write(eeprom_dev, UID_PAGE_OFFSET(uid_sync.page),
+                         &uid_sync.buf, sizeof(uid_sync.buf));
+  if (ret == 0) {
+    uid_sync.page_writes++;
+  }
+  uid_sync.dirty = false;
+  return ret;
+}
+
+/* Seite in den Puffer holen, eine andere geänderte Seite wird vorher
+   geschrieben */
+static int sync_load(uint16_t page) {
+  int ret;
+
+  if (sync_buffered(page)) {
+    return 0;
+  }
+  ret = sync_flush();
+  if (ret < 0) {
+    return ret;
+  }
+  if (fill_get(page) == 0) {
+    memset(&uid_sync.buf, 0, sizeof(uid_sync.buf));
+  } else {
+    ret = page_read(page, &uid_sync.buf);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+  uid_sync.page = page;
   return 0;
 }
 
-void eeprom_clear_uid_list(void) { memset(&uids, 0, sizeof(uids)); }
+void eeprom_sync_begin(void) {
+  k_mutex_lock(&uid_lock, K_FOREVER);
+  sync_flush();
+  memset(uid_sync.seen, 0, sizeof(uid_sync.seen));
+  uid_sync.active = true;
+  k_mutex_unlock(&uid_lock);
+}
 
-int eeprom_add_uid(uint8_t *uid, size_t len) {
+int eeprom_sync_uid(const uint8_t *uid, size_t len, uint8_t faecher) {
+  struct uid_page buf;
+  uint16_t p;
+  int slot;
+  int ret;
 
-  if (len > UID_MAX_LEN) {
-    printk("Wrong UID size! Max 10 bytes allowed");
+  if (len == 0 || len > UID_MAX_LEN || faecher == 0) {
     return -EINVAL;
   }
 
-  if (uids.uid_count >= UID_LIST_LEN) {
-    printk("UID List is full");
-    return -ENOMEM;
+  k_mutex_lock(&uid_lock, K_FOREVER);
+  if (!uid_sync.active) {
+    k_mutex_unlock(&uid_lock);
+    return -EINVAL;
   }
 
+  /* Bekannt: nur bei anderen Fächern ändern */
+  if (uid_lookup(uid, len, &buf, &p, &slot)) {
+    sync_mark_seen(p, slot);
+    ret = 0;
+    if (buf.faecher[slot] != faecher) {
+      ret = sync_load(p);
+      if (ret == 0) {
+        uid_sync.buf.faecher[slot] = faecher;
+        uid_sync.dirty = true;
+        cache_remove(uid, len);
+        ret = 1;
+      }
+    }
+    k_mutex_unlock(&uid_lock);
+    return ret;
+  }
 
-  memcpy(uids.uid[uids.uid_count], uid, len);
-  memset(&uids.uid[uids.uid_count][len], 0, UID_MAX_LEN - len);
-  uids.uid_count += 1;
+  /* Neu: ersten freien oder gelöschten Slot entlang der Kette belegen */
+  ret = -ENOMEM;
+  p = uid_bucket(uid, len);
+  for (uint16_t probe = 0; probe < UID_PAGES; probe++) {
+    if (fill_get(p) == UID_SLOTS) {
+      /* Voller Bucket kann gelöschte Slots enthalten */
+      if (page_read(p, &buf) < 0) {
+        ret = -EIO;
+        break;
+      }
+      for (slot = 0; slot < UID_SLOTS; slot++) {
+        if (!slot_valid(&buf.entry[slot])) {
+          break;
+        }
+      }
+      if (slot == UID_SLOTS) {
+        p = (p + 1) % UID_PAGES;
+        continue;
+      }
+    }
 
-  return 0;
+    ret = sync_load(p);
+    if (ret < 0) {
+      break;
+    }
+    for (slot = 0; slot < UID_SLOTS; slot++) {
+      if (!slot_valid(&uid_sync.buf.entry[slot])) {
+        break;
+      }
+    }
+    uid_sync.buf.entry[slot].len = len;
+    memcpy(uid_sync.buf.entry[slot].uid, uid, len);
+    memset(&uid_sync.buf.entry[slot].uid[len], 0, UID_MAX_LEN - len);
+    uid_sync.buf.faecher[slot] = faecher;
+    uid_sync.dirty = true;
+    fill_set(p, page_count_used(&uid_sync.buf));
+    uid_count++;
+    bloom_add(uid, len);
+    sync_mark_seen(p, slot);
+    ret = 1;
+    break;
+  }
+  k_mutex_unlock(&uid_lock);
+
+  if (ret == -ENOMEM) {
+    LOG_WRN("UID List is full");
+  }
+  return ret;
 }
 
-bool eeprom_check_uid(uint8_t *uid, size_t len) {
+int eeprom_sync_end(bool commit) {
+  struct uid_page buf;
+  uint8_t seen;
+  bool changed;
+  int removed = 0;
+  int ret;
 
-  for (uint8_t i = 0; i < uids.uid_count; i++) {
-    if (memcmp(uids.uid[i], uid, len) == 0) {
-      return true;
+  k_mutex_lock(&uid_lock, K_FOREVER);
+  ret = sync_flush();
+  k_mutex_unlock(&uid_lock);
+  if (ret < 0 || !commit) {
+    uid_sync.active = false;
+    return ret;
+  }
+
+  /* Nicht übertragene UIDs löschen. Die Sperre gilt nur für eine Seite, die
+     RFID-Prüfung wartet so höchstens einen Seitenzugriff. */
+  for (uint16_t p = 0; p < UID_PAGES && ret == 0; p++) {
+    k_mutex_lock(&uid_lock, K_FOREVER);
+    seen = 0;
+    for (int i = 0; i < UID_SLOTS; i++) {
+      seen += sync_seen(p, i);
+    }
+    /* Alle belegten Slots übertragen, Seite muss nicht gelesen werden */
+    if (fill_get(p) == seen) {
+      k_mutex_unlock(&uid_lock);
+      continue;
     }
+
+    changed = false;
+    ret = page_read(p, &buf);
+    for (int i = 0; i < UID_SLOTS && ret == 0; i++) {
+      if (slot_valid(&buf.entry[i]) && !sync_seen(p, i)) {
+        cache_remove(buf.entry[i].uid, buf.entry[i].len);
+        memset(&buf.entry[i], 0, sizeof(buf.entry[i]));
+        buf.entry[i].len = UID_SLOT_DELETED;
+        uid_count--;
+        removed++;
+        changed = true;
+      }
+    }
+    if (changed) {
+      ret = page_write(p, &buf);
+      uid_sync.page_writes++;
+    }
+    k_mutex_unlock(&uid_lock);
   }
-  return false;
-}
\ No newline at end of file
+  uid_sync.active = false;
+
+  return ret < 0 ? ret : removed;
+}
+
+int eeprom_foreach_uid(eeprom_uid_cb_t cb, void *user_data) {
+  struct uid_page buf;
+  int ret = 0;
+
+  for (uint16_t p = 0; p < UID_PAGES && ret == 0; p++) {
+    k_mutex_lock(&uid_lock, K_FOREVER);
+    if (fill_get(p) == 0) {
+      k_mutex_unlock(&uid_lock);
+      continue;
+    }
+    ret = page_read(p, &buf);
+    k_mutex_unlock(&uid_lock);
+
+    for (int i = 0; i < UID_SLOTS && ret == 0; i++) {
+      if (slot_valid(&buf.entry[i])) {
+        ret = cb(buf.entry[i].uid, buf.entry[i].len, slot_faecher(&buf, i),
+                 user_data);
+      }
+    }
+  }
+  return ret;
+}
+
+void eeprom_print_stats(void) {
+  printk("UIDs: %u, lookups %u, bloom rejects %u, cache hits %u, "
+         "table hits %u, false positives %u, page reads %u, "
+         "sync page writes %u\n",
+         uid_count, uid_stats.lookups, uid_stats.bloom_rejects,
+         uid_stats.cache_hits, uid_stats.table_hits, uid_stats.table_misses,
+         uid_stats.page_reads, uid_sync.page_writes);
+}
@@ -7,10 +7,55 @@
 #ifndef EEPROM_H
 #define EEPROM_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define UID_MAX_LEN 10
+
+/* Fachmaske einer Karte, Bit n = Fach n */
+#define UID_ALL_COMPARTMENTS 0xff
+
 int eeprom_init(void);
-int eeprom_write_uid_list(void);
 void eeprom_clear_uid_list(void);
-int eeprom_add_uid(uint8_t *uid, size_t len);
-bool eeprom_check_uid(uint8_t *uid, size_t len);
 
-#endif // EEPROM_H
\ No newline at end of file
+/* UID mit den Fächern speichern, die sie öffnen darf. Ist die UID schon
+   bekannt, werden nur die Fächer geändert. */
+int eeprom_add_uid(const uint8_t *uid, size_t len, uint8_t faecher);
+int eeprom_remove_uid(const uint8_t *uid, size_t len);
+
+/* Die neue UID übernimmt die Fächer der alten */
+int eeprom_replace_uid(const uint8_t *old_uid, size_t old_len,
+                       const uint8_t *new_uid, size_t new_len);
+
+/* Fächer, die die UID öffnen darf, 0 für eine unbekannte UID */
+uint8_t eeprom_check_uid(const uint8_t *uid, size_t len);
+uint16_t eeprom_uid_count(void);
+
+/* Abgleich mit einer vollständigen Liste (uidsync.c). Nach
+   eeprom_sync_begin() wird jede UID der Liste mit eeprom_sync_uid()
+   übergeben, Änderungen werden seitenweise gesammelt geschrieben. */
+void eeprom_sync_begin(void);
+
+/* 0 unverändert, 1 neu oder Fächer geändert, sonst negativer Fehler */
+int eeprom_sync_uid(const uint8_t *uid, size_t len, uint8_t faecher);
+
+/**
+ * @brief Abgleich beenden
+ *
+ * Schreibt die letzte gesammelte Seite. Mit commit werden alle UIDs
+ * gelöscht, die seit eeprom_sync_begin() nicht übergeben wurden, auch in
+ * der Zwischenzeit anders hinzugefügte.
+ *
+ * @return Anzahl gelöschter UIDs, sonst negativer Fehler
+ */
+int eeprom_sync_end(bool commit);
+
+typedef int (*eeprom_uid_cb_t)(const uint8_t *uid, size_t len,
+                               uint8_t faecher, void *user_data);
+
+/* Alle gespeicherten UIDs, ein negativer Rückgabewert von cb bricht ab */
+int eeprom_foreach_uid(eeprom_uid_cb_t cb, void *user_data);
+void eeprom_print_stats(void);
+
+#endif // EEPROM_H
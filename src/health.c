@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "health.h"
+#include "compartment.h"
+#include "logstore.h"
+#include "writeback.h"
+#include <zephyr/drivers/hwinfo.h>
+#include <zephyr/kernel.h>
+
+/* Die Zähler liegen im RAM und werden als zwei Datensätze im Log-Store
+   geschrieben: vor dem Abschalten der Peripherie oder nach
+   CONFIG_PAKETKASTEN_HEALTH_COMMIT_EVENTS Ereignissen. Ein Ereignis kostet
+   so keinen eigenen Seitenzugriff, bei Stromausfall gehen höchstens die
+   Ereignisse seit dem letzten Schreiben verloren. */
+#define HEALTH_FAECHER 8 // Speicherformat, unabhängig von COMPARTMENT_COUNT
+
+struct health_counters {
+  uint32_t counter[HEALTH_COUNTER_COUNT];
+};
+
+struct health_openings {
+  uint32_t fach[HEALTH_FAECHER];
+};
+
+BUILD_ASSERT(sizeof(struct health_counters) <= LOGSTORE_DATA_MAX);
+BUILD_ASSERT(sizeof(struct health_openings) <= LOGSTORE_DATA_MAX);
+BUILD_ASSERT(COMPARTMENT_COUNT <= HEALTH_FAECHER);
+
+static struct health_counters health_counters;
+static struct health_openings health_openings;
+static bool health_openings_dirty;
+static uint16_t health_pending; // Ereignisse seit dem letzten Schreiben
+static struct k_spinlock health_spin;
+static struct writeback health_wb;
+
+/* Beginn und angebrochene Sekunde des Schlafs */
+static int64_t health_sleep_start;
+static uint32_t health_sleep_ms;
+
+static int health_commit(struct writeback *wb) {
+  struct health_counters counters;
+  struct health_openings openings;
+  k_spinlock_key_t key;
+  bool write_openings;
+  int ret;
+
+  key = k_spin_lock(&health_spin);
+  counters = health_counters;
+  openings = health_openings;
+  write_openings = health_openings_dirty;
+  health_openings_dirty = false;
+  health_pending = 0;
+  k_spin_unlock(&health_spin, key);
+
+  ret = logstore_write(LOGSTORE_KEY_HEALTH, &counters, sizeof(counters));
+  if (ret == 0 && write_openings) {
+    ret = logstore_write(LOGSTORE_KEY_HEALTH_OPENINGS, &openings,
+                         sizeof(openings));
+  }
+  if (ret == -ENODEV) {
+    /* Ohne Log-Store nur im RAM zählen */
+    return 0;
+  }
+  if (ret < 0 && write_openings) {
+    key = k_spin_lock(&health_spin);
+    health_openings_dirty = true;
+    k_spin_unlock(&health_spin, key);
+  }
+  return ret;
+}
+
+/* Nur mit health_spin aufrufen. Gibt true zurück, wenn genug Ereignisse für
+   ein Schreiben gesammelt sind. */
+static bool health_event(void) {
+  return ++health_pending >= CONFIG_PAKETKASTEN_HEALTH_COMMIT_EVENTS;
+}
+
+int health_init(void) {
+  uint32_t cause;
+  int ret;
+
+  writeback_register(&health_wb, health_commit);
+
+  ret = logstore_read(LOGSTORE_KEY_HEALTH, &health_counters,
+                      sizeof(health_counters));
+  if (ret < 0 && ret != -ENOENT) {
+    return ret;
+  }
+  ret = logstore_read(LOGSTORE_KEY_HEALTH_OPENINGS, &health_openings,
+                      sizeof(health_openings));
+  if (ret < 0 && ret != -ENOENT) {
+    return ret;
+  }
+
+  health_inc(HEALTH_BOOTS);
+
+  /* Der STM32L1 setzt bei Unterspannung (BOR) dasselbe Flag wie beim
+     Einschalten, beides zählt als Unterspannung */
+  if (hwinfo_get_reset_cause(&cause) == 0) {
+    if (cause & (RESET_BROWNOUT | RESET_POR)) {
+      health_inc(HEALTH_BROWNOUT_BOOTS);
+    }
+    hwinfo_clear_reset_cause();
+  }
+
+  /* Den Start sofort schreiben, Neustarts in Schleife sollen sichtbar sein */
+  writeback_mark(&health_wb);
+  return 0;
+}
+
+void health_inc(health_counter_t counter) {
+  k_spinlock_key_t key = k_spin_lock(&health_spin);
+  bool commit;
+
+  health_counters.counter[counter]++;
+  commit = health_event();
+  k_spin_unlock(&health_spin, key);
+
+  if (commit) {
+    writeback_mark(&health_wb);
+  }
+}
+
+void health_opening(uint8_t fach) {
+  k_spinlock_key_t key;
+  bool commit;
+
+  if (fach >= HEALTH_FAECHER) {
+    return;
+  }
+
+  key = k_spin_lock(&health_spin);
+  health_openings.fach[fach]++;
+  health_openings_dirty = true;
+  commit = health_event();
+  k_spin_unlock(&health_spin, key);
+
+  if (commit) {
+    writeback_mark(&health_wb);
+  }
+}
+
+void health_motor_run(uint32_t charge_mas, uint16_t peak_ma) {
+  k_spinlock_key_t key = k_spin_lock(&health_spin);
+  uint32_t *c = health_counters.counter;
+  bool commit;
+
+  c[HEALTH_MOTOR_RUNS]++;
+  c[HEALTH_MOTOR_CHARGE_MAS] += charge_mas;
+  c[HEALTH_MOTOR_PEAK_MAS] = MAX(c[HEALTH_MOTOR_PEAK_MAS], charge_mas);
+  c[HEALTH_MOTOR_PEAK_MA] = MAX(c[HEALTH_MOTOR_PEAK_MA], peak_ma);
+  commit = health_event();
+  k_spin_unlock(&health_spin, key);
+
+  if (commit) {
+    writeback_mark(&health_wb);
+  }
+}
+
+void health_sleep_enter(void) {
+  k_spinlock_key_t key = k_spin_lock(&health_spin);
+  bool pending = health_pending > 0;
+
+  health_sleep_start = k_uptime_get();
+  k_spin_unlock(&health_spin, key);
+
+  if (pending) {
+    writeback_mark(&health_wb);
+  }
+}
+
+void health_sleep_exit(void) {
+  k_spinlock_key_t key = k_spin_lock(&health_spin);
+
+  health_sleep_ms += k_uptime_get() - health_sleep_start;
+  health_counters.counter[HEALTH_SLEEP_S] += health_sleep_ms / 1000;
+  health_sleep_ms %= 1000;
+  /* Geschrieben wird spätestens mit dem nächsten Schlaf */
+  health_pending++;
+  k_spin_unlock(&health_spin, key);
+}
+
+void health_print(void) {
+  struct health_counters h;
+  struct health_openings o;
+  k_spinlock_key_t key = k_spin_lock(&health_spin);
+  uint16_t pending = health_pending;
+
+  h = health_counters;
+  o = health_openings;
+  k_spin_unlock(&health_spin, key);
+
+  printk("Health: boots %u (power-on/brown-out %u), sleep %u s, "
+         "pending %u\n",
+         h.counter[HEALTH_BOOTS], h.counter[HEALTH_BROWNOUT_BOOTS],
+         h.counter[HEALTH_SLEEP_S], pending);
+  printk("RFID: accepts %u, rejects %u, CR95HF resets %u\n",
+         h.counter[HEALTH_RFID_ACCEPTS], h.counter[HEALTH_RFID_REJECTS],
+         h.counter[HEALTH_CR95HF_RESETS]);
+  printk("Motor: runs %u, timeouts %u, stalls %u, charge %u mAs, "
+         "peak %u mAs/run, %u mA\n",
+         h.counter[HEALTH_MOTOR_RUNS], h.counter[HEALTH_MOTOR_TIMEOUTS],
+         h.counter[HEALTH_MOTOR_STALLS], h.counter[HEALTH_MOTOR_CHARGE_MAS],
+         h.counter[HEALTH_MOTOR_PEAK_MAS], h.counter[HEALTH_MOTOR_PEAK_MA]);
+  for (uint8_t fach = 0; fach < COMPARTMENT_COUNT; fach++) {
+    printk("Fach %u: openings %u\n", fach, o.fach[fach]);
+  }
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef HEALTH_H
+#define HEALTH_H
+
+#include <stdint.h>
+
+/* Betriebszähler über die Lebensdauer, Reihenfolge ist das Speicherformat */
+typedef enum {
+  HEALTH_BOOTS,
+  HEALTH_BROWNOUT_BOOTS,   // Einschalten oder Unterspannung
+  HEALTH_SLEEP_S,          // Zeit mit abgeschalteter Peripherie
+  HEALTH_RFID_ACCEPTS,
+  HEALTH_RFID_REJECTS,
+  HEALTH_CR95HF_RESETS,    // Workaround nach abgebrochener Antikollision
+  HEALTH_MOTOR_RUNS,
+  HEALTH_MOTOR_TIMEOUTS,
+  HEALTH_MOTOR_STALLS,     // Strom über dem doppelten Nennstrom
+  HEALTH_MOTOR_CHARGE_MAS, // Ladung aller Motorläufe in mAs
+  HEALTH_MOTOR_PEAK_MAS,   // größte Ladung eines Laufs
+  HEALTH_MOTOR_PEAK_MA,    // höchster gemessener Motorstrom
+  HEALTH_COUNTER_COUNT
+} health_counter_t;
+
+/**
+ * @brief Zähler aus dem Log-Store lesen und den Start zählen
+ *
+ * Nach logstore_init() aufrufen. Ohne Log-Store wird nur im RAM gezählt.
+ *
+ * @return 0 bei Erfolg, sonst negativer Fehler
+ */
+int health_init(void);
+
+/* Zähler um eins erhöhen, aus jedem Thread */
+void health_inc(health_counter_t counter);
+
+/* Öffnung eines Fachs zählen */
+void health_opening(uint8_t fach);
+
+/* Abgeschlossenen Motorlauf mit Ladung und Spitzenstrom zählen */
+void health_motor_run(uint32_t charge_mas, uint16_t peak_ma);
+
+/* Vor dem Abschalten der Peripherie: offene Zähler zum Schreiben markieren,
+   vor writeback_flush() aufrufen */
+void health_sleep_enter(void);
+
+/* Nach dem Aufwachen: Schlafzeit addieren */
+void health_sleep_exit(void);
+
+void health_print(void);
+
+#endif // HEALTH_H
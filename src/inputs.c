@@ -4,46 +4,46 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include "inputs.h"
+#include "compartment.h"
 #include "powermanager.h"
 #include "states.h"
+#include "trace.h"
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
 #include <stdbool.h>
 
-#define HALL_ZU_NODE DT_ALIAS(hallzu)
-#if !DT_NODE_HAS_STATUS_OKAY(HALL_ZU_NODE)
-#error "Unsupported board: hallzu devicetree alias is not defined"
-#endif
-static const struct gpio_dt_spec hall_zu =
-    GPIO_DT_SPEC_GET_OR(HALL_ZU_NODE, gpios, {0});
-
-#define HALL_P_AUF_NODE DT_ALIAS(hallpauf)
-#if !DT_NODE_HAS_STATUS_OKAY(HALL_P_AUF_NODE)
-#error "Unsupported board: hallpauf devicetree alias is not defined"
-#endif
-static const struct gpio_dt_spec hall_p_auf =
-    GPIO_DT_SPEC_GET_OR(HALL_P_AUF_NODE, gpios, {0});
-
-#define HALL_B_AUF_NODE DT_ALIAS(hallbauf)
-#if !DT_NODE_HAS_STATUS_OKAY(HALL_B_AUF_NODE)
-#error "Unsupported board: hallbauf devicetree alias is not defined"
-#endif
-static const struct gpio_dt_spec hall_b_auf =
-    GPIO_DT_SPEC_GET_OR(HALL_B_AUF_NODE, gpios, {0});
-
-#define PAKET_AUF_NODE DT_ALIAS(paketauf)
-#if !DT_NODE_HAS_STATUS_OKAY(PAKET_AUF_NODE)
-#error "Unsupported board: paketauf devicetree alias is not defined"
-#endif
-static const struct gpio_dt_spec paket_auf =
-    GPIO_DT_SPEC_GET_OR(PAKET_AUF_NODE, gpios, {0});
-
-#define BRIEF_AUF_NODE DT_ALIAS(briefauf)
-#if !DT_NODE_HAS_STATUS_OKAY(BRIEF_AUF_NODE)
-#error "Unsupported board: briefauf devicetree alias is not defined"
-#endif
-static const struct gpio_dt_spec brief_auf =
-    GPIO_DT_SPEC_GET_OR(BRIEF_AUF_NODE, gpios, {0});
+LOG_MODULE_REGISTER(inputs, CONFIG_PAKETKASTEN_LOG_LEVEL);
+
+#define DT_DRV_COMPAT dhl_paketkasten_compartment
+
+typedef enum {
+  INPUT_HALL_ZU,
+  INPUT_HALL_P_AUF,
+  INPUT_HALL_B_AUF,
+  INPUT_PAKET_AUF, // Taster, optional
+  INPUT_BRIEF_AUF, // Taster, optional
+  INPUT_COUNT
+} input_t;
+
+static const char *const input_names[] = {
+    "hall_zu", "hall_p_auf", "hall_b_auf", "paket_auf", "brief_auf",
+};
+
+#define INPUT_SPECS(n)                                                         \
+  [n] = {                                                                      \
+      [INPUT_HALL_ZU] = GPIO_DT_SPEC_INST_GET(n, hall_zu_gpios),               \
+      [INPUT_HALL_P_AUF] = GPIO_DT_SPEC_INST_GET(n, hall_paket_gpios),         \
+      [INPUT_HALL_B_AUF] = GPIO_DT_SPEC_INST_GET(n, hall_brief_gpios),         \
+      [INPUT_PAKET_AUF] =                                                      \
+          GPIO_DT_SPEC_INST_GET_OR(n, paket_button_gpios, {0}),                \
+      [INPUT_BRIEF_AUF] =                                                      \
+          GPIO_DT_SPEC_INST_GET_OR(n, brief_button_gpios, {0}),                \
+  },
+
+static const struct gpio_dt_spec input_specs[COMPARTMENT_COUNT][INPUT_COUNT] = {
+    DT_INST_FOREACH_STATUS_OKAY(INPUT_SPECS)};
 
 #define JUMPER_NODE DT_ALIAS(jumper)
 #if !DT_NODE_HAS_STATUS_OKAY(JUMPER_NODE)
@@ -52,49 +52,46 @@ static const struct gpio_dt_spec brief_auf =
 static const struct gpio_dt_spec jumper_spec =
     GPIO_DT_SPEC_GET_OR(JUMPER_NODE, gpios, {0});
 
-static struct gpio_callback hall_zu_cb_data;
-static struct gpio_callback hall_p_auf_cb_data;
-static struct gpio_callback hall_b_auf_cb_data;
-static struct gpio_callback paket_auf_cb_data;
-static struct gpio_callback brief_auf_cb_data;
+/* Ein Callback pro Pin, darüber findet der Handler Fach und Eingang */
+struct input_pin {
+  struct gpio_callback cb;
+  uint8_t fach;
+  input_t input;
+};
+
+static struct input_pin input_pins[COMPARTMENT_COUNT][INPUT_COUNT];
 static struct gpio_callback jumper_cb_data;
 
-bool input_zu = true;
-bool input_p_auf = false;
-bool input_b_auf = false;
+static struct {
+  bool zu;
+  bool p_auf;
+  bool b_auf;
+} input_state[COMPARTMENT_COUNT];
+
 bool jumper_bit = false;
 
-void hall_change(const struct device *dev, struct gpio_callback *cb,
-                 uint32_t pins) {
-  if ((pins & BIT(hall_zu.pin)) != 0) {
-    input_zu = true;
-    input_p_auf = false;
-    input_b_auf = false;
-  }
+static void hall_change(const struct device *dev, struct gpio_callback *cb,
+                        uint32_t pins) {
+  struct input_pin *pin = CONTAINER_OF(cb, struct input_pin, cb);
 
-  if ((pins & BIT(hall_p_auf.pin)) != 0) {
-    input_zu = false;
-    input_p_auf = true;
-    input_b_auf = false;
-  }
+  /* Pins in Bit 0..15, Fach ab Bit 16 */
+  trace_event(TRACE_HALL_EDGE, pins | ((uint32_t)pin->fach << 16));
 
-  if ((pins & BIT(hall_b_auf.pin)) != 0) {
-    input_zu = false;
-    input_p_auf = false;
-    input_b_auf = true;
-  }
+  input_state[pin->fach].zu = pin->input == INPUT_HALL_ZU;
+  input_state[pin->fach].p_auf = pin->input == INPUT_HALL_P_AUF;
+  input_state[pin->fach].b_auf = pin->input == INPUT_HALL_B_AUF;
 }
 
-void taster_cb(const struct device *dev, struct gpio_callback *cb,
-               uint32_t pins) {
-  printk("Taster gedrückt\n");
-  powermanager_wakeup();
-  if ((pins & BIT(paket_auf.pin)) != 0) {
-    push_command(CMD_OEFFNE_PAKET);
-  }
+static void taster_cb(const struct device *dev, struct gpio_callback *cb,
+                      uint32_t pins) {
+  struct input_pin *pin = CONTAINER_OF(cb, struct input_pin, cb);
 
-  if ((pins & BIT(brief_auf.pin)) != 0) {
-    push_command(CMD_OEFFNE_BRIEF);
+  LOG_DBG("Taster gedrückt");
+  powermanager_wakeup();
+  if (pin->input == INPUT_PAKET_AUF) {
+    push_command(pin->fach, CMD_OEFFNE_PAKET);
+  } else {
+    push_command(pin->fach, CMD_OEFFNE_BRIEF);
   }
 }
 
@@ -103,141 +100,84 @@ void jumper_cb(const struct device *dev, struct gpio_callback *cb,
     jumper_bit = gpio_pin_get_dt(&jumper_spec);
 }
 
-int inputs_init(void) {
+/* Pin als Eingang mit Interrupt auf die aktive Flanke konfigurieren */
+static int input_setup(uint8_t fach, input_t input,
+                       gpio_callback_handler_t handler) {
+  const struct gpio_dt_spec *spec = &input_specs[fach][input];
+  struct input_pin *pin = &input_pins[fach][input];
   int ret;
 
-  /* Konfiguriere Hall Sensor für Paketkasten zu */
-  if (!gpio_is_ready_dt(&hall_zu)) {
-    printk("Error: hall_zu device %s is not ready\n", hall_zu.port->name);
+  if (!gpio_is_ready_dt(spec)) {
+    LOG_ERR("Fach %u %s device %s is not ready", fach, input_names[input],
+            spec->port->name);
     return -1;
   }
 
-  ret = gpio_pin_configure_dt(&hall_zu, GPIO_INPUT);
+  ret = gpio_pin_configure_dt(spec, GPIO_INPUT);
   if (ret != 0) {
-    printk("Error %d: failed to configure %s pin %d\n", ret, hall_zu.port->name,
-           hall_zu.pin);
+    LOG_ERR("Error %d: failed to configure %s pin %d", ret, spec->port->name,
+            spec->pin);
     return -1;
   }
 
-  ret = gpio_pin_interrupt_configure_dt(&hall_zu, GPIO_INT_EDGE_TO_ACTIVE);
+  ret = gpio_pin_interrupt_configure_dt(spec, GPIO_INT_EDGE_TO_ACTIVE);
   if (ret != 0) {
-    printk("Error %d: failed to configure interrupt on %s pin %d\n", ret,
-           hall_zu.port->name, hall_zu.pin);
-    return 0;
-  }
-
-  gpio_init_callback(&hall_zu_cb_data, hall_change, BIT(hall_zu.pin));
-  gpio_add_callback(hall_zu.port, &hall_zu_cb_data);
-
-  /* Konfiguriere Hall Sensor für Paketkasten auf */
-  if (!gpio_is_ready_dt(&hall_p_auf)) {
-    printk("Error: hall_p_auf device %s is not ready\n", hall_p_auf.port->name);
+    LOG_ERR("Error %d: failed to configure interrupt on %s pin %d", ret,
+            spec->port->name, spec->pin);
     return -1;
   }
 
-  ret = gpio_pin_configure_dt(&hall_p_auf, GPIO_INPUT);
-  if (ret != 0) {
-    printk("Error %d: failed to configure %s pin %d\n", ret,
-           hall_p_auf.port->name, hall_p_auf.pin);
-    return -1;
-  }
+  pin->fach = fach;
+  pin->input = input;
+  gpio_init_callback(&pin->cb, handler, BIT(spec->pin));
+  gpio_add_callback(spec->port, &pin->cb);
 
-  ret = gpio_pin_interrupt_configure_dt(&hall_p_auf, GPIO_INT_EDGE_TO_ACTIVE);
-  if (ret != 0) {
-    printk("Error %d: failed to configure interrupt on %s pin %d\n", ret,
-           hall_p_auf.port->name, hall_p_auf.pin);
-    return 0;
-  }
-
-  gpio_init_callback(&hall_p_auf_cb_data, hall_change, BIT(hall_p_auf.pin));
-  gpio_add_callback(hall_p_auf.port, &hall_p_auf_cb_data);
-
-  /* Konfiguriere Hall Sensor für Paketkasten und Briefkasten auf */
-  if (!gpio_is_ready_dt(&hall_b_auf)) {
-    printk("Error: hall_b_auf device %s is not ready\n", hall_b_auf.port->name);
-    return -1;
-  }
-
-  ret = gpio_pin_configure_dt(&hall_b_auf, GPIO_INPUT);
-  if (ret != 0) {
-    printk("Error %d: failed to configure %s pin %d\n", ret,
-           hall_b_auf.port->name, hall_b_auf.pin);
-    return -1;
-  }
-
-  ret = gpio_pin_interrupt_configure_dt(&hall_b_auf, GPIO_INT_EDGE_TO_ACTIVE);
-  if (ret != 0) {
-    printk("Error %d: failed to configure interrupt on %s pin %d\n", ret,
-           hall_b_auf.port->name, hall_b_auf.pin);
-    return 0;
-  }
-
-  gpio_init_callback(&hall_b_auf_cb_data, hall_change, BIT(hall_b_auf.pin));
-  gpio_add_callback(hall_b_auf.port, &hall_b_auf_cb_data);
-
-  /* Konfiguriere Taster für Paketkasten auf */
-  if (!gpio_is_ready_dt(&paket_auf)) {
-    printk("Error: paket_auf device %s is not ready\n", paket_auf.port->name);
-    return -1;
-  }
-
-  ret = gpio_pin_configure_dt(&paket_auf, GPIO_INPUT);
-  if (ret != 0) {
-    printk("Error %d: failed to configure %s pin %d\n", ret,
-           paket_auf.port->name, paket_auf.pin);
-    return -1;
-  }
-
-  ret = gpio_pin_interrupt_configure_dt(&paket_auf, GPIO_INT_EDGE_TO_ACTIVE);
-  if (ret != 0) {
-    printk("Error %d: failed to configure interrupt on %s pin %d\n", ret,
-           paket_auf.port->name, paket_auf.pin);
-    return 0;
-  }
-
-  gpio_init_callback(&paket_auf_cb_data, taster_cb, BIT(paket_auf.pin));
-  gpio_add_callback(paket_auf.port, &paket_auf_cb_data);
-
-  /* Konfiguriere Taster für Paketkasten und Briefkasten auf */
-  if (!gpio_is_ready_dt(&brief_auf)) {
-    printk("Error: brief_auf device %s is not ready\n", brief_auf.port->name);
-    return -1;
-  }
-
-  ret = gpio_pin_configure_dt(&brief_auf, GPIO_INPUT);
-  if (ret != 0) {
-    printk("Error %d: failed to configure %s pin %d\n", ret,
-           brief_auf.port->name, brief_auf.pin);
-    return -1;
-  }
-
-  ret = gpio_pin_interrupt_configure_dt(&brief_auf, GPIO_INT_EDGE_TO_ACTIVE);
-  if (ret != 0) {
-    printk("Error %d: failed to configure interrupt on %s pin %d\n", ret,
-           brief_auf.port->name, brief_auf.pin);
-    return 0;
-  }
+  return 0;
+}
 
-  gpio_init_callback(&brief_auf_cb_data, taster_cb, BIT(brief_auf.pin));
-  gpio_add_callback(brief_auf.port, &brief_auf_cb_data);
+int inputs_init(void) {
+  int ret;
 
-  /* Konfiguriere Taster für Paketkasten und Briefkasten auf */
+  for (uint8_t fach = 0; fach < COMPARTMENT_COUNT; fach++) {
+    input_state[fach].zu = true;
+
+    /* Hall Sensoren für zu, Paketkasten auf und Briefkasten auf */
+    for (input_t input = INPUT_HALL_ZU; input <= INPUT_HALL_B_AUF; input++) {
+      ret = input_setup(fach, input, hall_change);
+      if (ret < 0) {
+        return ret;
+      }
+    }
+
+    /* Taster, ein Fach ohne Taster wird nur per RFID oder Konsole geöffnet */
+    for (input_t input = INPUT_PAKET_AUF; input <= INPUT_BRIEF_AUF; input++) {
+      if (input_specs[fach][input].port == NULL) {
+        continue;
+      }
+      ret = input_setup(fach, input, taster_cb);
+      if (ret < 0) {
+        return ret;
+      }
+    }
+  }
+
+  /* Jumper für den Programmiermodus, gilt für alle Fächer */
   if (!gpio_is_ready_dt(&jumper_spec)) {
-    printk("Error: jumper device %s is not ready\n", jumper_spec.port->name);
+    LOG_ERR("jumper device %s is not ready", jumper_spec.port->name);
     return -1;
   }
 
   ret = gpio_pin_configure_dt(&jumper_spec, GPIO_INPUT);
   if (ret != 0) {
-    printk("Error %d: failed to configure %s pin %d\n", ret,
-           jumper_spec.port->name, jumper_spec.pin);
+    LOG_ERR("Error %d: failed to configure %s pin %d", ret,
+            jumper_spec.port->name, jumper_spec.pin);
     return -1;
   }
 
   ret = gpio_pin_interrupt_configure_dt(&jumper_spec, GPIO_INT_EDGE_BOTH);
   if (ret != 0) {
-    printk("Error %d: failed to configure interrupt on %s pin %d\n", ret,
-           jumper_spec.port->name, jumper_spec.pin);
+    LOG_ERR("Error %d: failed to configure interrupt on %s pin %d", ret,
+            jumper_spec.port->name, jumper_spec.pin);
     return 0;
   }
   jumper_bit = gpio_pin_get_dt(&jumper_spec);
@@ -248,10 +188,10 @@ int inputs_init(void) {
   return 0;
 }
 
-bool *get_kasten_zu(void) { return &input_zu; }
+bool *get_kasten_zu(uint8_t fach) { return &input_state[fach].zu; }
 
-bool *get_paket_auf(void) { return &input_p_auf; }
+bool *get_paket_auf(uint8_t fach) { return &input_state[fach].p_auf; }
 
-bool *get_brief_auf(void) { return &input_b_auf; }
+bool *get_brief_auf(uint8_t fach) { return &input_state[fach].b_auf; }
 
-bool get_jumper_bit(void) { return jumper_bit; }
\ No newline at end of file
+bool get_jumper_bit(void) { return jumper_bit; }
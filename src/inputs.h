@@ -7,10 +7,16 @@
 #ifndef INPUTS_H
 #define INPUTS_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 int inputs_init(void);
-bool *get_kasten_zu(void);
-bool *get_paket_auf(void);
-bool *get_brief_auf(void);
+
+/* Zeiger auf den Zustand der Hallsensoren eines Fachs, dienen dem Motor als
+   Stop-Kriterium */
+bool *get_kasten_zu(uint8_t fach);
+bool *get_paket_auf(uint8_t fach);
+bool *get_brief_auf(uint8_t fach);
 bool get_jumper_bit(void);
 
 #endif // INPUTS_H
@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include "led.h"
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/kernel.h>
 
@@ -11,10 +12,175 @@
 #define LEDGREEN_NODE DT_ALIAS(ledgreen)
 #define LEDRED_NODE DT_ALIAS(ledred)
 
+/* Periode der Soft-PWM für Helligkeitsstufen zwischen 0 und 100% */
+#define LED_SOFT_PWM_PERIOD_MS 10U
+
 static const struct gpio_dt_spec led_green =
     GPIO_DT_SPEC_GET(LEDGREEN_NODE, gpios);
 static const struct gpio_dt_spec led_red = GPIO_DT_SPEC_GET(LEDRED_NODE, gpios);
 
+static const struct led_step blink_steps[] = {
+    {100, 100},
+    {0, 100},
+};
+
+static const struct led_step double_blink_steps[] = {
+    {100, 100},
+    {0, 100},
+    {100, 100},
+    {0, 700},
+};
+
+static const struct led_step fade_steps[] = {
+    {0, 100},  {20, 100}, {40, 100}, {60, 100}, {80, 100},
+    {100, 100}, {80, 100}, {60, 100}, {40, 100}, {20, 100},
+};
+
+static const struct led_step error_code_steps[] = {
+    {100, 200},
+    {0, 300},
+};
+
+const struct led_pattern led_pattern_blink = {
+    .steps = blink_steps,
+    .step_count = ARRAY_SIZE(blink_steps),
+    .pulses = 1,
+    .loop = true,
+};
+
+const struct led_pattern led_pattern_double_blink = {
+    .steps = double_blink_steps,
+    .step_count = ARRAY_SIZE(double_blink_steps),
+    .pulses = 1,
+    .loop = true,
+};
+
+const struct led_pattern led_pattern_fade = {
+    .steps = fade_steps,
+    .step_count = ARRAY_SIZE(fade_steps),
+    .pulses = 1,
+    .loop = true,
+};
+
+static const struct led_pattern led_pattern_error_code = {
+    .steps = error_code_steps,
+    .step_count = ARRAY_SIZE(error_code_steps),
+    .pulses = 1,
+    .pause_ms = 1500,
+    .loop = true,
+};
+
+/* Laufzeitzustand eines Musters pro LED. Wird nur im Timer-ISR und bei
+ * gestopptem Timer verändert. */
+struct led_player {
+  const struct gpio_dt_spec *spec;
+  const struct led_pattern *pattern;
+  struct k_timer timer;
+  uint16_t remaining_ms; // Restzeit des Soft-PWM Schritts
+  uint8_t on_ms;         // Einschaltzeit pro Soft-PWM Periode
+  uint8_t step;
+  uint8_t pulse;
+  uint8_t pulses;
+  bool level;
+  bool pwm_on;
+};
+
+static struct led_player players[LED_COUNT] = {
+    [LED_GREEN] = {.spec = &led_green},
+    [LED_RED] = {.spec = &led_red},
+};
+
+static void led_player_set(struct led_player *p, bool on) {
+  p->level = on;
+  gpio_pin_set_dt(p->spec, on);
+}
+
+static void led_player_enter_step(struct led_player *p) {
+  const struct led_step *step = &p->pattern->steps[p->step];
+  uint16_t t;
+
+  if (step->level == 0 || step->level >= 100) {
+    led_player_set(p, step->level != 0);
+    p->remaining_ms = 0;
+    k_timer_start(&p->timer, K_MSEC(step->time_ms), K_NO_WAIT);
+    return;
+  }
+
+  /* Soft-PWM: Einschaltphase beginnt */
+  p->on_ms = MAX(1U, step->level * LED_SOFT_PWM_PERIOD_MS / 100U);
+  p->pwm_on = true;
+  led_player_set(p, true);
+  t = MIN(p->on_ms, step->time_ms);
+  p->remaining_ms = step->time_ms - t;
+  k_timer_start(&p->timer, K_MSEC(t), K_NO_WAIT);
+}
+
+static void led_player_advance(struct led_player *p) {
+  const struct led_pattern *pattern = p->pattern;
+
+  if (p->step == pattern->step_count) {
+    /* Pause ist abgelaufen, neuer Zyklus */
+    p->step = 0;
+  } else if (++p->step >= pattern->step_count) {
+    p->step = 0;
+    if (++p->pulse >= p->pulses) {
+      p->pulse = 0;
+      if (!pattern->loop) {
+        led_player_set(p, false);
+        p->pattern = NULL;
+        return;
+      }
+      if (pattern->pause_ms) {
+        /* step == step_count markiert die Pause */
+        p->step = pattern->step_count;
+        led_player_set(p, false);
+        k_timer_start(&p->timer, K_MSEC(pattern->pause_ms), K_NO_WAIT);
+        return;
+      }
+    }
+  }
+
+  led_player_enter_step(p);
+}
+
+static void led_timer_cb(struct k_timer *timer) {
+  struct led_player *p = CONTAINER_OF(timer, struct led_player, timer);
+  uint16_t t;
+
+  if (p->pattern == NULL) {
+    return;
+  }
+
+  if (p->remaining_ms > 0) {
+    /* Soft-PWM umschalten */
+    p->pwm_on = !p->pwm_on;
+    led_player_set(p, p->pwm_on);
+    t = p->pwm_on ? p->on_ms : LED_SOFT_PWM_PERIOD_MS - p->on_ms;
+    t = MIN(t, p->remaining_ms);
+    p->remaining_ms -= t;
+    k_timer_start(&p->timer, K_MSEC(t), K_NO_WAIT);
+    return;
+  }
+
+  led_player_advance(p);
+}
+
+static void led_player_start(led_t led, const struct led_pattern *pattern,
+                             uint8_t pulses) {
+  struct led_player *p = &players[led];
+
+  if (p->pattern == pattern && p->pulses == pulses) {
+    return;
+  }
+
+  k_timer_stop(&p->timer);
+  p->pattern = pattern;
+  p->pulses = pulses;
+  p->pulse = 0;
+  p->step = 0;
+  led_player_enter_step(p);
+}
+
 int led_init(void) {
   int ret;
 
@@ -32,11 +198,16 @@ int led_init(void) {
     return -1;
   }
 
+  for (int i = 0; i < LED_COUNT; i++) {
+    k_timer_init(&players[i].timer, led_timer_cb, NULL);
+  }
+
   /* Schalte grüne LED ein*/
   ret = gpio_pin_set_dt(&led_green, 1);
   if (ret < 0) {
     return -1;
   }
+  players[LED_GREEN].level = true;
 
   /* Schalte rote LED aus*/
   ret = gpio_pin_set_dt(&led_red, 0);
@@ -46,31 +217,45 @@ int led_init(void) {
   return 0;
 }
 
+void led_pattern_play(led_t led, const struct led_pattern *pattern) {
+  led_player_start(led, pattern, pattern->pulses);
+}
+
+bool led_pattern_running(led_t led) { return players[led].pattern != NULL; }
+
+void led_error_code(led_t led, uint8_t code) {
+  led_player_start(led, &led_pattern_error_code, MAX(code, 1U));
+}
+
+void led_pattern_stop(led_t led, bool on) {
+  struct led_player *p = &players[led];
+
+  k_timer_stop(&p->timer);
+  p->pattern = NULL;
+  led_player_set(p, on);
+}
+
 void led_green_on(void) {
   /* Schalte grüne LED ein*/
-  gpio_pin_set_dt(&led_green, 1);
+  led_pattern_stop(LED_GREEN, true);
 }
 
 void led_green_off(void) {
-  /* Schalte grüne LED ein*/
-  gpio_pin_set_dt(&led_green, 0);
-
+  /* Schalte grüne LED aus*/
+  led_pattern_stop(LED_GREEN, false);
 }
 
 void led_green_toggle(void) {
-  if(gpio_pin_get_dt(&led_green)) {
-     gpio_pin_set_dt(&led_green, 0);
-  } else {
-     gpio_pin_set_dt(&led_green, 1);
-  }
+  /* Zustand aus dem Speicher statt vom Pin lesen */
+  led_pattern_stop(LED_GREEN, !players[LED_GREEN].level);
 }
 
 void led_red_on(void) {
-  /* Schalte grüne LED ein*/
-  gpio_pin_set_dt(&led_red, 1);
+  /* Schalte rote LED ein*/
+  led_pattern_stop(LED_RED, true);
 }
 
 void led_red_off(void) {
-  /* Schalte grüne LED ein*/
-  gpio_pin_set_dt(&led_red, 0);
-}
\ No newline at end of file
+  /* Schalte rote LED aus*/
+  led_pattern_stop(LED_RED, false);
+}
@@ -7,6 +7,42 @@
 #ifndef LED_H
 #define LED_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum { LED_GREEN, LED_RED, LED_COUNT } led_t;
+
+/**
+ * @brief Ein Schritt eines LED-Musters
+ *
+ * level 0 schaltet die LED aus, 100 schaltet sie ein. Werte dazwischen werden
+ * per Soft-PWM aus dem Timer erzeugt (z.B. für Fade).
+ */
+struct led_step {
+  uint8_t level;    // Helligkeit in Prozent
+  uint16_t time_ms; // Dauer des Schritts
+};
+
+/**
+ * @brief Deklaratives LED-Muster
+ *
+ * Ein Zyklus spielt die Schritte pulses-mal ab und hält danach die LED für
+ * pause_ms aus. Bei loop wird der Zyklus endlos wiederholt, sonst bleibt die
+ * LED am Ende aus.
+ */
+struct led_pattern {
+  const struct led_step *steps;
+  uint8_t step_count;
+  uint8_t pulses;
+  uint16_t pause_ms;
+  bool loop;
+};
+
+/* Vordefinierte Muster */
+extern const struct led_pattern led_pattern_blink;
+extern const struct led_pattern led_pattern_double_blink;
+extern const struct led_pattern led_pattern_fade;
+
 /**
  * @brief Initialisiere die LEDs
  *
@@ -53,4 +89,39 @@ void led_red_on(void);
  */
 void led_red_off(void);
 
+/**
+ * @brief Spiele ein LED-Muster ab
+ *
+ * Das Muster läuft komplett im Kernel-Timer ab und benötigt weder den
+ * Hauptthread noch dessen 100ms Takt. Läuft das Muster bereits auf der LED,
+ * passiert nichts, sodass die Funktion zyklisch aufgerufen werden darf.
+ * led_*_on()/led_*_off() beenden ein laufendes Muster.
+ *
+ * @param led     Die LED auf der das Muster läuft
+ * @param pattern Das Muster
+ */
+void led_pattern_play(led_t led, const struct led_pattern *pattern);
+
+/* true, solange auf der LED ein Muster oder Fehlercode läuft */
+bool led_pattern_running(led_t led);
+
+/**
+ * @brief Zeige einen Fehlercode an
+ *
+ * Die LED blinkt code-mal und macht danach eine lange Pause. Das wiederholt
+ * sich bis die LED wieder gesetzt wird.
+ *
+ * @param led  Die LED auf der der Code angezeigt wird
+ * @param code Anzahl der Blinkimpulse (1..255)
+ */
+void led_error_code(led_t led, uint8_t code);
+
+/**
+ * @brief Beende ein laufendes Muster
+ *
+ * @param led Die LED
+ * @param on  Zustand der LED nach dem Beenden
+ */
+void led_pattern_stop(led_t led, bool on);
+
 #endif // LED_H
\ No newline at end of file
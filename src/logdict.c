@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "telemetry.h"
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log_backend.h>
+#include <zephyr/logging/log_output_dict.h>
+
+/* Log-Backend für die Dictionary-Kodierung: statt des Formatstrings wird nur
+ * seine Adresse mit den Argumenten gesendet, der Host setzt die Meldung mit
+ * der Datenbank aus dem Build (build/zephyr/log_dictionary.json) zusammen.
+ * Die Meldungen gehen als Rahmen über den Telemetriekanal TELEMETRY_LOG, so
+ * stören sie weder die Textausgaben der Konsole noch die anderen Kanäle.
+ *
+ * Das Backend läuft im Log-Thread mit der niedrigsten Priorität. Ist der
+ * Sendepuffer voll, wartet es dort und hält niemanden sonst auf. Längere
+ * Meldungen werden auf mehrere Rahmen verteilt. */
+#define LOGDICT_WAIT_MS 50
+
+static uint8_t logdict_buf[TELEMETRY_DATA_MAX];
+/* Nach einem Panic wird im Kontext des Aufrufers synchron ausgegeben, auch
+   im ISR (telemetry_panic) */
+static bool logdict_panic_mode;
+
+static int logdict_out(uint8_t *data, size_t length, void *ctx) {
+  telemetry_send_wait(TELEMETRY_LOG, data, length,
+                      logdict_panic_mode ? 0 : LOGDICT_WAIT_MS);
+  return length;
+}
+
+LOG_OUTPUT_DEFINE(logdict_output, logdict_out, logdict_buf,
+                  sizeof(logdict_buf));
+
+static void logdict_process(const struct log_backend *const backend,
+                             union log_msg_generic *msg) {
+  log_dict_output_msg_process(&logdict_output, &msg->log, 0);
+}
+
+static void logdict_dropped(const struct log_backend *const backend,
+                             uint32_t cnt) {
+  log_dict_output_dropped_process(&logdict_output, cnt);
+}
+
+static void logdict_panic(const struct log_backend *const backend) {
+  logdict_panic_mode = true;
+  telemetry_panic();
+  log_output_flush(&logdict_output);
+}
+
+static const struct log_backend_api logdict_api = {
+    .process = logdict_process,
+    .dropped = logdict_dropped,
+    .panic = logdict_panic,
+};
+
+LOG_BACKEND_DEFINE(logdict_backend, logdict_api, true);
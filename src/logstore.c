@@ -0,0 +1,333 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "logstore.h"
+#include "storage_io.h"
+#include "writeback.h"
+#include <zephyr/drivers/eeprom.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/crc.h>
+
+/* eeprom0 ist vollständig mit der UID-Tabelle belegt, deshalb liegt der
+ * Log-Store auf eeprom1:
+ *   Seite 0         Kopie B der Konfiguration (config.c)
+ *   Seiten 1..255   Log-Store
+ *   Seiten 256..511 frei
+ * Jeder Datensatz belegt genau eine Seite. Geschrieben wird immer an der
+ * nächsten Seite nach dem neuesten Datensatz, sodass sich die Schreibzugriffe
+ * gleichmäßig über alle Seiten verteilen. */
+#define LOG_NODE DT_NODELABEL(eeprom1)
+#define LOG_PAGE_SIZE DT_PROP(LOG_NODE, pagesize)
+#define LOG_FIRST_PAGE 1
+#define LOG_PAGES 255
+#define LOG_PAGE_OFFSET(p) ((LOG_FIRST_PAGE + (p)) * LOG_PAGE_SIZE)
+#define LOG_MAGIC 0xa5
+#define LOG_NONE 0xff
+
+/* So viele Seiten vor dem Kopf hält die Kompaktierung frei */
+#define LOG_COMPACT_AHEAD 8
+
+BUILD_ASSERT(LOG_PAGES <= LOG_NONE, "page index must fit into uint8_t");
+BUILD_ASSERT(LOG_PAGES > LOGSTORE_KEY_COUNT + LOG_COMPACT_AHEAD,
+             "log store too small for all keys");
+
+struct log_header {
+  uint8_t magic;
+  uint8_t key;
+  uint8_t len;
+  uint8_t reserved;
+  uint32_t seq;
+} __packed;
+
+struct log_record {
+  struct log_header hdr;
+  uint8_t data[LOGSTORE_DATA_MAX];
+  uint32_t crc; // CRC32 über Kopf und Daten
+} __packed;
+
+BUILD_ASSERT(sizeof(struct log_record) == LOG_PAGE_SIZE,
+             "struct log_record must fill one EEPROM page");
+
+static const struct device *log_dev = DEVICE_DT_GET(LOG_NODE);
+
+/* Seite des neuesten Datensatzes pro Schlüssel */
+static uint8_t log_index[LOGSTORE_KEY_COUNT];
+static uint8_t log_head;
+static uint32_t log_seq;
+static bool log_ready;
+
+static struct {
+  uint32_t appends;
+  uint32_t relocations;
+  uint32_t crc_errors;
+  uint32_t mount_ms;
+} log_stats;
+
+K_MUTEX_DEFINE(log_lock);
+
+static struct k_work log_compact_work;
+
+static uint32_t log_crc(const struct log_record *rec) {
+  return crc32_ieee((const uint8_t *)rec, offsetof(struct log_record, crc));
+}
+
+static int log_read_header(uint8_t page, struct log_header *hdr) {
+  return storage_io_read(log_dev, LOG_PAGE_OFFSET(page), hdr, sizeof(*hdr));
+}
+
+static int log_read_record(uint8_t page, struct log_record *rec) {
+  int ret;
+
+  ret = storage_io_read(log_dev, LOG_PAGE_OFFSET(page), rec, sizeof(*rec));
+  if (ret < 0) {
+    return ret;
+  }
+  if (rec->hdr.magic != LOG_MAGIC || rec->crc != log_crc(rec)) {
+    log_stats.crc_errors++;
+    return -EBADMSG;
+  }
+  return 0;
+}
+
+static bool log_header_valid(const struct log_header *hdr) {
+  return hdr->magic == LOG_MAGIC && hdr->key < LOGSTORE_KEY_COUNT &&
+         hdr->len <= LOGSTORE_DATA_MAX;
+}
+
+static bool log_page_live(uint8_t page) {
+  for (int k = 0; k < LOGSTORE_KEY_COUNT; k++) {
+    if (log_index[k] == page) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Schreibt den Datensatz an den Kopf und rückt ihn weiter */
+static int log_append(struct log_record *rec) {
+  uint8_t page = log_head;
+  int ret;
+
+  rec->hdr.magic = LOG_MAGIC;
+  rec->hdr.reserved = 0;
+  rec->hdr.seq = log_seq;
+  rec->crc = log_crc(rec);
+
+  ret = storage_io_write(log_dev, LOG_PAGE_OFFSET(page), rec, sizeof(*rec));
+  if (ret < 0) {
+    return ret;
+  }
+
+  log_index[rec->hdr.key] = page;
+  log_seq++;
+  log_head = (page + 1) % LOG_PAGES;
+  return 0;
+}
+
+/* Verschiebt einen gültigen Datensatz vom Kopf weg an die nächste freie
+   Stelle, bevor seine Seite überschrieben wird */
+static int log_relocate_head(void) {
+  struct log_record rec;
+  uint8_t page = log_head;
+  int ret;
+
+  ret = log_read_record(page, &rec);
+  if (ret < 0) {
+    /* Kaputter Datensatz, der Schlüssel ist verloren */
+    for (int k = 0; k < LOGSTORE_KEY_COUNT; k++) {
+      if (log_index[k] == page) {
+        log_index[k] = LOG_NONE;
+      }
+    }
+    log_head = (page + 1) % LOG_PAGES;
+    return ret;
+  }
+
+  log_head = (page + 1) % LOG_PAGES;
+  while (log_page_live(log_head)) {
+    /* Folgt direkt ein weiterer gültiger Datensatz, rückt er nach */
+    log_head = (log_head + 1) % LOG_PAGES;
+  }
+  log_stats.relocations++;
+  return log_append(&rec);
+}
+
+static bool log_needs_compaction(void) {
+  for (int i = 0; i < LOG_COMPACT_AHEAD; i++) {
+    if (log_page_live((log_head + i) % LOG_PAGES)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void log_compact(struct k_work *work) {
+  k_mutex_lock(&log_lock, K_FOREVER);
+  for (int i = 0; i < LOG_COMPACT_AHEAD; i++) {
+    if (log_page_live(log_head)) {
+      log_relocate_head();
+    } else {
+      break;
+    }
+  }
+  k_mutex_unlock(&log_lock);
+}
+
+/* Sucht den neuesten Datensatz eines Schlüssels älter als seq_below */
+static uint8_t log_find(uint8_t key, uint32_t seq_below) {
+  struct log_header hdr;
+  struct log_record rec;
+  uint32_t best_seq = 0;
+  uint8_t best = LOG_NONE;
+
+  for (uint8_t p = 0; p < LOG_PAGES; p++) {
+    if (log_read_header(p, &hdr) < 0 || !log_header_valid(&hdr)) {
+      continue;
+    }
+    if (hdr.key == key && hdr.seq < seq_below &&
+        (best == LOG_NONE || hdr.seq > best_seq) &&
+        log_read_record(p, &rec) == 0) {
+      best = p;
+      best_seq = hdr.seq;
+    }
+  }
+  return best;
+}
+
+int logstore_init(void) {
+  struct log_header hdr;
+  struct log_record rec;
+  uint32_t key_seq[LOGSTORE_KEY_COUNT];
+  int64_t start = k_uptime_get();
+  bool empty = true;
+  uint32_t max_seq = 0;
+  uint8_t max_page = 0;
+  int ret;
+
+  if (!device_is_ready(log_dev)) {
+    return -ENODEV;
+  }
+
+  k_work_init(&log_compact_work, log_compact);
+
+  k_mutex_lock(&log_lock, K_FOREVER);
+  memset(log_index, LOG_NONE, sizeof(log_index));
+
+  /* Nur die Seitenköpfe lesen */
+  for (uint8_t p = 0; p < LOG_PAGES; p++) {
+    ret = log_read_header(p, &hdr);
+    if (ret < 0) {
+      k_mutex_unlock(&log_lock);
+      return ret;
+    }
+    if (!log_header_valid(&hdr)) {
+      continue;
+    }
+    if (empty || hdr.seq > max_seq) {
+      max_seq = hdr.seq;
+      max_page = p;
+      empty = false;
+    }
+    if (log_index[hdr.key] == LOG_NONE || hdr.seq > key_seq[hdr.key]) {
+      log_index[hdr.key] = p;
+      key_seq[hdr.key] = hdr.seq;
+    }
+  }
+
+  /* Nur der neueste Datensatz pro Schlüssel wird vollständig geprüft. Ein
+     abgebrochener Schreibvorgang fällt auf die vorherige Version zurück. */
+  for (int k = 0; k < LOGSTORE_KEY_COUNT; k++) {
+    if (log_index[k] != LOG_NONE &&
+        log_read_record(log_index[k], &rec) < 0) {
+      log_index[k] = log_find(k, key_seq[k]);
+    }
+  }
+
+  log_seq = empty ? 0 : max_seq + 1;
+  log_head = empty ? 0 : (max_page + 1) % LOG_PAGES;
+  log_ready = true;
+  k_mutex_unlock(&log_lock);
+
+  log_stats.mount_ms = k_uptime_get() - start;
+  if (log_needs_compaction()) {
+    writeback_submit(&log_compact_work);
+  }
+  return 0;
+}
+
+int logstore_write(uint8_t key, const void *data, size_t len) {
+  struct log_record rec;
+  int ret;
+
+  if (key >= LOGSTORE_KEY_COUNT || len > LOGSTORE_DATA_MAX) {
+    return -EINVAL;
+  }
+  if (!log_ready) {
+    return -ENODEV;
+  }
+
+  memset(&rec, 0, sizeof(rec));
+  rec.hdr.key = key;
+  rec.hdr.len = len;
+  memcpy(rec.data, data, len);
+
+  k_mutex_lock(&log_lock, K_FOREVER);
+  /* Normalerweise hat die Kompaktierung den Kopf schon freigeräumt. Die
+     alte Version desselben Schlüssels bleibt bis nach dem Schreiben stehen. */
+  while (log_page_live(log_head)) {
+    if (log_index[key] == log_head) {
+      log_head = (log_head + 1) % LOG_PAGES;
+    } else {
+      log_relocate_head();
+    }
+  }
+  ret = log_append(&rec);
+  if (ret == 0) {
+    log_stats.appends++;
+  }
+  k_mutex_unlock(&log_lock);
+
+  if (log_needs_compaction()) {
+    writeback_submit(&log_compact_work);
+  }
+  return ret;
+}
+
+int logstore_read(uint8_t key, void *data, size_t len) {
+  struct log_record rec;
+  int ret;
+
+  if (key >= LOGSTORE_KEY_COUNT) {
+    return -EINVAL;
+  }
+
+  k_mutex_lock(&log_lock, K_FOREVER);
+  if (!log_ready || log_index[key] == LOG_NONE) {
+    ret = -ENOENT;
+  } else {
+    ret = log_read_record(log_index[key], &rec);
+  }
+  k_mutex_unlock(&log_lock);
+
+  if (ret < 0) {
+    return ret;
+  }
+  memcpy(data, rec.data, MIN(len, rec.hdr.len));
+  return rec.hdr.len;
+}
+
+void logstore_print_stats(void) {
+  uint8_t live = 0;
+
+  for (int k = 0; k < LOGSTORE_KEY_COUNT; k++) {
+    if (log_index[k] != LOG_NONE) {
+      live++;
+    }
+  }
+  printk("Log store: head %u, seq %u, live %u, appends %u, relocations %u, "
+         "crc errors %u, mount %u ms\n",
+         log_head, log_seq, live, log_stats.appends, log_stats.relocations,
+         log_stats.crc_errors, log_stats.mount_ms);
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LOGSTORE_H
+#define LOGSTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Maximale Nutzdaten eines Datensatzes (eine EEPROM-Seite) */
+#define LOGSTORE_DATA_MAX 52
+
+/* Schlüssel der Datensätze, pro Schlüssel gilt der neueste */
+enum logstore_key {
+  LOGSTORE_KEY_HEALTH = 0,          // Betriebszähler (health.c)
+  LOGSTORE_KEY_HEALTH_OPENINGS = 1, // Öffnungen pro Fach (health.c)
+  LOGSTORE_KEY_COUNT = 16,
+};
+
+/**
+ * @brief Log-Store auf eeprom1 einhängen
+ *
+ * Liest nur die Seitenköpfe und prüft die CRC des neuesten Datensatzes
+ * jedes Schlüssels.
+ *
+ * @return 0 bei Erfolg, sonst negativer Fehler
+ */
+int logstore_init(void);
+
+/**
+ * @brief Neue Version eines Datensatzes anhängen
+ *
+ * Schreibt genau eine Seite. Die Seiten werden reihum beschrieben.
+ *
+ * @return 0 bei Erfolg, sonst negativer Fehler
+ */
+int logstore_write(uint8_t key, const void *data, size_t len);
+
+/**
+ * @brief Neuesten Datensatz eines Schlüssels lesen
+ *
+ * @return Länge des gespeicherten Datensatzes, -ENOENT wenn keiner existiert
+ */
+int logstore_read(uint8_t key, void *data, size_t len);
+
+void logstore_print_stats(void);
+
+#endif // LOGSTORE_H
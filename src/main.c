@@ -5,50 +5,40 @@
  */
 
 #include <stdbool.h>
-#include <zephyr/drivers/uart.h>
 #include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "audit.h"
+#include "bus.h"
+#include "config.h"
+#include "console.h"
 #include "eeprom.h"
+#include "health.h"
 #include "inputs.h"
 #include "led.h"
+#include "logstore.h"
 #include "motor.h"
 #include "powermanager.h"
 #include "rfid.h"
 #include "states.h"
+#include "writeback.h"
 #include <zephyr/debug/thread_analyzer.h>
 
+LOG_MODULE_REGISTER(main, CONFIG_PAKETKASTEN_LOG_LEVEL);
+
 
 /* Mainloob will sleep for 100ms */
 #define SLEEP_TIME_MS 100
 
-static const struct device *uart_dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_console));
-
-static void uart_cb(const struct device *dev, void *user_data) {
-  uint8_t c;
-  powermanager_wakeup();
-  /* Read all available data from the UART FIFO */
-  while (uart_fifo_read(dev, &c, 1)) {
-    switch (c) {
-    case 'o':
-      push_command(CMD_OEFFNE_BRIEF);
-      break;
-
-    case 'p':
-      push_command(CMD_OEFFNE_PAKET);
-      break;
-    }
-  }
-}
-
 int main(void) {
   int ret;
 
-  if (!device_is_ready(uart_dev)) {
-    printk("UART device not ready\n");
-    return 0;
-  }
+  writeback_init();
 
-  uart_irq_callback_user_data_set(uart_dev, uart_cb, NULL);
-  uart_irq_rx_enable(uart_dev);
+  /* Konfiguration aus dem internen Flash, wird von motor_init gebraucht */
+  ret = config_init();
+  if (ret < 0) {
+    LOG_WRN("No valid config, using defaults");
+  }
 
   ret = led_init();
   if (ret < 0) {
@@ -70,16 +60,40 @@ int main(void) {
     return 0;
   }
 
+  /* Ohne Log-Store läuft der Briefkasten weiter, nur ohne Protokolle */
+  ret = logstore_init();
+  if (ret < 0) {
+    LOG_ERR("Log store init failed: %d", ret);
+  }
+
+  ret = audit_init();
+  if (ret < 0) {
+    LOG_ERR("Audit log init failed: %d", ret);
+  }
+
+  ret = health_init();
+  if (ret < 0) {
+    LOG_ERR("Health counters init failed: %d", ret);
+  }
+
   powermanager_init();
 
   rfid_init();
 
+  console_init();
+
+  ret = bus_init();
+  if (ret < 0) {
+    LOG_ERR("Bus init failed: %d", ret);
+  }
+
   while (1) {
     state_machine();
 
-    k_msleep(SLEEP_TIME_MS);
+    /* Laufende Ausgabe des Audit-Logs in Teilen */
+    audit_process();
 
-    //thread_analyzer_print(0);
+    k_msleep(SLEEP_TIME_MS);
   }
   return 0;
 }
@@ -5,60 +5,77 @@
  */
 
 #include "motor.h"
+#include "audit.h"
+#include "compartment.h"
+#include "config.h"
+#include "health.h"
+#include "stats.h"
+#include "telemetry.h"
+#include "trace.h"
 #include <zephyr/device.h>
 #include <zephyr/drivers/adc.h>
 #include <zephyr/drivers/pwm.h>
 #include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
 #include <zephyr/sys/printk.h>
 
-#define MOTORV_PWM_NODE DT_NODELABEL(motor_vor)
-#define MOTORZ_PWM_NODE DT_NODELABEL(motor_zur)
+LOG_MODULE_REGISTER(motor, CONFIG_PAKETKASTEN_LOG_LEVEL);
+
+#define DT_DRV_COMPAT dhl_paketkasten_compartment
 
 #define MOTOR_OFF 0
-#define MOTOR_PWM_PERIOD DT_PWMS_PERIOD(MOTORV_PWM_NODE)
-#define MOTOR_PWM_PULSE_START MOTOR_PWM_PERIOD / 2U
 
 #define MOTOR_ERR_PWM_NOT_READY -1
 #define MOTOR_ERR_PWM_SET -2
 #define MOTOR_ERR_ADC_NOT_READY -3
 #define MOTOR_ERR_ADC_SETUP -4
 #define MOTOR_ERR_ADC_START -5
+#define MOTOR_ERR_WORK_SUBMIT -6
 
-#define MOTOR_ADC_NODE DT_NODELABEL(adc1)
-#define MOTOR_ADC_RESOLUTION 12
-#define MOTOR_ADC_CHANNEL 1 // ADC_IN1 → PA1
-#define MOTOR_ADC_BUFFER_SIZE 20
+#define MOTOR_ADC_BUFFER_SIZE 20 // Abtastungen pro Kanal und Zyklus
 #define MOTOR_ADC_INTERVAL_US 500
 
-#define MOTOR_MAIN_STACK_SIZE 1024
-#define MOTOR_MAIN_PRIORITY 5
+/* Erwartete Periode von motor_main laut Messung (ADC Sequenz) */
+#define MOTOR_PERIOD_US 10400U
+
+/* Blockiert: Strom über dem doppelten Nennstrom für so viele Zyklen */
+#define MOTOR_STALL_CYCLES 5
 
-K_THREAD_STACK_DEFINE(motor_main_stack, MOTOR_MAIN_STACK_SIZE);
-static struct k_thread motor_main_data;
-k_tid_t motor_main_id;
+/* motor_main läuft als k_work_poll auf der System-Workqueue und wird vom
+   ADC-Signal ausgelöst. Ein eigener Thread mit Stack ist nicht nötig. */
+static struct k_work_poll motor_main_work;
 
-static const struct pwm_dt_spec motorv = PWM_DT_SPEC_GET(DT_ALIAS(motorv));
-static const struct pwm_dt_spec motorz = PWM_DT_SPEC_GET(DT_ALIAS(motorz));
+/* Hardware eines Fachs aus dem Devicetree */
+struct motor_config {
+  struct pwm_dt_spec vor;
+  struct pwm_dt_spec zur;
+  struct adc_dt_spec adc;   // Spannung am Shunt
+  uint16_t shunt_mohm;
+  uint16_t nennstrom_ma;    // für das Strombudget
+};
 
-static uint16_t motor_adc_buffer_a[MOTOR_ADC_BUFFER_SIZE];
-static uint16_t motor_adc_buffer_b[MOTOR_ADC_BUFFER_SIZE];
+#define MOTOR_CONFIG(n)                                                        \
+  [n] = {                                                                      \
+      .vor = PWM_DT_SPEC_INST_GET_BY_NAME(n, vor),                             \
+      .zur = PWM_DT_SPEC_INST_GET_BY_NAME(n, zur),                             \
+      .adc = ADC_DT_SPEC_INST_GET(n),                                          \
+      .shunt_mohm = DT_INST_PROP(n, shunt_milliohm),                           \
+      .nennstrom_ma = DT_INST_PROP(n, motor_current_ma),                       \
+  },
+
+static const struct motor_config motor_configs[COMPARTMENT_COUNT] = {
+    DT_INST_FOREACH_STATUS_OKAY(MOTOR_CONFIG)};
+
+/* Eine Sequenz tastet die Shunts aller Fächer ab, in einer Abtastung liegen
+   die Kanäle aufsteigend nach Kanalnummer hintereinander */
+static uint16_t motor_adc_buffer_a[MOTOR_ADC_BUFFER_SIZE * COMPARTMENT_COUNT];
+static uint16_t motor_adc_buffer_b[MOTOR_ADC_BUFFER_SIZE * COMPARTMENT_COUNT];
 static uint16_t *motor_adc_current_buffer = motor_adc_buffer_a;
+static uint8_t motor_adc_channel_count;
 
 static struct k_poll_signal motor_adc_done_signal;
 static struct k_poll_event motor_adc_event;
 
-#if !DT_NODE_EXISTS(DT_PATH(zephyr_user)) ||                                   \
-    !DT_NODE_HAS_PROP(DT_PATH(zephyr_user), io_channels)
-#error "No suitable devicetree overlay specified"
-#endif
-
-#define DT_SPEC_AND_COMMA(node_id, prop, idx)                                  \
-  ADC_DT_SPEC_GET_BY_IDX(node_id, idx),
-
-/* Data of ADC io-channels specified in devicetree. */
-static const struct adc_dt_spec motor_adc_channels[] = {
-    DT_FOREACH_PROP_ELEM(DT_PATH(zephyr_user), io_channels, DT_SPEC_AND_COMMA)};
-
 struct adc_sequence_options motor_seq_options = {
     .callback = NULL,
     .extra_samplings = MOTOR_ADC_BUFFER_SIZE - 1,
@@ -77,153 +94,408 @@ typedef struct {
   motor_richtung_t richtung_soll; // Angeforderte Drehrichtung
   uint16_t timeout_10ms; // Zeit bis zum Timeout pro 10ms (100raw * 10ms = 1s)
   bool *stop;            // Zeiger zum Stop Kriterium
-  uint16_t pulse;
+  uint32_t pulse;
+  bool wartet;           // Angefordert, wartet auf freies Strombudget
+  uint8_t adc_index;     // Position des Kanals in einer Abtastung
+  uint32_t anforderung;  // Reihenfolge der Anforderungen
+  uint32_t lauf_strom;   // Summe des Stroms im laufenden Lauf in mA je Zyklus
+  uint16_t lauf_peak_ma; // höchster Strom im laufenden Lauf
+  uint8_t stall_zyklen;  // Zyklen über dem doppelten Nennstrom
 } motor_t;
 
-motor_t motor;
+static motor_t motors[COMPARTMENT_COUNT];
+static uint32_t motor_anforderungen;
 
 typedef struct {
+  uint8_t fach;
   motor_richtung_t richtung_soll; // Angeforderte Drehrichtung
   uint16_t timeout_10ms; // Zeit bis zum Timeout pro 10ms (100raw * 10ms = 1s)
   bool *stop;            // Zeiger zum Stop Kriterium
 } motor_set_t;
 
-K_PIPE_DEFINE(motor_set_pipe, sizeof(motor_set_t), 4);
+K_PIPE_DEFINE(motor_set_pipe, sizeof(motor_set_t) * COMPARTMENT_COUNT, 4);
+
+/* Zeitverhalten der Regelschleife */
+static struct {
+  struct stats_hist period; // Abstand zweier Aufrufe in us
+  struct stats_hist exec;   // Laufzeit eines Aufrufs in us
+  uint32_t last_start;      // Zyklenzähler beim letzten Aufruf
+  uint32_t misses;          // Deadline verpasst, gesamt
+  uint16_t misses_in_row;   // Deadline verpasst, hintereinander
+  uint16_t safe_stops;      // Motor wegen verpasster Deadlines gestoppt
+  uint32_t budget_waits;    // Zyklen, in denen ein Motor auf Budget wartete
+  bool started;
+} motor_timing;
+
+/* Periode und Deadline des aktuellen Aufrufs auswerten.
+   Gibt true zurück, wenn der Motor in den sicheren Zustand muss. */
+static bool motor_timing_start(uint32_t now) {
+  uint32_t period_us;
+
+  if (!motor_timing.started) {
+    motor_timing.started = true;
+    motor_timing.last_start = now;
+    return false;
+  }
 
-/* 10ms Funktion zur Motorregelung */
-void motor_main(void *p1, void *p2, void *p3) {
-  int ret;
-  motor_set_t my_motor_set;
-  uint32_t motor_strom;
+  period_us = k_cyc_to_us_floor32(now - motor_timing.last_start);
+  motor_timing.last_start = now;
+  stats_hist_add(&motor_timing.period, period_us);
 
-  while (1) {
-    /* Auf ADC Werte warte => 10ms Takt erzeugen
-        - k_poll kommt ca. alle 10,4ms Zurück */
-    ret = k_poll(&motor_adc_event, 1, K_FOREVER);
-    if (ret < 0) {
-      printk("k_poll error: %d\n", ret);
-    }
+  if (period_us <= CONFIG_PAKETKASTEN_MOTOR_DEADLINE_US) {
+    motor_timing.misses_in_row = 0;
+    return false;
+  }
+
+  motor_timing.misses++;
+  if (motor_timing.misses_in_row < UINT16_MAX) {
+    motor_timing.misses_in_row++;
+  }
+
+  return CONFIG_PAKETKASTEN_MOTOR_MAX_MISSES > 0 &&
+         motor_timing.misses_in_row >= CONFIG_PAKETKASTEN_MOTOR_MAX_MISSES;
+}
 
-    k_poll_signal_reset(&motor_adc_done_signal);
+/* Mittelwert über die Abtastungen des Fachs in mA */
+static uint32_t motor_strom_ma(uint8_t fach, const uint16_t *samples) {
+  const struct motor_config *cfg = &motor_configs[fach];
+  int32_t mv = 0;
 
-    /* Buffer bearbeiten */
-    motor_strom = 0;
-    for (int i = 0; i < MOTOR_ADC_BUFFER_SIZE; i++) {
-      motor_strom += motor_adc_current_buffer[i];
+  for (int i = 0; i < MOTOR_ADC_BUFFER_SIZE; i++) {
+    mv += samples[i * motor_adc_channel_count + motors[fach].adc_index];
+  }
+  mv = mv / MOTOR_ADC_BUFFER_SIZE;
+
+  /* Umrechung in mV*/
+  adc_raw_to_millivolts_dt(&cfg->adc, &mv);
+
+  /* Umrechnung in mA: I = U/R */
+  return MAX(mv, 0) * 1000 / cfg->shunt_mohm;
+}
+
+static bool motor_aktiv(const motor_t *m) {
+  return m->richtung_soll != MOTOR_STOP && !m->wartet;
+}
+
+/* Wartende Motoren in der Reihenfolge ihrer Anforderung starten, solange die
+   Summe der Nennströme im Budget bleibt. Ein Motor darf den nächsten nicht
+   überholen. Läuft kein Motor, startet der nächste auch über dem Budget. */
+static void motor_schedule(void) {
+  uint32_t strom_ma = 0;
+  int next;
+
+  for (int i = 0; i < COMPARTMENT_COUNT; i++) {
+    if (motor_aktiv(&motors[i])) {
+      strom_ma += motor_configs[i].nennstrom_ma;
     }
-    /* Mittelwert bilden */
-    motor_strom = motor_strom / MOTOR_ADC_BUFFER_SIZE;
-
-    /* Umrechung in mV*/
-    adc_raw_to_millivolts_dt(&motor_adc_channels[0], &motor_strom);
-
-    /* Umrechnung in mA: 0,5 Ohm => I = U/R = U/0,5 = U*2 */
-    motor_strom = motor_strom * 2;
-
-    /* Buffer wechseln */
-    motor_adc_current_buffer = (motor_adc_current_buffer == motor_adc_buffer_a)
-                                   ? motor_adc_buffer_b
-                                   : motor_adc_buffer_a;
-
-    /* Nächste ADC-DMA Übertragung starten */
-    (void)adc_sequence_init_dt(&motor_adc_channels[0], &motor_sequence);
-    motor_sequence.buffer = motor_adc_current_buffer;
-    motor_sequence.buffer_size = sizeof(motor_adc_buffer_a);
-    ret = adc_read_async((&motor_adc_channels[0])->dev, &motor_sequence,
-                         &motor_adc_done_signal);
-    if (ret < 0) {
-      printk("ADC async read failed: %d\n", ret);
+  }
+
+  while (true) {
+    next = -1;
+    for (int i = 0; i < COMPARTMENT_COUNT; i++) {
+      if (motors[i].richtung_soll != MOTOR_STOP && motors[i].wartet &&
+          (next < 0 || (int32_t)(motors[i].anforderung -
+                                 motors[next].anforderung) < 0)) {
+        next = i;
+      }
     }
+    if (next < 0) {
+      return;
+    }
+    if (strom_ma > 0 && strom_ma + motor_configs[next].nennstrom_ma >
+                            CONFIG_PAKETKASTEN_MOTOR_CURRENT_BUDGET_MA) {
+      motor_timing.budget_waits++;
+      return;
+    }
+    motors[next].wartet = false;
+    strom_ma += motor_configs[next].nennstrom_ma;
+  }
+}
+
+/* Schalte PWM für den Motor. Erst den Zweig abschalten, dann den anderen
+   einschalten, damit nie beide gleichzeitig angesteuert sind. */
+static void motor_output(uint8_t fach) {
+  const struct motor_config *cfg = &motor_configs[fach];
+  const motor_t *m = &motors[fach];
+  uint32_t vor = MOTOR_OFF;
+  uint32_t zur = MOTOR_OFF;
+  int ret;
 
-    /* Checken ob neue Befehl vorliegt*/
-    if (k_pipe_read(&motor_set_pipe, (uint8_t *)&my_motor_set,
-                    sizeof(motor_set_t), K_NO_WAIT) == sizeof(motor_set_t)) {
-      motor.richtung_soll = my_motor_set.richtung_soll;
-      motor.timeout_10ms = my_motor_set.timeout_10ms;
-      motor.stop = my_motor_set.stop;
+  if (motor_aktiv(m)) {
+    if (m->richtung_soll == MOTOR_VOR) {
+      vor = m->pulse;
+    } else {
+      zur = m->pulse;
     }
+  }
+
+  if (vor == MOTOR_OFF) {
+    ret = pwm_set_dt(&cfg->vor, cfg->vor.period, vor);
+    ret = ret ? ret : pwm_set_dt(&cfg->zur, cfg->zur.period, zur);
+  } else {
+    ret = pwm_set_dt(&cfg->zur, cfg->zur.period, zur);
+    ret = ret ? ret : pwm_set_dt(&cfg->vor, cfg->vor.period, vor);
+  }
+  if (ret) {
+    LOG_ERR("Fach %u: failed to set pulse width", fach);
+  }
+}
+
+/* Neue Anforderung übernehmen. Ein laufender Motor behält sein Budget, auch
+   wenn sich die Richtung ändert. */
+static void motor_request(const motor_set_t *set) {
+  motor_t *m = &motors[set->fach];
+  bool aktiv = motor_aktiv(m);
+
+  m->richtung_soll = set->richtung_soll;
+  m->timeout_10ms = set->timeout_10ms;
+  m->stop = set->stop;
+  if (m->richtung_soll == MOTOR_STOP) {
+    m->wartet = false;
+  } else if (!aktiv) {
+    m->wartet = true;
+    m->anforderung = motor_anforderungen++;
+  }
+}
+
+/* Endschalter, Deadlines und Timeout eines Fachs prüfen */
+static void motor_check(uint8_t fach, bool late) {
+  motor_t *m = &motors[fach];
+
+  if (m->richtung_soll == MOTOR_STOP) {
+    return;
+  }
 
-    /* ToDo: Stromregelung*/
+  /* Check endstop, auch für wartende Motoren */
+  if (*m->stop) {
+    /* Endstop erreicht */
+    m->richtung_soll = MOTOR_STOP;
+    m->wartet = false;
+    return;
+  }
+
+  /* Zu viele verpasste Deadlines: Regelung nicht mehr deterministisch */
+  if (late) {
+    LOG_ERR("Motor Error: Fach %u, %u deadlines missed, stopping", fach,
+            motor_timing.misses_in_row);
+    audit_log(AUDIT_MOTOR_STOP, 0, m->richtung_soll);
+    m->richtung_soll = MOTOR_STOP;
+    m->wartet = false;
+    motor_timing.safe_stops++;
+    return;
+  }
 
-    /* Check endstop */
-    if (*motor.stop) {
-      /* Endstop erreicht */
-      motor.richtung_soll = MOTOR_STOP;
+  /* Rechne Timeout, nur solange der Motor läuft */
+  if (!m->wartet && m->timeout_10ms > 0) {
+    m->timeout_10ms--;
+    if (!m->timeout_10ms) {
+      LOG_ERR("Motor Error: Fach %u, timeout before endstop reached", fach);
+      audit_log(AUDIT_MOTOR_TIMEOUT, 0, m->richtung_soll);
+      health_inc(HEALTH_MOTOR_TIMEOUTS);
+      m->richtung_soll = MOTOR_STOP;
     }
+  }
+}
 
-    /* Rechne Timeout */
-    if (motor.richtung_soll != MOTOR_STOP && motor.timeout_10ms > 0) {
-      motor.timeout_10ms--;
-      if (!motor.timeout_10ms) {
-        printk("Motor Error: Timeout before endstop reached\n");
-        motor.richtung_soll = MOTOR_STOP;
+/* Ladung und Spitzenstrom eines Laufs sammeln und am Ende des Laufs an die
+   Betriebszähler geben. Ein Blockieren zählt einmal, bis der Strom wieder
+   unter den doppelten Nennstrom fällt. */
+static void motor_health(uint8_t fach, uint16_t strom_ma) {
+  motor_t *m = &motors[fach];
+  uint32_t ladung_mas;
+
+  if (motor_aktiv(m)) {
+    m->lauf_strom += strom_ma;
+    m->lauf_peak_ma = MAX(m->lauf_peak_ma, strom_ma);
+    if (strom_ma > 2U * motor_configs[fach].nennstrom_ma) {
+      if (m->stall_zyklen < MOTOR_STALL_CYCLES &&
+          ++m->stall_zyklen == MOTOR_STALL_CYCLES) {
+        health_inc(HEALTH_MOTOR_STALLS);
       }
+    } else {
+      m->stall_zyklen = 0;
     }
+    return;
+  }
 
-    /* Schalte PWM für den Motor */
-    switch (motor.richtung_soll) {
-    case MOTOR_VOR:
-      if (pwm_set_dt(&motorv, MOTOR_PWM_PERIOD, motor.pulse)) {
-        printk("Error: failed to set pulse width\n");
-      }
-      if (pwm_set_dt(&motorz, MOTOR_PWM_PERIOD, MOTOR_OFF)) {
-        printk("Error: failed to set pulse width\n");
-      }
-      break;
+  if (m->lauf_strom > 0) {
+    ladung_mas = (uint64_t)m->lauf_strom * MOTOR_PERIOD_US / 1000000U;
+    health_motor_run(ladung_mas, m->lauf_peak_ma);
+    m->lauf_strom = 0;
+    m->lauf_peak_ma = 0;
+    m->stall_zyklen = 0;
+  }
+}
 
-    case MOTOR_ZUR:
-      if (pwm_set_dt(&motorv, MOTOR_PWM_PERIOD, MOTOR_OFF)) {
-        printk("Error: failed to set pulse width\n");
-      }
-      if (pwm_set_dt(&motorz, MOTOR_PWM_PERIOD, motor.pulse)) {
-        printk("Error: failed to set pulse width\n");
-      }
-      break;
+/* 10ms Funktion zur Motorregelung
+   Wird nach jeder abgeschlossenen ADC-Übertragung aufgerufen => 10ms Takt
+   - kommt ca. alle 10,4ms */
+static void motor_main(struct k_work *work) {
+  int ret;
+  motor_set_t my_motor_set;
+  uint16_t motor_strom[COMPARTMENT_COUNT];
+  uint32_t strom_summe = 0;
+  uint32_t richtungen = 0;
+  uint32_t exec_us;
+  struct telemetry_motor telemetry;
+  uint32_t start = k_cycle_get_32();
+  bool late = motor_timing_start(start);
+
+  k_poll_signal_reset(&motor_adc_done_signal);
+  motor_adc_event.state = K_POLL_STATE_NOT_READY;
+
+  /* Buffer bearbeiten */
+  for (uint8_t fach = 0; fach < COMPARTMENT_COUNT; fach++) {
+    motor_strom[fach] =
+        MIN(motor_strom_ma(fach, motor_adc_current_buffer), UINT16_MAX);
+    strom_summe += motor_strom[fach];
+  }
+  trace_event(TRACE_ADC_DONE, strom_summe);
 
-    default:
-      /* Stop Motor */
-      if (pwm_set_dt(&motorv, MOTOR_PWM_PERIOD, MOTOR_OFF)) {
-        printk("Error: failed to set pulse width\n");
-      }
-      if (pwm_set_dt(&motorz, MOTOR_PWM_PERIOD, MOTOR_OFF)) {
-        printk("Error: failed to set pulse width\n");
-      }
+  /* Buffer wechseln */
+  motor_adc_current_buffer = (motor_adc_current_buffer == motor_adc_buffer_a)
+                                 ? motor_adc_buffer_b
+                                 : motor_adc_buffer_a;
+
+  /* Nächste ADC-DMA Übertragung starten */
+  motor_sequence.buffer = motor_adc_current_buffer;
+  ret = adc_read_async(motor_configs[0].adc.dev, &motor_sequence,
+                       &motor_adc_done_signal);
+  if (ret < 0) {
+    LOG_ERR("ADC async read failed: %d", ret);
+  }
+
+  /* Checken ob neue Befehle vorliegen */
+  while (k_pipe_read(&motor_set_pipe, (uint8_t *)&my_motor_set,
+                     sizeof(motor_set_t), K_NO_WAIT) == sizeof(motor_set_t)) {
+    motor_request(&my_motor_set);
+  }
+
+  /* ToDo: Stromregelung*/
+
+  for (uint8_t fach = 0; fach < COMPARTMENT_COUNT; fach++) {
+    motor_check(fach, late);
+  }
+  motor_schedule();
+
+  for (uint8_t fach = 0; fach < COMPARTMENT_COUNT; fach++) {
+    motor_output(fach);
+    motor_health(fach, motor_strom[fach]);
+    if (motor_aktiv(&motors[fach])) {
+      richtungen |= motors[fach].richtung_soll << (2 * fach);
     }
   }
+
+  trace_event(TRACE_MOTOR_CYCLE, richtungen);
+  exec_us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+  stats_hist_add(&motor_timing.exec, exec_us);
+
+  telemetry.exec_us = MIN(exec_us, UINT16_MAX);
+  for (uint8_t fach = 0; fach < COMPARTMENT_COUNT; fach++) {
+    telemetry.strom_ma = motor_strom[fach];
+    telemetry.richtung =
+        motor_aktiv(&motors[fach]) ? motors[fach].richtung_soll : MOTOR_STOP;
+    telemetry.fach = fach;
+    telemetry_send(TELEMETRY_MOTOR, &telemetry, sizeof(telemetry));
+  }
+
+  /* Auf die nächste ADC-Übertragung warten */
+  ret = k_work_poll_submit(&motor_main_work, &motor_adc_event, 1, K_FOREVER);
+  if (ret < 0) {
+    LOG_ERR("Motor work submit failed: %d", ret);
+  }
 }
 
-/* Initialization of necessary Inputs (ADC) and outputs (PWM) */
-int motor_init(void) {
+static int motor_init_pwm(uint8_t fach) {
+  const struct motor_config *cfg = &motor_configs[fach];
   int ret;
 
-  motor.richtung_soll = MOTOR_STOP;
-  motor.pulse = MOTOR_PWM_PULSE_START;
-
-  if (!pwm_is_ready_dt(&motorv)) {
-    printk("Error: PWM device %s is not ready\n", motorv.dev->name);
+  if (!pwm_is_ready_dt(&cfg->vor)) {
+    LOG_ERR("PWM device %s is not ready", cfg->vor.dev->name);
     return MOTOR_ERR_PWM_NOT_READY;
   }
 
-  if (!pwm_is_ready_dt(&motorz)) {
-    printk("Error: PWM device %s is not ready\n", motorz.dev->name);
+  if (!pwm_is_ready_dt(&cfg->zur)) {
+    LOG_ERR("PWM device %s is not ready", cfg->zur.dev->name);
     return MOTOR_ERR_PWM_NOT_READY;
   }
 
-  ret = pwm_set_dt(&motorv, MOTOR_PWM_PERIOD, MOTOR_OFF);
+  ret = pwm_set_dt(&cfg->vor, cfg->vor.period, MOTOR_OFF);
   if (ret) {
-    printk("Error %d: failed to set pulse width\n", ret);
+    LOG_ERR("Error %d: failed to set pulse width", ret);
     return MOTOR_ERR_PWM_SET;
   }
 
-  ret = pwm_set_dt(&motorz, MOTOR_PWM_PERIOD, MOTOR_OFF);
+  ret = pwm_set_dt(&cfg->zur, cfg->zur.period, MOTOR_OFF);
   if (ret) {
-    printk("Error %d: failed to set pulse width\n", ret);
+    LOG_ERR("Error %d: failed to set pulse width", ret);
     return MOTOR_ERR_PWM_SET;
   }
 
-  if (!adc_is_ready_dt(&motor_adc_channels[0])) {
-    printk("ADC device not ready!\n");
-    return MOTOR_ERR_ADC_NOT_READY;
+  motors[fach].richtung_soll = MOTOR_STOP;
+  motors[fach].pulse = cfg->vor.period * config_get()->motor_duty / 100U;
+  return 0;
+}
+
+/* Kanäle aller Fächer einrichten, doppelt genutzte Kanäle nur einmal */
+static int motor_init_adc(void) {
+  const struct device *adc_dev = motor_configs[0].adc.dev;
+  uint32_t channels = 0;
+  int ret;
+
+  for (uint8_t fach = 0; fach < COMPARTMENT_COUNT; fach++) {
+    const struct adc_dt_spec *adc = &motor_configs[fach].adc;
+
+    if (adc->dev != adc_dev) {
+      LOG_ERR("Fach %u: current shunt must be on %s", fach, adc_dev->name);
+      return MOTOR_ERR_ADC_SETUP;
+    }
+    if (!adc_is_ready_dt(adc)) {
+      LOG_ERR("ADC device not ready!");
+      return MOTOR_ERR_ADC_NOT_READY;
+    }
+    if (channels & BIT(adc->channel_id)) {
+      continue;
+    }
+    ret = adc_channel_setup_dt(adc);
+    if (ret != 0) {
+      LOG_ERR("ADC channel setup failed (%d)", ret);
+      return MOTOR_ERR_ADC_SETUP;
+    }
+    channels |= BIT(adc->channel_id);
+  }
+
+  for (uint8_t fach = 0; fach < COMPARTMENT_COUNT; fach++) {
+    motors[fach].adc_index =
+        POPCOUNT(channels & BIT_MASK(motor_configs[fach].adc.channel_id));
+  }
+  motor_adc_channel_count = POPCOUNT(channels);
+
+  (void)adc_sequence_init_dt(&motor_configs[0].adc, &motor_sequence);
+  motor_sequence.channels = channels;
+  motor_sequence.buffer = motor_adc_current_buffer;
+  motor_sequence.buffer_size =
+      MOTOR_ADC_BUFFER_SIZE * motor_adc_channel_count * sizeof(uint16_t);
+  return 0;
+}
+
+/* Initialization of necessary Inputs (ADC) and outputs (PWM) */
+int motor_init(void) {
+  int ret;
+
+  stats_hist_init(&motor_timing.period, MOTOR_PERIOD_US - 1000U, 500U);
+  stats_hist_init(&motor_timing.exec, 0, 100U);
+
+  for (uint8_t fach = 0; fach < COMPARTMENT_COUNT; fach++) {
+    ret = motor_init_pwm(fach);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+
+  ret = motor_init_adc();
+  if (ret < 0) {
+    return ret;
   }
 
   /* Init ADC async event handling */
@@ -231,33 +503,29 @@ int motor_init(void) {
   k_poll_event_init(&motor_adc_event, K_POLL_TYPE_SIGNAL,
                     K_POLL_MODE_NOTIFY_ONLY, &motor_adc_done_signal);
 
-  ret = adc_channel_setup_dt(&motor_adc_channels[0]);
-  if (ret != 0) {
-    printk("ADC channel setup failed (%d)\n", ret);
-    return MOTOR_ERR_ADC_SETUP;
-  }
-
   /* ADC Read starten */
-  (void)adc_sequence_init_dt(&motor_adc_channels[0], &motor_sequence);
-  motor_sequence.buffer = motor_adc_current_buffer;
-  ret = adc_read_async((&motor_adc_channels[0])->dev, &motor_sequence,
+  ret = adc_read_async(motor_configs[0].adc.dev, &motor_sequence,
                        &motor_adc_done_signal);
   if (ret != 0) {
-    printk("ADC Async Read failed (%d)\n", ret);
+    LOG_ERR("ADC Async Read failed (%d)", ret);
     return MOTOR_ERR_ADC_START;
   }
 
-  /* Starte motor_main */
-  motor_main_id =
-      k_thread_create(&motor_main_data, motor_main_stack,
-                      K_THREAD_STACK_SIZEOF(motor_main_stack), motor_main, NULL,
-                      NULL, NULL, MOTOR_MAIN_PRIORITY, 0, K_NO_WAIT);
+  /* Starte motor_main sobald die erste Übertragung fertig ist */
+  k_work_poll_init(&motor_main_work, motor_main);
+  ret = k_work_poll_submit(&motor_main_work, &motor_adc_event, 1, K_FOREVER);
+  if (ret != 0) {
+    LOG_ERR("Motor work submit failed (%d)", ret);
+    return MOTOR_ERR_WORK_SUBMIT;
+  }
 
   return 0;
 }
 
-void motor_set(motor_richtung_t richtung, uint8_t timeout_s, bool *stop) {
+void motor_set(uint8_t fach, motor_richtung_t richtung, uint8_t timeout_s,
+               bool *stop) {
   motor_set_t my_motor_set;
+  my_motor_set.fach = fach;
   my_motor_set.richtung_soll = richtung;
   my_motor_set.timeout_10ms = (uint16_t)timeout_s * 100U;
   my_motor_set.stop = stop;
@@ -265,3 +533,34 @@ void motor_set(motor_richtung_t richtung, uint8_t timeout_s, bool *stop) {
   k_pipe_write(&motor_set_pipe, (uint8_t *)&my_motor_set, sizeof(motor_set_t),
                K_FOREVER);
 }
+
+/* Auch ein Motor, der auf Budget wartet, zählt als laufend */
+bool motor_is_running(void) {
+  for (int i = 0; i < COMPARTMENT_COUNT; i++) {
+    if (motors[i].richtung_soll != MOTOR_STOP) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void motor_print_timing(void) {
+  stats_hist_print("motor period", "us", &motor_timing.period);
+  stats_hist_print("motor exec", "us", &motor_timing.exec);
+  if (motor_timing.period.count) {
+    printk("motor jitter: %u us\n",
+           motor_timing.period.max - motor_timing.period.min);
+  }
+  printk("motor deadline %u us: missed %u, in row %u, safe stops %u\n",
+         CONFIG_PAKETKASTEN_MOTOR_DEADLINE_US, motor_timing.misses,
+         motor_timing.misses_in_row, motor_timing.safe_stops);
+  printk("motor budget %u mA: %u cycles waited\n",
+         CONFIG_PAKETKASTEN_MOTOR_CURRENT_BUDGET_MA, motor_timing.budget_waits);
+  for (int i = 0; i < COMPARTMENT_COUNT; i++) {
+    printk("motor %d: %s%s, %u mA nominal\n", i,
+           motors[i].richtung_soll == MOTOR_VOR   ? "vor"
+           : motors[i].richtung_soll == MOTOR_ZUR ? "zur"
+                                                  : "stop",
+           motors[i].wartet ? " (waiting)" : "", motor_configs[i].nennstrom_ma);
+  }
+}
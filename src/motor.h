@@ -13,6 +13,13 @@
 typedef enum { MOTOR_STOP, MOTOR_VOR, MOTOR_ZUR } motor_richtung_t;
 
 int motor_init(void);
-void motor_set(motor_richtung_t richtung, uint8_t timeout_s, bool *stop);
+
+/* Motor eines Fachs anfordern. Er startet, sobald das Strombudget
+   (CONFIG_PAKETKASTEN_MOTOR_CURRENT_BUDGET_MA) es zulässt, und läuft bis
+   *stop wahr wird oder timeout_s abgelaufen ist. */
+void motor_set(uint8_t fach, motor_richtung_t richtung, uint8_t timeout_s,
+               bool *stop);
+bool motor_is_running(void);
+void motor_print_timing(void);
 
 #endif // MOTOR_H
@@ -3,9 +3,15 @@
  *
  * SPDX-License-Identifier: Apache-2.0
  */
+#include "health.h"
 #include "led.h"
+#include "trace.h"
+#include "writeback.h"
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(powermanager, CONFIG_PAKETKASTEN_LOG_LEVEL);
 
 /* Todo: Die Zephyr Treiber unterstützen aktuell noch keine Powermodes für den
    STM32L100 sodass er nicht schlafen geht. Die Treiber müssen erweitert werden
@@ -32,7 +38,18 @@ void powermanager_trigger(void) {
 
 void powermanager_check(void) {
   if (system_state == SLEEPING) {
-    printk("System entering sleep mode\n");
+    /* Die EEPROMs hängen an der Peripherieversorgung, offene Schreibzugriffe
+       vorher abschließen. Die Betriebszähler werden nur hier und nach
+       CONFIG_PAKETKASTEN_HEALTH_COMMIT_EVENTS Ereignissen geschrieben. */
+    health_sleep_enter();
+    if (writeback_flush() < 0) {
+      /* Ohne Versorgung gingen die Änderungen verloren, später erneut */
+      LOG_WRN("Pending writes, sleep postponed");
+      powermanager_trigger();
+      return;
+    }
+    LOG_INF("System entering sleep mode");
+    trace_event(TRACE_POWER_SLEEP, 0);
     /* Schalte Versorgung für Peripherie aus */
     /* This will turn off the VDDEN pin */
     /* and disable the power to the peripherals */
@@ -42,6 +59,7 @@ void powermanager_check(void) {
     /* by powermanager_wakeup() */
     sleep_thread = k_current_get();
     k_sleep(K_FOREVER);
+    health_sleep_exit();
   }
 }
 
@@ -77,6 +95,7 @@ void powermanager_wakeup(void) {
 
     k_wakeup(sleep_thread);
     sleep_thread = NULL;
-    printk("System waking up\n");
+    trace_event(TRACE_POWER_WAKEUP, 0);
+    LOG_INF("System waking up");
   }
 }
\ No newline at end of file
@@ -4,13 +4,27 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <stdlib.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/drivers/rfid.h>
 #include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
 #include <zephyr/rfid/iso14443.h>
 #include "states.h"
+#include "audit.h"
+#include "compartment.h"
+#include "config.h"
 #include "eeprom.h"
+#include "health.h"
+#include "led.h"
 #include "powermanager.h"
+#include "rfid_link.h"
+#include "stats.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "writeback.h"
+
+LOG_MODULE_REGISTER(rfid, CONFIG_PAKETKASTEN_LOG_LEVEL);
 
 #define RFID_MAIN_STACK_SIZE 1024
 #define RFID_MAIN_PRIORITY 5
@@ -31,8 +45,327 @@ struct my_rfid_iso14443a_info {
 
 static bool programming = false;
 
+/* Im Programmiermodus wählt eine bekannte Karte sich selbst aus. Wird sie
+   innerhalb von RFID_SELECT_TIMEOUT_MS erneut aufgelegt, wird sie gelöscht,
+   eine unbekannte Karte ersetzt sie. */
+#define RFID_SELECT_TIMEOUT_MS 10000
+
+static struct {
+  uint8_t uid[RFID_ISO14443A_MAX_UID_LEN];
+  uint8_t uid_len;
+  int64_t time;
+} rfid_selected;
+
+/* Karte, die länger als CONFIG_PAKETKASTEN_RFID_PRESENCE_MAX_S liegen
+   geblieben ist. Der Tag-Detektor meldet sie weiter, sie wird aber erst
+   wieder bearbeitet, nachdem sie das Feld verlassen hat. */
+static struct {
+  uint8_t uid[RFID_ISO14443A_MAX_UID_LEN];
+  uint8_t uid_len;
+} rfid_parked;
+static uint32_t rfid_parked_wakeups;
+
+/* Phasen einer Kartenerkennung mit Laufzeit und Ergebnis */
+enum rfid_phase {
+  RFID_PHASE_DETECT, // Tag-Detektor, Dauer in ms
+  RFID_PHASE_PROTOCOL,
+  RFID_PHASE_REQUEST,
+  RFID_PHASE_SDD,
+  RFID_PHASE_LOOKUP,
+  RFID_PHASE_COUNT
+};
+
+struct rfid_phase_stats {
+  struct stats_hist time;
+  uint32_t ok;
+  uint32_t failed;
+  uint32_t timeout;
+};
+
+static const char *const rfid_phase_names[RFID_PHASE_COUNT] = {
+    "detect", "protocol", "request", "sdd", "lookup"};
+
+static struct rfid_phase_stats rfid_phases[RFID_PHASE_COUNT];
+/* Dauer von Request + Antikollision in us */
+static struct stats_hist rfid_read_time;
+/* Aufwachen ohne lesbare Karte */
+static uint32_t rfid_retries;
+static uint32_t rfid_resets;
+
+static void rfid_phase_record(enum rfid_phase phase, uint32_t time, int ret) {
+  struct rfid_phase_stats *s = &rfid_phases[phase];
+  struct telemetry_rfid telemetry = {
+      .time = time, .phase = phase, .ret = CLAMP(ret, INT8_MIN, INT8_MAX)};
+
+  stats_hist_add(&s->time, time);
+  telemetry_send(TELEMETRY_RFID, &telemetry, sizeof(telemetry));
+
+  if (ret == 0) {
+    s->ok++;
+  } else if (ret == -ETIMEDOUT || ret == -EAGAIN) {
+    s->timeout++;
+  } else {
+    s->failed++;
+  }
+}
+
+#ifdef CONFIG_PAKETKASTEN_RFID_ADAPTIVE_DETECT
+/* Timeout des Tag-Detektors nach 32 Perioden, danach wird neu geplant */
+#define RFID_DETECT_MAX_SLEEP 0x1F
+/* Abweichung der Referenz, ab der sie gespeichert wird */
+#define RFID_DAC_SAVE_DELTA 4
+
+static uint8_t rfid_dac_ref;
+static bool rfid_calibrated;
+static int64_t rfid_last_calibration;
+static int64_t rfid_last_activity;
+static uint32_t rfid_calibrations;
+static uint32_t rfid_calibration_errors;
+static uint32_t rfid_detect_period;
+
+/* Eine fehlgeschlagene Kalibrierung behält die alte Referenz. Beim Start
+   ist das die zuletzt gespeicherte. */
+static void rfid_calibrate(void) {
+  uint8_t saved = config_get()->rfid_dac_ref;
+  uint8_t ref;
+  int ret;
+
+  ret = rfid_link_calibrate(&ref);
+  rfid_last_calibration = k_uptime_get();
+  if (ret < 0) {
+    rfid_calibration_errors++;
+    if (!rfid_calibrated && saved != 0) {
+      rfid_dac_ref = saved;
+      rfid_calibrated = true;
+    }
+    return;
+  }
+  rfid_dac_ref = ref;
+  rfid_calibrated = true;
+  rfid_calibrations++;
+
+  /* Nur deutliche Änderungen speichern, stündliches Schreiben wäre unnötiger
+     Verschleiß */
+  if (abs(ref - saved) > RFID_DAC_SAVE_DELTA) {
+    config_set_dac_ref(ref);
+  }
+}
+
+/* Nach einer Karte schnell suchen, danach verdoppelt sich die Periode mit
+   jedem weiteren ruhigen Zeitfenster bis zum Maximum */
+static uint32_t rfid_detect_period_ms(void) {
+  int64_t idle = k_uptime_get() - rfid_last_activity;
+  int64_t window = (int64_t)CONFIG_PAKETKASTEN_RFID_DETECT_ACTIVE_MIN * 60 *
+                   MSEC_PER_SEC;
+  uint32_t period = CONFIG_PAKETKASTEN_RFID_DETECT_FAST_MS;
+
+  while (idle >= window &&
+         period < CONFIG_PAKETKASTEN_RFID_DETECT_SLOW_MS) {
+    period *= 2;
+    idle -= window;
+  }
+  return MIN(period, CONFIG_PAKETKASTEN_RFID_DETECT_SLOW_MS);
+}
+#endif
+
+/* Schläft bis eine Karte erkannt wurde. -EAGAIN: Timeout ohne Karte */
+static int rfid_sleep(struct rfid_property *sleep) {
+#ifdef CONFIG_PAKETKASTEN_RFID_ADAPTIVE_DETECT
+  if (rfid_calibrated) {
+    /* Kalibriert wird nur die leere Antenne */
+    if (rfid_parked.uid_len == 0 &&
+        k_uptime_get() - rfid_last_calibration >=
+            (int64_t)CONFIG_PAKETKASTEN_RFID_CALIBRATION_MIN * 60 *
+                MSEC_PER_SEC) {
+      rfid_calibrate();
+    }
+    /* Eine liegen gelassene Karte weckt nur mit der längsten Periode */
+    rfid_detect_period = rfid_parked.uid_len != 0
+                             ? CONFIG_PAKETKASTEN_RFID_DETECT_SLOW_MS
+                             : rfid_detect_period_ms();
+    return rfid_link_detect(rfid_dac_ref, rfid_detect_period,
+                            RFID_DETECT_MAX_SLEEP);
+  }
+#endif
+  /* Feste Einstellungen des Treibers */
+  rfid_set_properties(rfid_dev, sleep, 1);
+  return sleep->status;
+}
+
+static uint32_t rfid_us_since(uint32_t start) {
+  return k_cyc_to_us_floor32(k_cycle_get_32() - start);
+}
+
+/* Nach dem Lesen wird die Karte mit Request + Antikollision weiter abgefragt,
+   bis sie das Feld verlässt. Bleibt sie länger liegen, wird seltener gefragt. */
+#define RFID_PRESENCE_SLOW_AFTER_MS 5000
+#define RFID_PRESENCE_SLOW_POLL_MS 500
+#define RFID_PRESENCE_MISSES 2
+
+/* Beim Verfolgen einer Karte (presence) sind Fehler das erwartete Ende und
+   werden nicht als Fehler gezählt */
+static bool rfid_read_tag(struct my_rfid_iso14443a_info *tag, bool presence) {
+  uint32_t start = k_cycle_get_32();
+  uint32_t phase_start = start;
+  int ret;
+
+  memset(tag, 0, sizeof(*tag));
+
+  ret = rfid_iso14443a_request(rfid_dev, tag->atqa, true);
+  if (ret == 0 || !presence) {
+    rfid_phase_record(RFID_PHASE_REQUEST, rfid_us_since(phase_start), ret);
+  }
+  trace_event(TRACE_RFID_REQUEST, ret);
+  if (ret != 0) {
+    return false;
+  }
+
+  phase_start = k_cycle_get_32();
+  ret = rfid_iso14443a_sdd(rfid_dev, (struct rfid_iso14443a_info *)tag);
+  if (ret == 0 || !presence) {
+    rfid_phase_record(RFID_PHASE_SDD, rfid_us_since(phase_start), ret);
+  }
+  trace_event(TRACE_RFID_SDD, ret);
+  if (ret != 0) {
+    return false;
+  }
+
+  stats_hist_add(&rfid_read_time, rfid_us_since(start));
+  return true;
+}
+
+static void rfid_select_clear(void) {
+  rfid_selected.uid_len = 0;
+  states_led_red_pattern_stop();
+}
+
+/* Karte im Programmiermodus: unbekannte Karten werden hinzugefügt oder
+   ersetzen die ausgewählte, bekannte Karten werden ausgewählt oder gelöscht */
+static void rfid_program_tag(bool known, uint16_t hash) {
+  bool selected = rfid_selected.uid_len != 0 &&
+                  k_uptime_get() - rfid_selected.time < RFID_SELECT_TIMEOUT_MS;
+  int ret;
+
+  if (!known) {
+    if (selected) {
+      ret = eeprom_replace_uid(rfid_selected.uid, rfid_selected.uid_len,
+                               info.uid, info.uid_len);
+      LOG_INF("UID replaced: %d", ret);
+      audit_log(AUDIT_UID_REMOVE,
+                audit_uid_hash(rfid_selected.uid, rfid_selected.uid_len),
+                ret < 0);
+      audit_log(AUDIT_UID_ADD, hash, ret < 0);
+    } else {
+      /* Im Programmiermodus gelernte Karten öffnen alle Fächer, die
+         Zuordnung ändert "uid add <hex> <fächer>" auf der Konsole */
+      ret = eeprom_add_uid(info.uid, info.uid_len, UID_ALL_COMPARTMENTS);
+      LOG_INF("UID added: %d", ret);
+      audit_log(AUDIT_UID_ADD, hash, ret < 0);
+    }
+    rfid_select_clear();
+    return;
+  }
+
+  if (selected && rfid_selected.uid_len == info.uid_len &&
+      memcmp(rfid_selected.uid, info.uid, info.uid_len) == 0) {
+    ret = eeprom_remove_uid(info.uid, info.uid_len);
+    LOG_INF("UID removed: %d", ret);
+    audit_log(AUDIT_UID_REMOVE, hash, ret < 0);
+    rfid_select_clear();
+    return;
+  }
+
+  memcpy(rfid_selected.uid, info.uid, info.uid_len);
+  rfid_selected.uid_len = info.uid_len;
+  rfid_selected.time = k_uptime_get();
+  led_pattern_play(LED_RED, &led_pattern_double_blink);
+  LOG_INF("UID selected: present again to remove, new card to replace");
+}
+
+static void rfid_handle_tag(void) {
+  uint32_t start = k_cycle_get_32();
+  uint8_t faecher = eeprom_check_uid(info.uid, info.uid_len);
+  bool known = faecher != 0;
+  uint16_t hash;
+
+  /* Ergebnis der Suche ist kein Fehler, ok zählt alle Suchen */
+  rfid_phase_record(RFID_PHASE_LOOKUP, rfid_us_since(start), 0);
+  trace_event(TRACE_RFID_LOOKUP, known);
+
+  hash = audit_uid_hash(info.uid, info.uid_len);
+  if (programming) {
+    rfid_program_tag(known, hash);
+  } else if (known) {
+    /* Alle Fächer öffnen, für die die Karte berechtigt ist */
+    for (uint8_t fach = 0; fach < COMPARTMENT_COUNT; fach++) {
+      if (faecher & BIT(fach)) {
+        push_command(fach, CMD_OEFFNE_BRIEF);
+      }
+    }
+    audit_log(AUDIT_RFID_ACCEPT, hash, faecher);
+    health_inc(HEALTH_RFID_ACCEPTS);
+  } else {
+    audit_log(AUDIT_RFID_REJECT, hash, 0);
+    health_inc(HEALTH_RFID_REJECTS);
+  }
+}
+
+static bool rfid_is_parked(const struct my_rfid_iso14443a_info *tag) {
+  return rfid_parked.uid_len != 0 && tag->uid_len == rfid_parked.uid_len &&
+         memcmp(tag->uid, rfid_parked.uid, tag->uid_len) == 0;
+}
+
+/* Verfolgt die gelesene Karte bis sie entfernt wird, höchstens
+   CONFIG_PAKETKASTEN_RFID_PRESENCE_MAX_S. Gibt true zurück, wenn statt dessen
+   eine andere Karte im Feld ist, diese steht dann in info. */
+static bool rfid_track_presence(void) {
+  struct my_rfid_iso14443a_info probe;
+  int64_t start = k_uptime_get();
+  uint8_t misses = 0;
+
+  while (misses < RFID_PRESENCE_MISSES) {
+    if (k_uptime_get() - start >=
+        (int64_t)CONFIG_PAKETKASTEN_RFID_PRESENCE_MAX_S * MSEC_PER_SEC) {
+      /* Nicht endlos mit eingeschaltetem Feld abfragen */
+      memcpy(rfid_parked.uid, info.uid, info.uid_len);
+      rfid_parked.uid_len = info.uid_len;
+      trace_event(TRACE_RFID_PARKED, (uint32_t)(k_uptime_get() - start));
+      LOG_INF("Tag left on reader, back to tag detection");
+      return false;
+    }
+    /* Der Powermanager schaltet die Versorgung des CR95HF sonst während
+       der Abfrage ab */
+    powermanager_trigger();
+    if (k_uptime_get() - start < RFID_PRESENCE_SLOW_AFTER_MS) {
+      k_msleep(CONFIG_PAKETKASTEN_RFID_PRESENCE_POLL_MS);
+    } else {
+      k_msleep(RFID_PRESENCE_SLOW_POLL_MS);
+    }
+
+    if (!rfid_read_tag(&probe, true)) {
+      misses++;
+      continue;
+    }
+    misses = 0;
+
+    if (probe.uid_len != info.uid_len ||
+        memcmp(probe.uid, info.uid, info.uid_len) != 0) {
+      memcpy(&info, &probe, sizeof(info));
+      return true;
+    }
+  }
+
+  trace_event(TRACE_RFID_REMOVED, (uint32_t)(k_uptime_get() - start));
+  return false;
+}
+
 static void rfid_main(void *p1, void *p2, void *p3) {
   struct rfid_property props[2];
+  uint32_t start;
+  int64_t sleep_start = 0;
+  bool waiting = false;
+  bool read;
+  int ret;
 
   props[0].type = RFID_PROP_SLEEP;
   /* refid_set_properties shall block until a tag is detected*/
@@ -41,9 +374,21 @@ static void rfid_main(void *p1, void *p2, void *p3) {
   props[1].type = RFID_PROP_RESET;
 
   while (1) {
-    rfid_set_properties(rfid_dev, &props[0], 1);
+    if (!waiting) {
+      sleep_start = k_uptime_get();
+    }
+    ret = rfid_sleep(&props[0]);
+    /* Timeout des Tag-Detektors: Periode neu planen, Schlafdauer läuft
+       weiter */
+    waiting = (ret == -EAGAIN);
+    if (waiting) {
+      continue;
+    }
+    rfid_phase_record(RFID_PHASE_DETECT,
+                      (uint32_t)(k_uptime_get() - sleep_start), ret);
+    trace_event(TRACE_RFID_DETECT, ret);
 
-    if (props[0].status != 0) {
+    if (ret != 0) {
       /** Workaround for CR95HF:
        * If the Tag is removed while rfid_iso14443a_sdd is not finished, the
        * CR95HF seems to be in an internal state where Sleep Mode is not
@@ -52,48 +397,89 @@ static void rfid_main(void *p1, void *p2, void *p3) {
        * device.
        */
       rfid_set_properties(rfid_dev, &props[1], 1);
+      trace_event(TRACE_RFID_RESET, 0);
+      rfid_resets++;
+      health_inc(HEALTH_CR95HF_RESETS);
       continue;
     }
 
-    powermanager_wakeup();
+    /* Für eine liegen gelassene Karte erst nach dem Lesen */
+    if (rfid_parked.uid_len == 0) {
+      powermanager_wakeup();
+    }
 
-    rfid_load_protocol(rfid_dev, RFID_PROTO_ISO14443A,
-                       RFID_MODE_INITIATOR | RFID_MODE_TX_106 |
-                           RFID_MODE_RX_106);
+    start = k_cycle_get_32();
+    ret = rfid_load_protocol(rfid_dev, RFID_PROTO_ISO14443A,
+                             RFID_MODE_INITIATOR | RFID_MODE_TX_106 |
+                                 RFID_MODE_RX_106);
+    rfid_phase_record(RFID_PHASE_PROTOCOL, rfid_us_since(start), ret);
+    trace_event(TRACE_RFID_PROTOCOL, ret);
 
-    memset(&info, 0, sizeof(info));
+    read = rfid_read_tag(&info, false);
+    if (!read && rfid_parked.uid_len != 0) {
+      /* Einmal nachfassen, bevor die liegen gelassene Karte als entfernt
+         gilt */
+      k_msleep(CONFIG_PAKETKASTEN_RFID_PRESENCE_POLL_MS);
+      read = rfid_read_tag(&info, true);
+    }
+    if (!read) {
+      rfid_retries++;
+      rfid_parked.uid_len = 0;
+      continue;
+    }
+    if (rfid_is_parked(&info)) {
+      /* Schon bearbeitet, das System nicht wecken */
+      rfid_parked_wakeups++;
+      continue;
+    }
+    if (rfid_parked.uid_len != 0) {
+      rfid_parked.uid_len = 0;
+      powermanager_wakeup();
+    }
 
-    if (rfid_iso14443a_request(rfid_dev, info.atqa, true) == 0) {
-      if (rfid_iso14443a_sdd(rfid_dev, (struct rfid_iso14443a_info *)&info) ==
-          0) {
+#ifdef CONFIG_PAKETKASTEN_RFID_ADAPTIVE_DETECT
+    rfid_last_activity = k_uptime_get();
+#endif
 
-		if(eeprom_check_uid(info.uid, info.uid_len)) {
-			if(programming == false)
-			{
-				push_command(CMD_OEFFNE_BRIEF);
-			}
-		} else {
-			if(programming == true) {
-				eeprom_add_uid(info.uid, info.uid_len);
-			}
-		}
-		k_sleep(K_SECONDS(2));
-        }
-      }
-    }
+    /* Statt einer festen Pause erst wieder scharf schalten, wenn die Karte
+       entfernt wurde. Eine neue Karte wird sofort bearbeitet. */
+    do {
+      rfid_handle_tag();
+    } while (rfid_track_presence());
+  }
 }
 
 void rfid_init(void) {
+  stats_hist_init(&rfid_phases[RFID_PHASE_DETECT].time, 0, 60000U);
+  stats_hist_init(&rfid_phases[RFID_PHASE_PROTOCOL].time, 0, 2000U);
+  stats_hist_init(&rfid_phases[RFID_PHASE_REQUEST].time, 0, 2000U);
+  stats_hist_init(&rfid_phases[RFID_PHASE_SDD].time, 0, 5000U);
+  stats_hist_init(&rfid_phases[RFID_PHASE_LOOKUP].time, 0, 500U);
+  stats_hist_init(&rfid_read_time, 0, 5000U);
+
+#ifdef CONFIG_PAKETKASTEN_RFID_LINK_CHECK
+  /* SPI-Verbindung prüfen, solange der Treiber noch nicht benutzt wird */
+  rfid_link_check();
+#endif
+
+#ifdef CONFIG_PAKETKASTEN_RFID_ADAPTIVE_DETECT
+  /* Ohne Referenz (auch keine gespeicherte) werden die festen Einstellungen
+     des Treibers benutzt */
+  rfid_calibrate();
+#endif
+
   /* Starte rfid_main */
   rfid_main_id = k_thread_create(
       &rfid_main_data, rfid_main_stack, K_THREAD_STACK_SIZEOF(rfid_main_stack),
       rfid_main, NULL, NULL, NULL, RFID_MAIN_PRIORITY, 0, K_NO_WAIT);
+  k_thread_name_set(rfid_main_id, "rfid_main");
 }
 
 void rfid_set_programming_mode(void) {
 	if(programming == false) {
-		eeprom_clear_uid_list();
-		printk("programming mode\n");
+		/* Gespeicherte UIDs bleiben erhalten, Karten werden einzeln
+		   hinzugefügt, ersetzt oder gelöscht */
+		LOG_INF("programming mode, %u UIDs stored", eeprom_uid_count());
 		programming = true;
 	}
 }
@@ -101,7 +487,45 @@ void rfid_set_programming_mode(void) {
 void rfid_set_normal_mode(void) {
 	if(programming == true) {
 		programming = false;
-		printk("normal mode\n");
-		eeprom_write_uid_list();
+		rfid_select_clear();
+		/* Neue UIDs wurden bereits beim Einlesen gespeichert */
+		LOG_INF("normal mode, %u UIDs stored", eeprom_uid_count());
 	}
-}
\ No newline at end of file
+}
+
+static void rfid_clear_work_handler(struct k_work *work) {
+	eeprom_clear_uid_list();
+	LOG_INF("all UIDs cleared");
+}
+
+static K_WORK_DEFINE(rfid_clear_work, rfid_clear_work_handler);
+
+int rfid_clear_uids(void) {
+	if(programming == false) {
+		return -EPERM;
+	}
+	/* Löschen kann alle Seiten schreiben, nicht im Hauptthread */
+	return writeback_submit(&rfid_clear_work);
+}
+
+void rfid_print_timing(void) {
+  uint32_t hours = k_uptime_get() / (3600 * MSEC_PER_SEC);
+
+  for (int i = 0; i < RFID_PHASE_COUNT; i++) {
+    stats_hist_print(rfid_phase_names[i],
+                     i == RFID_PHASE_DETECT ? "ms" : "us",
+                     &rfid_phases[i].time);
+    printk("  ok %u, failed %u, timeout %u\n", rfid_phases[i].ok,
+           rfid_phases[i].failed, rfid_phases[i].timeout);
+  }
+  stats_hist_print("request+sdd", "us", &rfid_read_time);
+  printk("retries %u, CR95HF resets %u (%u/h), left on reader %u\n",
+         rfid_retries, rfid_resets, rfid_resets / MAX(hours, 1U),
+         rfid_parked_wakeups);
+#ifdef CONFIG_PAKETKASTEN_RFID_ADAPTIVE_DETECT
+  printk("tag detect: dac ref 0x%02x, period %u ms, calibrations %u "
+         "(failed %u)\n",
+         rfid_dac_ref, rfid_detect_period, rfid_calibrations,
+         rfid_calibration_errors);
+#endif
+}
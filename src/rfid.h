@@ -9,5 +9,8 @@
 void rfid_init(void);
 void rfid_set_programming_mode(void);
 void rfid_set_normal_mode(void);
+/* Löscht alle UIDs im Hintergrund, nur im Programmiermodus erlaubt */
+int rfid_clear_uids(void);
+void rfid_print_timing(void);
 
 #endif /* RFID_H */
\ No newline at end of file
@@ -0,0 +1,307 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "rfid_link.h"
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/spi.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(rfid_link, CONFIG_PAKETKASTEN_LOG_LEVEL);
+
+#define RFID_NODE DT_ALIAS(rfid)
+
+/* CR95HF SPI Steuerbytes */
+#define CR95HF_CTRL_SEND 0x00
+#define CR95HF_CTRL_READ 0x02
+#define CR95HF_CTRL_POLL 0x03
+#define CR95HF_POLL_READY BIT(3)
+#define CR95HF_CMD_ECHO 0x55
+#define CR95HF_CMD_IDLE 0x07
+
+/* Aufwachquellen des IDLE Befehls, auch in der Antwort */
+#define CR95HF_WU_TIMEOUT BIT(0)
+#define CR95HF_WU_TAG_DETECT BIT(1)
+
+/* Ein Schritt des Tag-Detektors dauert 256 Takte des 32 kHz Oszillators */
+#define CR95HF_WU_STEP_MS 8U
+#define CR95HF_DAC_MAX 0xFC
+/* Abstand der Schwellen zur Referenz bei der Erkennung */
+#define CR95HF_DAC_GUARD 0x08
+
+#define RFID_LINK_ECHOS 16
+#define RFID_LINK_POLLS 50
+/* Zusätzliche Wartezeit auf die Antwort des IDLE Befehls */
+#define RFID_LINK_IDLE_MARGIN_MS 100
+
+static const struct spi_dt_spec rfid_link_spec =
+    SPI_DT_SPEC_GET(RFID_NODE, SPI_WORD_SET(8) | SPI_TRANSFER_MSB, 0);
+
+/* IRQ_OUT wird aktiv, sobald die Antwort bereitliegt */
+static const struct gpio_dt_spec rfid_link_irq_out =
+    GPIO_DT_SPEC_GET(RFID_NODE, irq_out_gpios);
+static struct gpio_callback rfid_link_irq_cb;
+static K_SEM_DEFINE(rfid_link_irq_sem, 0, 1);
+static bool rfid_link_irq_ready;
+
+/* Taktstufen, der CR95HF erlaubt maximal 2 MHz */
+static const uint32_t rfid_link_freqs[] = {50000,  100000,  250000,
+                                           500000, 1000000, 2000000};
+
+/* Eine Konfiguration pro Stufe: der STM32 SPI-Treiber konfiguriert nur neu,
+   wenn sich der Zeiger auf die spi_config ändert, nicht bei geändertem
+   Inhalt */
+static struct spi_dt_spec rfid_link_steps[ARRAY_SIZE(rfid_link_freqs)];
+
+/* Ein ECHO besteht aus drei SPI-Transfers (Senden, Pollen, Lesen). Der
+   CR95HF verlangt zwischen den Phasen ein Deaktivieren von CS. */
+static int rfid_link_echo(const struct spi_dt_spec *spec) {
+  uint8_t send[2] = {CR95HF_CTRL_SEND, CR95HF_CMD_ECHO};
+  uint8_t poll_tx[2] = {CR95HF_CTRL_POLL, 0};
+  uint8_t read_tx[2] = {CR95HF_CTRL_READ, 0};
+  uint8_t rx[2];
+  const struct spi_buf send_buf = {.buf = send, .len = sizeof(send)};
+  const struct spi_buf poll_buf = {.buf = poll_tx, .len = sizeof(poll_tx)};
+  const struct spi_buf read_buf = {.buf = read_tx, .len = sizeof(read_tx)};
+  const struct spi_buf rx_buf = {.buf = rx, .len = sizeof(rx)};
+  const struct spi_buf_set send_set = {.buffers = &send_buf, .count = 1};
+  const struct spi_buf_set poll_set = {.buffers = &poll_buf, .count = 1};
+  const struct spi_buf_set read_set = {.buffers = &read_buf, .count = 1};
+  const struct spi_buf_set rx_set = {.buffers = &rx_buf, .count = 1};
+  int ret;
+  int i;
+
+  ret = spi_write_dt(spec, &send_set);
+  if (ret < 0) {
+    return ret;
+  }
+
+  for (i = 0; i < RFID_LINK_POLLS; i++) {
+    ret = spi_transceive_dt(spec, &poll_set, &rx_set);
+    if (ret < 0) {
+      return ret;
+    }
+    if (rx[1] & CR95HF_POLL_READY) {
+      break;
+    }
+    k_busy_wait(100);
+  }
+  if (i == RFID_LINK_POLLS) {
+    return -ETIMEDOUT;
+  }
+
+  ret = spi_transceive_dt(spec, &read_set, &rx_set);
+  if (ret < 0) {
+    return ret;
+  }
+
+  return (rx[1] == CR95HF_CMD_ECHO) ? 0 : -EIO;
+}
+
+uint32_t rfid_link_check(void) {
+  uint32_t configured = rfid_link_spec.config.frequency;
+  uint32_t best = 0;
+  int ret;
+
+  if (!spi_is_ready_dt(&rfid_link_spec)) {
+    return 0;
+  }
+
+  for (int f = 0; f < ARRAY_SIZE(rfid_link_freqs); f++) {
+    rfid_link_steps[f] = rfid_link_spec;
+    rfid_link_steps[f].config.frequency = rfid_link_freqs[f];
+
+    for (int i = 0; i < RFID_LINK_ECHOS; i++) {
+      ret = rfid_link_echo(&rfid_link_steps[f]);
+      if (ret < 0) {
+        break;
+      }
+    }
+    if (ret < 0) {
+      break;
+    }
+    best = rfid_link_freqs[f];
+  }
+
+  LOG_INF("CR95HF link: ok up to %u Hz, configured %u Hz", best, configured);
+  if (best < configured) {
+    LOG_WRN("CR95HF link: lower spi-max-frequency to %u", best);
+  }
+
+  return best;
+}
+
+static void rfid_link_irq_handler(const struct device *dev,
+                                  struct gpio_callback *cb, uint32_t pins) {
+  k_sem_give(&rfid_link_irq_sem);
+}
+
+static int rfid_link_irq_init(void) {
+  int ret;
+
+  if (rfid_link_irq_ready) {
+    return 0;
+  }
+  if (!gpio_is_ready_dt(&rfid_link_irq_out)) {
+    return -ENODEV;
+  }
+  ret = gpio_pin_configure_dt(&rfid_link_irq_out, GPIO_INPUT);
+  if (ret < 0) {
+    return ret;
+  }
+  gpio_init_callback(&rfid_link_irq_cb, rfid_link_irq_handler,
+                     BIT(rfid_link_irq_out.pin));
+  ret = gpio_add_callback_dt(&rfid_link_irq_out, &rfid_link_irq_cb);
+  if (ret < 0) {
+    return ret;
+  }
+  rfid_link_irq_ready = true;
+  return 0;
+}
+
+/* Sendet IDLE und wartet bis zum Aufwachen. Der CR95HF meldet die Antwort
+   über IRQ_OUT, bis dahin schläft der Thread ohne SPI-Zugriffe. Die
+   Steuerwerte für Kalibrierung und Erkennung stammen aus dem Datenblatt.
+   Gibt die Aufwachquelle zurück oder einen negativen Fehler. */
+static int rfid_link_idle(bool calibration, uint8_t wu_period, uint8_t dac_low,
+                          uint8_t dac_high, uint8_t max_sleep) {
+  const uint8_t cmd[] = {CR95HF_CTRL_SEND,
+                         CR95HF_CMD_IDLE,
+                         0x0E,
+                         CR95HF_WU_TIMEOUT | CR95HF_WU_TAG_DETECT,
+                         calibration ? 0xA1 : 0x21, // EnterCtrl
+                         0x00,
+                         calibration ? 0xB8 : 0x79, // WUCtrl
+                         calibration ? 0x00 : 0x01,
+                         0x18, // LeaveCtrl
+                         0x00,
+                         wu_period,
+                         0x60, // OscStart
+                         0x60, // DacStart
+                         dac_low,
+                         dac_high,
+                         0x3F, // SwingsCnt
+                         max_sleep};
+  uint8_t poll_tx[2] = {CR95HF_CTRL_POLL, 0};
+  uint8_t read_tx[4] = {CR95HF_CTRL_READ, 0, 0, 0};
+  uint8_t rx[4];
+  const struct spi_buf cmd_buf = {.buf = (void *)cmd, .len = sizeof(cmd)};
+  const struct spi_buf poll_buf = {.buf = poll_tx, .len = sizeof(poll_tx)};
+  const struct spi_buf read_buf = {.buf = read_tx, .len = sizeof(read_tx)};
+  struct spi_buf rx_buf = {.buf = rx, .len = sizeof(poll_tx)};
+  const struct spi_buf_set cmd_set = {.buffers = &cmd_buf, .count = 1};
+  const struct spi_buf_set poll_set = {.buffers = &poll_buf, .count = 1};
+  const struct spi_buf_set read_set = {.buffers = &read_buf, .count = 1};
+  const struct spi_buf_set rx_set = {.buffers = &rx_buf, .count = 1};
+  int64_t deadline = k_uptime_get() + RFID_LINK_IDLE_MARGIN_MS +
+                     (int64_t)CR95HF_WU_STEP_MS * (wu_period + 2) *
+                         (max_sleep + 1);
+  int ret;
+
+  ret = rfid_link_irq_init();
+  if (ret < 0) {
+    return ret;
+  }
+
+  /* Interrupt vor dem Senden scharf schalten, sonst geht eine schnelle
+     Antwort verloren */
+  k_sem_reset(&rfid_link_irq_sem);
+  ret = gpio_pin_interrupt_configure_dt(&rfid_link_irq_out,
+                                        GPIO_INT_EDGE_TO_ACTIVE);
+  if (ret < 0) {
+    return ret;
+  }
+
+  ret = spi_write_dt(&rfid_link_spec, &cmd_set);
+  if (ret == 0) {
+    ret = k_sem_take(&rfid_link_irq_sem, K_TIMEOUT_ABS_MS(deadline));
+  }
+  gpio_pin_interrupt_configure_dt(&rfid_link_irq_out, GPIO_INT_DISABLE);
+  if (ret == -EAGAIN) {
+    return -ETIMEDOUT;
+  }
+  if (ret < 0) {
+    return ret;
+  }
+
+  /* Einmal das Poll-Flag prüfen, falls die Flanke eine Störung war */
+  ret = spi_transceive_dt(&rfid_link_spec, &poll_set, &rx_set);
+  if (ret < 0) {
+    return ret;
+  }
+  if (!(rx[1] & CR95HF_POLL_READY)) {
+    return -EIO;
+  }
+
+  /* Antwort: Ergebnis 0x00, Länge 0x01, Aufwachquelle */
+  rx_buf.len = sizeof(rx);
+  ret = spi_transceive_dt(&rfid_link_spec, &read_set, &rx_set);
+  if (ret < 0) {
+    return ret;
+  }
+  if (rx[1] != 0x00 || rx[2] != 0x01) {
+    return -EIO;
+  }
+
+  return rx[3];
+}
+
+int rfid_link_calibrate(uint8_t *dac_ref) {
+  uint8_t dac = 0;
+  int ret;
+
+  if (!spi_is_ready_dt(&rfid_link_spec)) {
+    return -ENODEV;
+  }
+
+  /* Ohne Karte muss DAC 0x00 sofort wecken und 0xFC nie */
+  ret = rfid_link_idle(true, 0x01, 0x00, 0x00, 0x01);
+  if (ret < 0) {
+    return ret;
+  }
+  if (!(ret & CR95HF_WU_TAG_DETECT)) {
+    return -EIO;
+  }
+  ret = rfid_link_idle(true, 0x01, 0x00, CR95HF_DAC_MAX, 0x01);
+  if (ret < 0) {
+    return ret;
+  }
+  if (!(ret & CR95HF_WU_TIMEOUT)) {
+    return -EIO;
+  }
+
+  /* Binäre Suche: Detektion, solange die obere Schwelle unter dem
+     Messwert der leeren Antenne liegt */
+  for (uint8_t step = 0x80; step >= 0x04; step >>= 1) {
+    ret = rfid_link_idle(true, 0x01, 0x00, dac + step, 0x01);
+    if (ret < 0) {
+      return ret;
+    }
+    if (ret & CR95HF_WU_TAG_DETECT) {
+      dac += step;
+    }
+  }
+
+  *dac_ref = dac;
+  return 0;
+}
+
+int rfid_link_detect(uint8_t dac_ref, uint32_t period_ms, uint8_t max_sleep) {
+  uint32_t steps = period_ms / CR95HF_WU_STEP_MS;
+  uint8_t wu_period = CLAMP(steps, 2U, 257U) - 2U;
+  uint8_t low = MAX(dac_ref, CR95HF_DAC_GUARD) - CR95HF_DAC_GUARD;
+  uint8_t high = MIN(dac_ref + CR95HF_DAC_GUARD, CR95HF_DAC_MAX);
+  int ret;
+
+  ret = rfid_link_idle(false, wu_period, low, high, max_sleep);
+  if (ret < 0) {
+    return ret;
+  }
+  if (ret & CR95HF_WU_TAG_DETECT) {
+    return 0;
+  }
+  return -EAGAIN;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef RFID_LINK_H
+#define RFID_LINK_H
+
+#include <stdint.h>
+
+/**
+ * @brief Prüfe die SPI-Verbindung zum CR95HF
+ *
+ * Beginnt mit einem langsamen Takt und erhöht ihn schrittweise. Bei jeder
+ * Stufe werden ECHO-Befehle gesendet und die Antwort geprüft. Darf nur
+ * aufgerufen werden, solange rfid_main noch nicht läuft. Nur zur Diagnose,
+ * der Treiber behält den Takt aus dem Devicetree.
+ *
+ * @return schnellster fehlerfreier SPI-Takt in Hz, 0 wenn keine Stufe ging
+ */
+uint32_t rfid_link_check(void);
+
+/**
+ * @brief Kalibriere den Tag-Detektor des CR95HF
+ *
+ * Sucht die DAC-Referenz der leeren Antenne nach dem Verfahren aus dem
+ * Datenblatt (binäre Suche mit IDLE-Befehlen). Es darf keine Karte im Feld
+ * liegen und der Treiber darf gleichzeitig nicht benutzt werden.
+ *
+ * @param dac_ref gefundene Referenz
+ * @return 0 bei Erfolg, sonst negativer Fehler
+ */
+int rfid_link_calibrate(uint8_t *dac_ref);
+
+/**
+ * @brief Warte im Tag-Detektor-Modus auf eine Karte
+ *
+ * Versetzt den CR95HF mit den Schwellen dac_ref +/- 8 in den Schlafmodus.
+ * Der Detektor sucht alle period_ms nach einer Karte und gibt nach
+ * max_sleep + 1 Perioden ohne Karte auf.
+ *
+ * @param dac_ref Referenz aus rfid_link_calibrate
+ * @param period_ms Abstand der Suchvorgänge, 8 ms bis ca. 2 s
+ * @param max_sleep Anzahl Perioden bis zum Timeout - 1, höchstens 0x1F
+ * @return 0 wenn eine Karte erkannt wurde, -EAGAIN beim Timeout, sonst
+ *         negativer Fehler
+ */
+int rfid_link_detect(uint8_t dac_ref, uint32_t period_ms, uint8_t max_sleep);
+
+#endif /* RFID_LINK_H */
@@ -7,12 +7,23 @@
 
 #include <stdbool.h>
 #include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
 #include "states.h"
+#include "audit.h"
+#include "compartment.h"
+#include "config.h"
+#include "health.h"
 #include "inputs.h"
 #include "led.h"
 #include "motor.h"
 #include "powermanager.h"
 #include "rfid.h"
+#include "telemetry.h"
+#include "trace.h"
+
+LOG_MODULE_REGISTER(states, CONFIG_PAKETKASTEN_LOG_LEVEL);
+
+#define DT_DRV_COMPAT dhl_paketkasten_compartment
 
 typedef enum {
   STATE_GESCHLOSSEN,
@@ -27,69 +38,153 @@ typedef enum {
 typedef struct {
   bool *condition;
   state_t next_state;
+  bool led; // rote LED wurde von goto_warten eingeschaltet
 } warten_t;
 
-static state_t current_state = STATE_GESCHLOSSEN; // Initialzustand
-static warten_t warten;
+/* Zustand eines Fachs */
+typedef struct {
+  state_t current_state;
+  warten_t warten;
+  bool timeout;
+  struct k_timer *timer;
+  struct k_pipe *command_pipe; // FIFO für die Befehle
+} fach_t;
+
+static void timeout_handler(struct k_timer *timer_id);
+
+#define FACH_DEFINE(n)                                                         \
+  K_PIPE_DEFINE(command_pipe_##n, sizeof(command_t), 2);                       \
+  K_TIMER_DEFINE(timer_##n, timeout_handler, NULL);
+
+DT_INST_FOREACH_STATUS_OKAY(FACH_DEFINE)
+
+#define FACH_INIT(n)                                                           \
+  [n] = {                                                                      \
+      .current_state = STATE_GESCHLOSSEN, /* Initialzustand */                 \
+      .timer = &timer_##n,                                                     \
+      .command_pipe = &command_pipe_##n,                                       \
+  },
+
+static fach_t faecher[COMPARTMENT_COUNT] = {
+    DT_INST_FOREACH_STATUS_OKAY(FACH_INIT)};
+
+/* Die rote LED gehört allen Fächern: ein Bit pro Fach, das sie gerade
+   anzeigt. Aus geht sie erst, wenn kein Fach sie mehr braucht. */
+static uint8_t led_red_owners;
+BUILD_ASSERT(COMPARTMENT_COUNT <= 8);
+
+/* Reihenfolge wie state_t */
+static const char *const state_names[] = {
+    "geschlossen",        "paket_offen", "brief_offen",        "paket_gesperrt",
+    "paket_sicher_offen", "warten",      "rfid_programmieren",
+};
+
+int push_command(uint8_t fach, command_t command) {
+  if (fach >= COMPARTMENT_COUNT) {
+    return -EINVAL;
+  }
+  trace_event(TRACE_CMD_PUSH, command | (fach << 8));
+  /* Die Pipe fasst einen Befehl, der vorige ist noch nicht abgeholt */
+  if (k_pipe_write(faecher[fach].command_pipe, (uint8_t *)&command,
+                   sizeof(command_t), K_NO_WAIT) != sizeof(command_t)) {
+    return -EBUSY;
+  }
+  return 0;
+}
+
+static void set_state(uint8_t fach, state_t next) {
+  fach_t *f = &faecher[fach];
+  struct telemetry_state telemetry = {
+      .from = f->current_state, .to = next, .fach = fach};
+
+  if (next != f->current_state) {
+    telemetry_send(TELEMETRY_STATE, &telemetry, sizeof(telemetry));
+    f->current_state = next;
+  }
+}
 
-// FIFO für die Befehle
-K_PIPE_DEFINE(command_pipe, sizeof(command_t), 2);
+static void warten_led_release(uint8_t fach) {
+  if (!faecher[fach].warten.led) {
+    return;
+  }
+  faecher[fach].warten.led = false;
+  led_red_owners &= ~BIT(fach);
+  /* Ein laufendes Muster (z.B. Karte gewählt im Programmiermodus) bleibt
+     stehen */
+  if (led_red_owners == 0 && !led_pattern_running(LED_RED)) {
+    led_red_off();
+  }
+}
 
-void push_command(command_t command) {
-  k_pipe_write(&command_pipe, (uint8_t *)&command, sizeof(command_t),
-               K_NO_WAIT);
+void states_led_red_pattern_stop(void) {
+  led_pattern_stop(LED_RED, led_red_owners != 0);
 }
 
-void goto_warten(bool *condition, state_t next, bool led) {
-  warten.condition = condition;
-  warten.next_state = next;
-  current_state = STATE_WARTEN;
+static void goto_warten(uint8_t fach, bool *condition, state_t next,
+                        bool led) {
+  warten_led_release(fach);
+  faecher[fach].warten.condition = condition;
+  faecher[fach].warten.next_state = next;
+  faecher[fach].warten.led = led;
+  set_state(fach, STATE_WARTEN);
   // LED rot einschalten
   if (led) {
+    led_red_owners |= BIT(fach);
     led_red_on();
   }
 }
 
-static void timeout_handler(struct k_timer *timer_id);
+static void timeout_handler(struct k_timer *timer_id) {
+  fach_t *f = k_timer_user_data_get(timer_id);
 
-K_TIMER_DEFINE(timer, timeout_handler, NULL);
-static bool timeout = false;
+  f->timeout = true;
+}
 
-void timeout_handler(struct k_timer *timer_id) { timeout = true; }
+static int start_timer(uint8_t fach, uint32_t time_ms) {
+  fach_t *f = &faecher[fach];
 
-int start_timer(uint32_t time_ms) {
-  timeout = false;
-  k_timer_user_data_set(&timer, NULL);
-  k_timer_start(&timer, K_MSEC(time_ms), K_NO_WAIT);
+  f->timeout = false;
+  k_timer_user_data_set(f->timer, f);
+  k_timer_start(f->timer, K_MSEC(time_ms), K_NO_WAIT);
 
   return 0;
 }
 
 // Funktion zum Verarbeiten von Befehlen in der FIFO
-void process_commands() {
+static void process_commands(uint8_t fach) {
+  fach_t *f = &faecher[fach];
   command_t cmd;
-  if (k_pipe_read(&command_pipe, (uint8_t *)&cmd, sizeof(command_t),
+
+  if (k_pipe_read(f->command_pipe, (uint8_t *)&cmd, sizeof(command_t),
                   K_NO_WAIT) == sizeof(command_t)) {
+    trace_event(TRACE_CMD_POP, cmd | (fach << 8));
     switch (cmd) {
     case CMD_OEFFNE_PAKET:
-      if (current_state == STATE_GESCHLOSSEN) {
-        goto_warten(get_paket_auf(), STATE_PAKET_OFFEN, false);
-        motor_set(MOTOR_ZUR, 3, get_paket_auf());
+      if (f->current_state == STATE_GESCHLOSSEN) {
+        audit_log(AUDIT_OPEN_PAKET, 0, AUDIT_FACH(fach, f->current_state));
+        health_opening(fach);
+        goto_warten(fach, get_paket_auf(fach), STATE_PAKET_OFFEN, false);
+        motor_set(fach, MOTOR_ZUR, config_get()->motor_timeout_s,
+                  get_paket_auf(fach));
       } else {
         // STATE_PAKET_GESPERRT: Das Paket muss erst vom Besitzer herausgenommen
         // werden
-        start_timer(1000);
-        goto_warten(&timeout, STATE_PAKET_GESPERRT, true);
+        audit_log(AUDIT_LOCKOUT, 0, AUDIT_FACH(fach, f->current_state));
+        start_timer(fach, 1000);
+        goto_warten(fach, &f->timeout, STATE_PAKET_GESPERRT, true);
       }
       break;
 
     case CMD_OEFFNE_BRIEF:
-      goto_warten(get_brief_auf(), STATE_BRIEF_OFFEN, false);
-      motor_set(MOTOR_ZUR, 3, get_brief_auf());
+      audit_log(AUDIT_OPEN_BRIEF, 0, AUDIT_FACH(fach, f->current_state));
+      health_opening(fach);
+      goto_warten(fach, get_brief_auf(fach), STATE_BRIEF_OFFEN, false);
+      motor_set(fach, MOTOR_ZUR, config_get()->motor_timeout_s,
+                get_brief_auf(fach));
       break;
 
     default:
-      printk("Unbekannter Befehl\n");
+      LOG_WRN("Unbekannter Befehl");
       break;
     }
   } else {
@@ -97,63 +192,66 @@ void process_commands() {
   }
 }
 
-void process_rfid_programming(void) {
+static void fach_state_machine(uint8_t fach) {
+  fach_t *f = &faecher[fach];
 
-}
-
-void state_machine(void) {
-  switch (current_state) {
+  switch (f->current_state) {
   case STATE_GESCHLOSSEN:
     // Logik für den Zustand "geschlossen"
     if (get_jumper_bit() == 0 ) {
-		current_state = STATE_RFID_PROGRAMMIEREN;
+		set_state(fach, STATE_RFID_PROGRAMMIEREN);
 		break;
     }
-    process_commands(); // Ankommende Befehle verarbeiten
+    process_commands(fach); // Ankommende Befehle verarbeiten
     break;
 
   case STATE_PAKET_OFFEN:
     // Logik für den Zustand "paket_offen"
     powermanager_trigger();
-    motor_set(MOTOR_VOR, 3, get_kasten_zu());
-    k_pipe_reset(&command_pipe); // Pipe leeren
-    goto_warten(get_kasten_zu(), STATE_PAKET_GESPERRT, false);
+    motor_set(fach, MOTOR_VOR, config_get()->motor_timeout_s,
+              get_kasten_zu(fach));
+    k_pipe_reset(f->command_pipe); // Pipe leeren
+    goto_warten(fach, get_kasten_zu(fach), STATE_PAKET_GESPERRT, false);
     break;
 
   case STATE_BRIEF_OFFEN:
     // Logik für den Zustand "brief_offen"
     powermanager_trigger();
-    motor_set(MOTOR_VOR, 3, get_kasten_zu());
-    k_pipe_reset(&command_pipe); // Pipe leeren
-    goto_warten(get_kasten_zu(), STATE_GESCHLOSSEN, false);
+    motor_set(fach, MOTOR_VOR, config_get()->motor_timeout_s,
+              get_kasten_zu(fach));
+    k_pipe_reset(f->command_pipe); // Pipe leeren
+    goto_warten(fach, get_kasten_zu(fach), STATE_GESCHLOSSEN, false);
     break;
 
   case STATE_PAKET_GESPERRT:
     // Logik für den Zustand "paket_gesperrt"
-    process_commands(); // Ankommende Befehle verarbeiten
+    process_commands(fach); // Ankommende Befehle verarbeiten
     break;
 
   case STATE_PAKET_SICHER_OFFEN:
     // Logik für den Zustand "paket_sicher_offen"
-    printk("State: paket_sicher_offen\n");
+    LOG_INF("Fach %u State: paket_sicher_offen", fach);
     break;
 
   case STATE_WARTEN:
     powermanager_trigger();
-    if (*(warten.condition)) {
-      current_state = warten.next_state;
-      led_red_off();
+    if (*(f->warten.condition)) {
+      set_state(fach, f->warten.next_state);
+      warten_led_release(fach);
     }
     break;
 
   case STATE_RFID_PROGRAMMIEREN:
+    /* Der Jumper gilt für alle Fächer, jedes geschlossene Fach wechselt in
+       den Programmiermodus */
     rfid_set_programming_mode();
     powermanager_trigger();
-    led_green_toggle();
-    start_timer(100);
-    goto_warten(&timeout, STATE_RFID_PROGRAMMIEREN, false);
+    /* Blinken läuft im LED-Timer, der Hauptthread prüft nur den Jumper */
+    led_pattern_play(LED_GREEN, &led_pattern_blink);
+    start_timer(fach, 100);
+    goto_warten(fach, &f->timeout, STATE_RFID_PROGRAMMIEREN, false);
     if (get_jumper_bit() == 1 ) {
-	current_state = STATE_GESCHLOSSEN;
+	set_state(fach, STATE_GESCHLOSSEN);
 	rfid_set_normal_mode();
 	led_green_on();
     }
@@ -161,7 +259,29 @@ void state_machine(void) {
 
   default:
     // Unbekannter Zustand
-    printk("Unbekannter Zustand\n");
+    LOG_ERR("Unbekannter Zustand");
     break;
   }
 }
+
+void state_machine(void) {
+  for (uint8_t fach = 0; fach < COMPARTMENT_COUNT; fach++) {
+    fach_state_machine(fach);
+  }
+}
+
+uint8_t states_get(uint8_t fach) {
+  return fach < COMPARTMENT_COUNT ? faecher[fach].current_state : 0xff;
+}
+
+void states_print(void) {
+  for (uint8_t fach = 0; fach < COMPARTMENT_COUNT; fach++) {
+    /* Kein Hallsensor aktiv: Schloss zwischen den Endlagen oder noch keine
+       Flanke seit dem Start */
+    printk("Fach %u: %s, %s\n", fach, state_names[faecher[fach].current_state],
+           *get_kasten_zu(fach)   ? "zu"
+           : *get_paket_auf(fach) ? "paket auf"
+           : *get_brief_auf(fach) ? "brief auf"
+                                  : "unbekannt");
+  }
+}
@@ -8,12 +8,28 @@
 #ifndef STATES_H
 #define STATES_H
 
+#include <stdint.h>
+
 typedef enum {
   CMD_OEFFNE_PAKET,
   CMD_OEFFNE_BRIEF,
 } command_t;
 
-void push_command(command_t command);
+/* Befehl an ein Fach, -EINVAL für ein unbekanntes Fach, -EBUSY wenn der
+   vorige Befehl noch nicht abgeholt ist */
+int push_command(uint8_t fach, command_t command);
+
+/* Zustandsautomaten aller Fächer einmal durchlaufen, aus der Hauptschleife */
 void state_machine(void);
 
+/* Aktueller Zustand (state_t) eines Fachs, 0xff für ein unbekanntes Fach */
+uint8_t states_get(uint8_t fach);
+
+/* Muster auf der roten LED beenden. Die LED bleibt an, solange ein Fach sie
+   anzeigt. */
+void states_led_red_pattern_stop(void);
+
+/* Zustand und Hallsensoren aller Fächer ausgeben */
+void states_print(void);
+
 #endif // STATES_H
\ No newline at end of file
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "stats.h"
+#include <zephyr/kernel.h>
+
+void stats_hist_init(struct stats_hist *h, uint32_t first, uint32_t width) {
+  memset(h, 0, sizeof(*h));
+  h->min = UINT32_MAX;
+  h->first = first;
+  h->width = width;
+}
+
+void stats_hist_add(struct stats_hist *h, uint32_t value) {
+  uint32_t bin;
+
+  h->count++;
+  h->sum += value;
+  h->min = MIN(h->min, value);
+  h->max = MAX(h->max, value);
+
+  if (value < h->first) {
+    bin = 0;
+  } else {
+    bin = MIN((value - h->first) / h->width + 1, STATS_HIST_BINS - 1);
+  }
+  /* Bins sättigen statt überzulaufen */
+  if (h->bins[bin] < UINT16_MAX) {
+    h->bins[bin]++;
+  }
+}
+
+void stats_hist_print(const char *name, const char *unit,
+                      const struct stats_hist *h) {
+  if (h->count == 0) {
+    printk("%s: -\n", name);
+    return;
+  }
+
+  printk("%s: n=%u min=%u avg=%u max=%u %s |", name, h->count, h->min,
+         (uint32_t)(h->sum / h->count), h->max, unit);
+  for (int i = 0; i < STATS_HIST_BINS; i++) {
+    printk(" %u", h->bins[i]);
+  }
+  printk(" | <%u +%u\n", h->first, h->width);
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#define STATS_HIST_BINS 8
+
+/**
+ * @brief Laufzeitstatistik mit linearem Histogramm
+ *
+ * Bin 0 zählt Werte unterhalb von first, der letzte Bin alle Werte oberhalb
+ * des Bereichs. Die Bins dazwischen sind width breit.
+ */
+struct stats_hist {
+  uint64_t sum;
+  uint32_t min;
+  uint32_t max;
+  uint32_t count;
+  uint32_t first;
+  uint32_t width;
+  uint16_t bins[STATS_HIST_BINS];
+};
+
+void stats_hist_init(struct stats_hist *h, uint32_t first, uint32_t width);
+void stats_hist_add(struct stats_hist *h, uint32_t value);
+
+/**
+ * @brief Gib die Statistik einzeilig auf der Konsole aus
+ *
+ * @param name Bezeichnung der Messgröße
+ * @param unit Einheit der Werte, z.B. "us"
+ */
+void stats_hist_print(const char *name, const char *unit,
+                      const struct stats_hist *h);
+
+#endif // STATS_H
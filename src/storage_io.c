@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "storage_io.h"
+#include <zephyr/drivers/eeprom.h>
+#include <zephyr/kernel.h>
+
+/* Beide AT25 haben dieselbe Seitengröße. Der Treiber wartet nach jeder
+   Seite per Statusabfrage (WIP) statt einer festen Zeit. DMA ist auf spi2
+   nicht möglich, DMA1 Kanal 4/5 gehören auf dem STM32L1 auch zu usart1. */
+#define STORAGE_PAGE_SIZE DT_PROP(DT_NODELABEL(eeprom0), pagesize)
+#define STORAGE_RA_PAGES CONFIG_PAKETKASTEN_STORAGE_READAHEAD_PAGES
+
+BUILD_ASSERT(DT_PROP(DT_NODELABEL(eeprom0), pagesize) ==
+                 DT_PROP(DT_NODELABEL(eeprom1), pagesize),
+             "both EEPROMs must have the same page size");
+
+/* Vorausgelesener Block */
+static struct {
+  const struct device *dev;
+  uint32_t offset;
+  uint32_t len;
+  uint8_t data[STORAGE_RA_PAGES * STORAGE_PAGE_SIZE];
+} storage_ra;
+
+/* Ende des letzten Lesezugriffs, erkennt sequentielles Lesen */
+static const struct device *storage_last_dev;
+static uint32_t storage_last_end;
+
+static struct {
+  uint32_t reads;
+  uint32_t read_bytes;
+  uint32_t ra_hits;
+  uint32_t ra_bursts;
+  uint32_t writes;
+  uint32_t page_writes;
+} storage_stats;
+
+K_MUTEX_DEFINE(storage_lock);
+
+static bool storage_ra_contains(const struct device *dev, uint32_t offset,
+                                size_t len) {
+  return storage_ra.dev == dev && offset >= storage_ra.offset &&
+         offset + len <= storage_ra.offset + storage_ra.len;
+}
+
+static int storage_ra_fill(const struct device *dev, uint32_t offset) {
+  size_t size = eeprom_get_size(dev);
+  uint32_t len = MIN(sizeof(storage_ra.data), size - offset);
+  int ret;
+
+  storage_ra.dev = NULL;
+  ret = eeprom_read(dev, offset, storage_ra.data, len);
+  if (ret < 0) {
+    return ret;
+  }
+  storage_ra.dev = dev;
+  storage_ra.offset = offset;
+  storage_ra.len = len;
+  storage_stats.ra_bursts++;
+  return 0;
+}
+
+int storage_io_read(const struct device *dev, uint32_t offset, void *buf,
+                    size_t len) {
+  bool whole_page = (offset % STORAGE_PAGE_SIZE) == 0 &&
+                    (len % STORAGE_PAGE_SIZE) == 0 && len > 0 &&
+                    len <= sizeof(storage_ra.data);
+  int ret = 0;
+
+  k_mutex_lock(&storage_lock, K_FOREVER);
+  storage_stats.reads++;
+  storage_stats.read_bytes += len;
+
+  if (storage_ra_contains(dev, offset, len)) {
+    storage_stats.ra_hits++;
+  } else if (whole_page && dev == storage_last_dev &&
+             offset == storage_last_end) {
+    /* Sequentiell: die folgenden Seiten gleich mitlesen */
+    ret = storage_ra_fill(dev, offset);
+  } else {
+    ret = eeprom_read(dev, offset, buf, len);
+    goto out;
+  }
+
+  if (ret == 0) {
+    memcpy(buf, &storage_ra.data[offset - storage_ra.offset], len);
+  }
+
+out:
+  storage_last_dev = dev;
+  storage_last_end = offset + len;
+  k_mutex_unlock(&storage_lock);
+  return ret;
+}
+
+int storage_io_write(const struct device *dev, uint32_t offset,
+                     const void *buf, size_t len) {
+  const uint8_t *src = buf;
+  size_t chunk;
+  int ret = 0;
+
+  k_mutex_lock(&storage_lock, K_FOREVER);
+  storage_stats.writes++;
+
+  if (storage_ra.dev == dev && offset < storage_ra.offset + storage_ra.len &&
+      offset + len > storage_ra.offset) {
+    storage_ra.dev = NULL;
+  }
+
+  while (len > 0) {
+    /* Nie über eine Seitengrenze schreiben */
+    chunk = MIN(len, STORAGE_PAGE_SIZE - offset % STORAGE_PAGE_SIZE);
+    ret = eeprom_write(dev, offset, src, chunk);
+    if (ret < 0) {
+      break;
+    }
+    storage_stats.page_writes++;
+    offset += chunk;
+    src += chunk;
+    len -= chunk;
+  }
+
+  k_mutex_unlock(&storage_lock);
+  return ret;
+}
+
+void storage_io_print_stats(void) {
+  printk("Storage: reads %u (%u bytes), read-ahead bursts %u, hits %u, "
+         "writes %u (%u pages)\n",
+         storage_stats.reads, storage_stats.read_bytes,
+         storage_stats.ra_bursts, storage_stats.ra_hits, storage_stats.writes,
+         storage_stats.page_writes);
+}
+
+#ifdef CONFIG_PAKETKASTEN_STORAGE_BENCHMARK
+/* Gemessen wird auf eeprom0 ab Seite 1 (Seite 0 enthält die Köpfe) */
+#define STORAGE_BENCH_FIRST 1
+#define STORAGE_BENCH_PAGES 64
+#define STORAGE_BENCH_WRITES 16
+
+#define STORAGE_BENCH_OFFSET(p) ((STORAGE_BENCH_FIRST + (p)) * STORAGE_PAGE_SIZE)
+
+static void storage_bench_print(const char *name, uint32_t bytes,
+                                uint32_t us) {
+  printk("%-8s %6u bytes %8u us %6u bytes/s\n", name, bytes, us,
+         (uint32_t)((uint64_t)bytes * USEC_PER_SEC / MAX(us, 1U)));
+}
+
+static uint32_t storage_bench_us(uint32_t start) {
+  return k_cyc_to_us_floor32(k_cycle_get_32() - start);
+}
+
+void storage_io_benchmark(void) {
+  const struct device *dev = DEVICE_DT_GET(DT_NODELABEL(eeprom0));
+  uint8_t page[STORAGE_PAGE_SIZE];
+  uint32_t start;
+  uint32_t us;
+  int ret = 0;
+
+  /* Sperre über die ganze Messung: Zurückschreiben des gelesenen Inhalts
+     kann keine Änderung eines anderen Threads überschreiben */
+  k_mutex_lock(&storage_lock, K_FOREVER);
+
+  /* Einzelne Seiten direkt vom Treiber */
+  start = k_cycle_get_32();
+  for (int p = 0; p < STORAGE_BENCH_PAGES && ret == 0; p++) {
+    ret = eeprom_read(dev, STORAGE_BENCH_OFFSET(p), page, sizeof(page));
+  }
+  storage_bench_print("read", STORAGE_BENCH_PAGES * STORAGE_PAGE_SIZE,
+                      storage_bench_us(start));
+
+  /* Dieselben Seiten mit Vorauslesen */
+  storage_ra.dev = NULL;
+  storage_last_dev = NULL;
+  start = k_cycle_get_32();
+  for (int p = 0; p < STORAGE_BENCH_PAGES && ret == 0; p++) {
+    ret = storage_io_read(dev, STORAGE_BENCH_OFFSET(p), page, sizeof(page));
+  }
+  storage_bench_print("read-ra", STORAGE_BENCH_PAGES * STORAGE_PAGE_SIZE,
+                      storage_bench_us(start));
+
+  /* Nur die Schreibzugriffe messen, der Inhalt bleibt gleich */
+  us = 0;
+  for (int p = 0; p < STORAGE_BENCH_WRITES && ret == 0; p++) {
+    ret = eeprom_read(dev, STORAGE_BENCH_OFFSET(p), page, sizeof(page));
+    if (ret == 0) {
+      start = k_cycle_get_32();
+      ret = eeprom_write(dev, STORAGE_BENCH_OFFSET(p), page, sizeof(page));
+      us += storage_bench_us(start);
+    }
+  }
+  storage_bench_print("write", STORAGE_BENCH_WRITES * STORAGE_PAGE_SIZE, us);
+
+  /* Gemischt: pro Seite lesen und zurückschreiben */
+  start = k_cycle_get_32();
+  for (int p = 0; p < STORAGE_BENCH_WRITES && ret == 0; p++) {
+    ret = eeprom_read(dev, STORAGE_BENCH_OFFSET(p), page, sizeof(page));
+    if (ret == 0) {
+      ret = eeprom_write(dev, STORAGE_BENCH_OFFSET(p), page, sizeof(page));
+    }
+  }
+  storage_bench_print("mixed", 2 * STORAGE_BENCH_WRITES * STORAGE_PAGE_SIZE,
+                      storage_bench_us(start));
+
+  storage_ra.dev = NULL;
+  k_mutex_unlock(&storage_lock);
+
+  if (ret < 0) {
+    printk("Benchmark failed: %d\n", ret);
+  }
+}
+#else
+void storage_io_benchmark(void) {
+  printk("Benchmark needs CONFIG_PAKETKASTEN_STORAGE_BENCHMARK\n");
+}
+#endif
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef STORAGE_IO_H
+#define STORAGE_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/device.h>
+
+/**
+ * @brief Aus einem AT25 lesen
+ *
+ * Ganze Seiten, die direkt an den vorherigen Zugriff anschließen, werden in
+ * einem Block von CONFIG_PAKETKASTEN_STORAGE_READAHEAD_PAGES Seiten
+ * vorausgelesen. Kürzere Zugriffe (z.B. Seitenköpfe) gehen direkt an das
+ * EEPROM.
+ *
+ * @return 0 bei Erfolg, sonst negativer Fehler
+ */
+int storage_io_read(const struct device *dev, uint32_t offset, void *buf,
+                    size_t len);
+
+/**
+ * @brief In einen AT25 schreiben
+ *
+ * Teilt den Zugriff an Seitengrenzen, jede Teilseite ist ein
+ * Programmierzyklus. Betroffene Seiten im Lesepuffer werden verworfen.
+ *
+ * @return 0 bei Erfolg, sonst negativer Fehler
+ */
+int storage_io_write(const struct device *dev, uint32_t offset,
+                     const void *buf, size_t len);
+
+void storage_io_print_stats(void);
+
+/**
+ * @brief Durchsatz messen
+ *
+ * Liest eeprom0 sequentiell und schreibt Seiten mit ihrem eigenen Inhalt
+ * zurück, gespeicherte Daten bleiben erhalten. Läuft einige Sekunden.
+ */
+void storage_io_benchmark(void);
+
+#endif // STORAGE_IO_H
@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "telemetry.h"
+#include "cobs.h"
+#include <string.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/printk-hooks.h>
+#include <zephyr/sys/ring_buffer.h>
+
+/* Rahmen vor der Kodierung:
+ *   Kanal (1), Folgenummer (1), Uptime in ms (4), Nutzdaten, CRC16 (2)
+ * CRC-16/CCITT (0x1021, Start 0xffff) über alles davor. Der Rahmen wird
+ * COBS-kodiert und mit 0x00 abgeschlossen, 0x00 kommt sonst nicht vor. So
+ * findet der Host nach Textausgaben oder verlorenen Bytes wieder den
+ * Anfang. */
+#define TELEMETRY_RAW_MAX                                                      \
+  (sizeof(struct telemetry_header) + TELEMETRY_DATA_MAX + sizeof(uint16_t))
+#define TELEMETRY_FRAME_MAX COBS_ENCODED_MAX(TELEMETRY_RAW_MAX)
+
+/* Textausgaben (printk) laufen zeilenweise durch denselben Sendepuffer wie
+   die Rahmen. Würde printk per uart_poll_out senden, mischte der
+   STM32-Treiber die Zeichen in eine laufende DMA-Übertragung. Eine Zeile
+   landet als Ganzes im Puffer, so trennt der Host Text und Rahmen an den
+   Zeilenenden. Ein Thread hält telemetry_line_mutex vom ersten Zeichen bis
+   zum Zeilenende, Ausgaben aus einem ISR gehen direkt in den Puffer. */
+#define TELEMETRY_LINE_MAX 80
+
+struct telemetry_header {
+  uint8_t channel;
+  uint8_t seq;
+  uint32_t time_ms;
+} __packed;
+
+BUILD_ASSERT(sizeof(struct telemetry_motor) <= TELEMETRY_DATA_MAX);
+BUILD_ASSERT(sizeof(struct telemetry_state) <= TELEMETRY_DATA_MAX);
+BUILD_ASSERT(sizeof(struct telemetry_rfid) <= TELEMETRY_DATA_MAX);
+
+static const struct device *uart_dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_console));
+
+RING_BUF_DECLARE(telemetry_buf, CONFIG_PAKETKASTEN_TELEMETRY_BUFFER);
+static struct k_spinlock telemetry_lock;
+static uint32_t telemetry_channels = CONFIG_PAKETKASTEN_TELEMETRY_CHANNELS;
+static uint8_t telemetry_seq;
+static bool telemetry_tx_busy;
+static bool telemetry_started; // UART-Callback gesetzt, DMA erlaubt
+/* Nach einem Panic wird synchron per uart_poll_out gesendet, ein
+   DMA-Ende käme dort nie an */
+static bool telemetry_panic_mode;
+
+static K_MUTEX_DEFINE(telemetry_line_mutex);
+static k_tid_t telemetry_line_owner;
+static uint8_t telemetry_line[TELEMETRY_LINE_MAX];
+static uint8_t telemetry_line_len;
+
+static struct {
+  uint32_t frames;
+  uint32_t dropped;
+  uint32_t bytes;
+  uint32_t peak; // höchster Füllstand des Sendepuffers
+  uint32_t text_dropped; // verworfene Textzeichen
+} telemetry_stats;
+
+/* Nächsten zusammenhängenden Teil des Puffers per DMA senden, nur mit
+   telemetry_lock aufrufen */
+static void telemetry_tx_start(void) {
+  uint8_t *data;
+  uint32_t len;
+
+  if (telemetry_tx_busy || !telemetry_started || telemetry_panic_mode) {
+    return;
+  }
+
+  len = ring_buf_get_claim(&telemetry_buf, &data,
+                           CONFIG_PAKETKASTEN_TELEMETRY_BUFFER);
+  if (len == 0) {
+    return;
+  }
+  if (uart_tx(uart_dev, data, len, SYS_FOREVER_US) == 0) {
+    telemetry_tx_busy = true;
+  } else {
+    /* Später mit dem nächsten Rahmen erneut versuchen */
+    ring_buf_get_finish(&telemetry_buf, 0);
+  }
+}
+
+static void telemetry_poll_out(const uint8_t *data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    uart_poll_out(uart_dev, data[i]);
+  }
+}
+
+/* Füllstand nach einem Schreiben, nur mit telemetry_lock aufrufen */
+static void telemetry_put_done(void) {
+  uint32_t used = CONFIG_PAKETKASTEN_TELEMETRY_BUFFER -
+                  ring_buf_space_get(&telemetry_buf);
+
+  telemetry_stats.peak = MAX(telemetry_stats.peak, used);
+  telemetry_tx_start();
+}
+
+/* Gesammelte Textzeile in den Sendepuffer schreiben, nur mit
+   telemetry_line_mutex aufrufen. Es wird auf Platz gewartet. */
+static void telemetry_line_flush(void) {
+  k_spinlock_key_t key = k_spin_lock(&telemetry_lock);
+
+  while (ring_buf_space_get(&telemetry_buf) < telemetry_line_len) {
+    if (telemetry_panic_mode || !telemetry_started) {
+      break;
+    }
+    k_spin_unlock(&telemetry_lock, key);
+    k_msleep(1);
+    key = k_spin_lock(&telemetry_lock);
+  }
+  if (telemetry_panic_mode) {
+    telemetry_poll_out(telemetry_line, telemetry_line_len);
+  } else if (ring_buf_space_get(&telemetry_buf) < telemetry_line_len) {
+    telemetry_stats.text_dropped += telemetry_line_len;
+  } else {
+    ring_buf_put(&telemetry_buf, telemetry_line, telemetry_line_len);
+    telemetry_put_done();
+  }
+  telemetry_line_len = 0;
+  k_spin_unlock(&telemetry_lock, key);
+}
+
+/* Zeichen aus einem ISR oder nach einem Panic direkt ausgeben. Ein ISR wird
+   von keinem Thread unterbrochen, seine Zeile bleibt zusammen. Bei vollem
+   Puffer wird das Zeichen verworfen. */
+static void telemetry_char_direct(uint8_t c) {
+  k_spinlock_key_t key = k_spin_lock(&telemetry_lock);
+
+  if (telemetry_panic_mode) {
+    telemetry_poll_out(&c, 1);
+  } else if (ring_buf_put(&telemetry_buf, &c, 1) == 0) {
+    telemetry_stats.text_dropped++;
+  } else if (c == '\n') {
+    telemetry_put_done();
+  }
+  k_spin_unlock(&telemetry_lock, key);
+}
+
+static int telemetry_char_out(int c) {
+  k_tid_t self;
+
+  /* 0x00 beendet Rahmen und darf im Text nicht vorkommen */
+  if (c == '\0') {
+    return c;
+  }
+  if (k_is_in_isr() || telemetry_panic_mode) {
+    telemetry_char_direct(c);
+    return c;
+  }
+
+  self = k_current_get();
+  if (telemetry_line_owner != self) {
+    /* Wartet, bis ein anderer Thread seine Zeile abgeschlossen hat */
+    k_mutex_lock(&telemetry_line_mutex, K_FOREVER);
+    telemetry_line_owner = self;
+  }
+  telemetry_line[telemetry_line_len++] = c;
+  if (c == '\n' || telemetry_line_len == TELEMETRY_LINE_MAX) {
+    telemetry_line_flush();
+  }
+  if (c == '\n') {
+    telemetry_line_owner = NULL;
+    k_mutex_unlock(&telemetry_line_mutex);
+  }
+  return c;
+}
+
+/* Rahmen kodieren und in den Sendepuffer schreiben. Mit drop wird ein Rahmen,
+   der nicht passt, verworfen, sonst kommt -ENOBUFS ohne Folgenummer zurück. */
+static int telemetry_put(telemetry_channel_t channel, const void *data,
+                         size_t len, bool drop) {
+  uint8_t raw[TELEMETRY_RAW_MAX];
+  uint8_t frame[TELEMETRY_FRAME_MAX];
+  struct telemetry_header *hdr = (struct telemetry_header *)raw;
+  k_spinlock_key_t key;
+  uint16_t crc;
+  size_t n;
+  int ret = 0;
+
+  /* Log-Meldungen werden über den Log-Level gefiltert */
+  if (channel != TELEMETRY_LOG && !(telemetry_channels & BIT(channel))) {
+    return 0;
+  }
+  if (len > TELEMETRY_DATA_MAX) {
+    return -EINVAL;
+  }
+
+  hdr->channel = channel;
+  hdr->time_ms = k_uptime_get_32();
+  memcpy(raw + sizeof(*hdr), data, len);
+  len += sizeof(*hdr);
+
+  key = k_spin_lock(&telemetry_lock);
+  hdr->seq = telemetry_seq;
+  crc = crc16_itu_t(0xffff, raw, len);
+  raw[len++] = crc & 0xff;
+  raw[len++] = crc >> 8;
+  n = cobs_encode(raw, len, frame);
+
+  if (telemetry_panic_mode) {
+    telemetry_poll_out(frame, n);
+    telemetry_seq++;
+    telemetry_stats.frames++;
+  } else if (ring_buf_space_get(&telemetry_buf) < n) {
+    ret = -ENOBUFS;
+    if (drop) {
+      /* Auch verworfene Rahmen zählen, damit der Host die Lücke sieht */
+      telemetry_seq++;
+      telemetry_stats.dropped++;
+    }
+  } else {
+    ring_buf_put(&telemetry_buf, frame, n);
+    telemetry_seq++;
+    telemetry_stats.frames++;
+    telemetry_put_done();
+  }
+  k_spin_unlock(&telemetry_lock, key);
+
+  return ret;
+}
+
+int telemetry_send(telemetry_channel_t channel, const void *data, size_t len) {
+  return telemetry_put(channel, data, len, true);
+}
+
+int telemetry_send_wait(telemetry_channel_t channel, const void *data,
+                        size_t len, uint32_t timeout_ms) {
+  int ret;
+
+  while ((ret = telemetry_put(channel, data, len, false)) == -ENOBUFS) {
+    if (timeout_ms == 0) {
+      /* Letzter Versuch, ein verworfener Rahmen zählt als Lücke */
+      return telemetry_put(channel, data, len, true);
+    }
+    /* Eine Millisekunde reicht bei 115200 Baud für etwa 11 Bytes */
+    k_msleep(1);
+    timeout_ms--;
+  }
+  return ret;
+}
+
+void telemetry_tx_done(size_t len) {
+  k_spinlock_key_t key = k_spin_lock(&telemetry_lock);
+
+  if (telemetry_tx_busy) {
+    ring_buf_get_finish(&telemetry_buf, len);
+    telemetry_stats.bytes += len;
+    telemetry_tx_busy = false;
+    telemetry_tx_start();
+  }
+  k_spin_unlock(&telemetry_lock, key);
+}
+
+void telemetry_panic(void) {
+  k_spinlock_key_t key = k_spin_lock(&telemetry_lock);
+  bool busy = telemetry_tx_busy;
+  uint8_t *data;
+  uint32_t len;
+
+  telemetry_panic_mode = true;
+  k_spin_unlock(&telemetry_lock, key);
+
+  /* Der Abbruch kann telemetry_tx_done() direkt aufrufen, deshalb ohne
+     Sperre */
+  if (busy) {
+    uart_tx_abort(uart_dev);
+  }
+
+  key = k_spin_lock(&telemetry_lock);
+  if (telemetry_tx_busy) {
+    /* Kein Callback mehr: den laufenden Teil noch einmal senden, der Host
+       verwirft den doppelten Anfang per CRC */
+    ring_buf_get_finish(&telemetry_buf, 0);
+    telemetry_tx_busy = false;
+  }
+  while ((len = ring_buf_get_claim(&telemetry_buf, &data,
+                                   CONFIG_PAKETKASTEN_TELEMETRY_BUFFER)) > 0) {
+    telemetry_poll_out(data, len);
+    ring_buf_get_finish(&telemetry_buf, len);
+  }
+  telemetry_poll_out(telemetry_line, telemetry_line_len);
+  telemetry_line_len = 0;
+  k_spin_unlock(&telemetry_lock, key);
+}
+
+void telemetry_start(void) {
+  k_spinlock_key_t key = k_spin_lock(&telemetry_lock);
+
+  telemetry_started = true;
+  telemetry_tx_start();
+  k_spin_unlock(&telemetry_lock, key);
+
+  __printk_hook_install(telemetry_char_out);
+}
+
+void telemetry_set_channels(uint32_t mask) {
+  telemetry_channels = mask & BIT_MASK(TELEMETRY_CHANNEL_COUNT);
+}
+
+void telemetry_print_stats(void) {
+  printk("Telemetry: channels 0x%x, frames %u, dropped %u, bytes %u, "
+         "buffer peak %u/%u, text dropped %u\n",
+         telemetry_channels, telemetry_stats.frames, telemetry_stats.dropped,
+         telemetry_stats.bytes, telemetry_stats.peak,
+         CONFIG_PAKETKASTEN_TELEMETRY_BUFFER, telemetry_stats.text_dropped);
+}
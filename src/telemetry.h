@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/toolchain.h>
+
+/* Maximale Nutzdaten eines Rahmens */
+#define TELEMETRY_DATA_MAX 48
+
+/* Reihenfolge und Nutzdaten müssen zu CHANNELS in scripts/telemetry_rx.py
+   passen */
+typedef enum {
+  TELEMETRY_MOTOR, // struct telemetry_motor, jeder Regelzyklus und Fach
+  TELEMETRY_STATE, // struct telemetry_state, jeder Zustandswechsel
+  TELEMETRY_RFID,  // struct telemetry_rfid, jede RFID-Phase
+  TELEMETRY_LOG,   // Log-Meldungen im Dictionary-Format (log_dict.c)
+  TELEMETRY_CHANNEL_COUNT
+} telemetry_channel_t;
+
+struct telemetry_motor {
+  uint16_t strom_ma;
+  uint16_t exec_us; // Laufzeit des Regelzyklus
+  uint8_t richtung;
+  uint8_t fach;
+} __packed;
+
+struct telemetry_state {
+  uint8_t from;
+  uint8_t to;
+  uint8_t fach;
+} __packed;
+
+struct telemetry_rfid {
+  uint32_t time;  // Dauer, Einheit wie in rfid_print_timing
+  uint8_t phase;
+  int8_t ret;
+} __packed;
+
+#ifdef CONFIG_PAKETKASTEN_TELEMETRY
+/**
+ * @brief Datensatz als Rahmen auf der Konsole senden
+ *
+ * Der Rahmen wird COBS-kodiert mit Folgenummer und CRC16 in einen
+ * Sendepuffer geschrieben, die Übertragung läuft per DMA. Ist der Kanal
+ * abgeschaltet, kostet der Aufruf nur einen Bitvergleich. Ist der Puffer
+ * voll, wird der Rahmen verworfen, die Lücke in der Folgenummer zeigt das
+ * auf dem Host an. Darf aus ISRs aufgerufen werden.
+ *
+ * @return 0 bei Erfolg oder abgeschaltetem Kanal, -ENOBUFS wenn verworfen
+ */
+int telemetry_send(telemetry_channel_t channel, const void *data, size_t len);
+
+/**
+ * @brief Datensatz senden, bei vollem Puffer bis zu timeout_ms warten
+ *
+ * Nur aus Threads mit niedriger Priorität, die warten dürfen.
+ *
+ * @return 0 bei Erfolg (auch bei abgeschaltetem Kanal), -ENOBUFS wenn der
+ *         Rahmen nach Ablauf verworfen wurde
+ */
+int telemetry_send_wait(telemetry_channel_t channel, const void *data,
+                        size_t len, uint32_t timeout_ms);
+
+/**
+ * @brief Senden per DMA freigeben
+ *
+ * Nach uart_callback_set() aufrufen, vorher sammeln sich die Rahmen nur im
+ * Puffer. Ab hier läuft auch printk zeilenweise durch den Sendepuffer, so
+ * greift nur noch ein Sendepfad auf den UART zu.
+ */
+void telemetry_start(void);
+
+/**
+ * @brief Auf synchrones Senden umschalten
+ *
+ * Bricht die DMA-Übertragung ab und sendet den Puffer per uart_poll_out.
+ * Danach gehen Rahmen und Text sofort und ohne Warten hinaus. Aus dem
+ * Panic-Handler des Log-Backends.
+ */
+void telemetry_panic(void);
+
+/* Kanäle als Bitmaske (1 << telemetry_channel_t) einschalten */
+void telemetry_set_channels(uint32_t mask);
+
+/* Aus dem UART-Callback nach einer abgeschlossenen DMA-Übertragung */
+void telemetry_tx_done(size_t len);
+
+void telemetry_print_stats(void);
+#else
+static inline int telemetry_send(telemetry_channel_t channel, const void *data,
+                                 size_t len) {
+  return 0;
+}
+static inline int telemetry_send_wait(telemetry_channel_t channel,
+                                      const void *data, size_t len,
+                                      uint32_t timeout_ms) {
+  return 0;
+}
+static inline void telemetry_start(void) {}
+static inline void telemetry_panic(void) {}
+static inline void telemetry_set_channels(uint32_t mask) {}
+static inline void telemetry_tx_done(size_t len) {}
+static inline void telemetry_print_stats(void) {}
+#endif
+
+#endif // TELEMETRY_H
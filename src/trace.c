@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "trace.h"
+#include <zephyr/kernel.h>
+
+/* Records pro Zeile in der Ausgabe */
+#define TRACE_DUMP_PER_LINE 4
+
+struct trace_record {
+  uint32_t cycles;
+  uint32_t arg;
+  uint8_t id;
+} __packed;
+
+static struct trace_record records[CONFIG_PAKETKASTEN_TRACE_RECORDS];
+static uint16_t head;     // nächster Schreibindex
+static uint16_t count;    // gültige Records
+static uint32_t overrun;  // überschriebene Records
+static bool paused;
+
+void trace_event(trace_id_t id, uint32_t arg) {
+  unsigned int key = irq_lock();
+  struct trace_record *r;
+
+  if (!paused) {
+    r = &records[head];
+    r->cycles = k_cycle_get_32();
+    r->arg = arg;
+    r->id = id;
+
+    head = (head + 1) % CONFIG_PAKETKASTEN_TRACE_RECORDS;
+    if (count < CONFIG_PAKETKASTEN_TRACE_RECORDS) {
+      count++;
+    } else {
+      overrun++;
+    }
+  }
+
+  irq_unlock(key);
+}
+
+void trace_dump(void) {
+  uint16_t start;
+  struct trace_record *r;
+
+  paused = true;
+
+  /* Kopfzeile: Takt des Zeitstempels, Anzahl, verlorene Records */
+  printk("TRACE %u %u %u\n", sys_clock_hw_cycles_per_sec(), count, overrun);
+
+  start = (head + CONFIG_PAKETKASTEN_TRACE_RECORDS - count) %
+          CONFIG_PAKETKASTEN_TRACE_RECORDS;
+  for (uint16_t i = 0; i < count; i++) {
+    r = &records[(start + i) % CONFIG_PAKETKASTEN_TRACE_RECORDS];
+    printk("%08x%02x%08x", r->cycles, r->id, r->arg);
+    printk((i % TRACE_DUMP_PER_LINE == TRACE_DUMP_PER_LINE - 1) ? "\n" : " ");
+  }
+  printk("\nTRACE END\n");
+
+  count = 0;
+  overrun = 0;
+  paused = false;
+}
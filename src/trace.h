@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/* Reihenfolge muss zu EVENTS in scripts/trace_decode.py passen */
+typedef enum {
+  TRACE_MOTOR_CYCLE,   // arg: richtung_soll, 2 Bit pro Fach
+  TRACE_ADC_DONE,      // arg: Summe der Motorströme in mA
+  TRACE_HALL_EDGE,     // arg: Pins, Fach ab Bit 16
+  TRACE_CMD_PUSH,      // arg: command_t, Fach ab Bit 8
+  TRACE_CMD_POP,       // arg: command_t, Fach ab Bit 8
+  TRACE_RFID_DETECT,   // arg: Status des Tag-Detektors
+  TRACE_RFID_RESET,    // arg: 0
+  TRACE_RFID_PROTOCOL, // arg: Rückgabewert
+  TRACE_RFID_REQUEST,  // arg: Rückgabewert
+  TRACE_RFID_SDD,      // arg: Rückgabewert
+  TRACE_RFID_LOOKUP,   // arg: 1 = bekannte UID
+  TRACE_POWER_SLEEP,   // arg: 0
+  TRACE_POWER_WAKEUP,  // arg: 0
+  TRACE_RFID_REMOVED,  // arg: Verweildauer der Karte in ms
+  TRACE_RFID_PARKED,   // arg: Verweildauer der Karte in ms
+} trace_id_t;
+
+#ifdef CONFIG_PAKETKASTEN_TRACE
+/**
+ * @brief Speichere ein Ereignis im Trace-Ringpuffer
+ *
+ * Darf aus ISRs aufgerufen werden. Kostet nur wenige Zyklen und keine
+ * Ausgabe auf der Konsole.
+ */
+void trace_event(trace_id_t id, uint32_t arg);
+
+/**
+ * @brief Gib den Ringpuffer hexkodiert auf der Konsole aus
+ *
+ * Während der Ausgabe wird nicht aufgezeichnet.
+ */
+void trace_dump(void);
+#else
+static inline void trace_event(trace_id_t id, uint32_t arg) {}
+static inline void trace_dump(void) {}
+#endif
+
+#endif // TRACE_H
@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "uidsync.h"
+#include "audit.h"
+#include "config.h"
+#include "eeprom.h"
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+LOG_MODULE_REGISTER(uidsync, CONFIG_PAKETKASTEN_LOG_LEVEL);
+
+/* Bytes pro Zeile bei der Ausgabe, passt mit "sync " in CONSOLE_LINE_MAX */
+#define UIDSYNC_EXPORT_LINE 21
+
+static struct {
+  bool active;
+  uint16_t version;
+  uint16_t count;
+  uint32_t crc;
+  uint16_t received;
+  uint32_t crc_received;
+  int error; // erster Fehler beim Übernehmen einer UID
+} sync;
+
+static struct {
+  uint32_t runs;
+  uint32_t failed;
+  uint16_t unchanged; // letzter Abgleich
+  uint16_t changed;
+  uint16_t removed;
+  uint32_t time_ms;
+  int64_t start;
+} sync_stats;
+
+/* Konsole und Bus können gleichzeitig abgleichen wollen */
+K_MUTEX_DEFINE(sync_lock);
+
+static void sync_stop(bool commit) {
+  int ret;
+
+  ret = eeprom_sync_end(commit);
+  if (commit && ret >= 0) {
+    sync_stats.removed = ret;
+  }
+  sync.active = false;
+  sync_stats.time_ms = k_uptime_get() - sync_stats.start;
+}
+
+int uidsync_begin(uint16_t version, uint16_t count, uint32_t crc) {
+  k_mutex_lock(&sync_lock, K_FOREVER);
+  if (sync.active && sync.version == version && sync.count == count &&
+      sync.crc == crc) {
+    k_mutex_unlock(&sync_lock);
+    return 0;
+  }
+  if (sync.active) {
+    LOG_WRN("UID sync to version %u aborted", sync.version);
+    sync_stop(false);
+    sync_stats.failed++;
+  }
+
+  sync.version = version;
+  sync.count = count;
+  sync.crc = crc;
+  sync.received = 0;
+  sync.crc_received = 0;
+  sync.error = 0;
+  sync_stats.unchanged = 0;
+  sync_stats.changed = 0;
+  sync_stats.removed = 0;
+  sync_stats.start = k_uptime_get();
+  eeprom_sync_begin();
+  sync.active = true;
+  k_mutex_unlock(&sync_lock);
+  return 0;
+}
+
+/* Prüft zuerst alle Datensätze, ein fehlerhafter Teil ändert nichts */
+static int sync_parse(const uint8_t *data, size_t len) {
+  size_t pos = 0;
+  int n = 0;
+
+  while (pos < len) {
+    if (pos + 2 > len || data[pos] == 0 || data[pos] > UID_MAX_LEN ||
+        data[pos + 1] == 0 || pos + 2 + data[pos] > len) {
+      return -EINVAL;
+    }
+    pos += 2 + data[pos];
+    n++;
+  }
+  return n;
+}
+
+int uidsync_data(uint16_t first, const uint8_t *data, size_t len) {
+  size_t pos = 0;
+  int n;
+  int ret;
+
+  k_mutex_lock(&sync_lock, K_FOREVER);
+  if (!sync.active) {
+    k_mutex_unlock(&sync_lock);
+    return -EINVAL;
+  }
+  if (first != sync.received) {
+    /* Wiederholung nach verlorener Quittung oder Lücke */
+    ret = first < sync.received ? sync.received : -EAGAIN;
+    k_mutex_unlock(&sync_lock);
+    return ret;
+  }
+  n = sync_parse(data, len);
+  if (n < 0 || sync.received + n > sync.count) {
+    k_mutex_unlock(&sync_lock);
+    return -EINVAL;
+  }
+
+  sync.crc_received = crc32_ieee_update(sync.crc_received, data, len);
+  sync.received += n;
+  for (; pos < len; pos += 2 + data[pos]) {
+    ret = eeprom_sync_uid(&data[pos + 2], data[pos], data[pos + 1]);
+    if (ret < 0) {
+      /* Weiter abgleichen, übernommen wird die Liste aber nicht */
+      if (sync.error == 0) {
+        LOG_ERR("UID sync failed: %d", ret);
+        sync.error = ret;
+      }
+    } else if (ret > 0) {
+      sync_stats.changed++;
+    } else {
+      sync_stats.unchanged++;
+    }
+  }
+  ret = sync.received;
+  k_mutex_unlock(&sync_lock);
+  return ret;
+}
+
+uint16_t uidsync_received(void) { return sync.received; }
+
+int uidsync_end(void) {
+  bool ok;
+  int ret;
+
+  k_mutex_lock(&sync_lock, K_FOREVER);
+  if (!sync.active) {
+    /* Wiederholung, die Liste ist schon übernommen */
+    ret = config_get()->uid_version == sync.version && sync_stats.runs > 0
+              ? 0
+              : -EINVAL;
+    k_mutex_unlock(&sync_lock);
+    return ret;
+  }
+
+  ok = sync.error == 0 && sync.received == sync.count &&
+       sync.crc_received == sync.crc;
+  sync_stop(ok);
+
+  if (!ok) {
+    sync_stats.failed++;
+    ret = sync.error != 0 ? sync.error : -EBADMSG;
+    LOG_WRN("UID sync to version %u rejected: %d", sync.version, ret);
+    k_mutex_unlock(&sync_lock);
+    return ret;
+  }
+
+  sync_stats.runs++;
+  config_set_uid_version(sync.version);
+  audit_log(AUDIT_UID_SYNC, sync.version,
+            MIN(sync_stats.changed + sync_stats.removed, UINT8_MAX));
+  LOG_INF("UID list version %u: %u changed, %u removed", sync.version,
+          sync_stats.changed, sync_stats.removed);
+  k_mutex_unlock(&sync_lock);
+  return 0;
+}
+
+void uidsync_abort(void) {
+  k_mutex_lock(&sync_lock, K_FOREVER);
+  if (sync.active) {
+    sync_stop(false);
+    sync_stats.failed++;
+  }
+  k_mutex_unlock(&sync_lock);
+}
+
+struct sync_export {
+  uint16_t count;
+  uint32_t crc;
+  bool print;
+  uint8_t line[UIDSYNC_EXPORT_LINE];
+  uint8_t len;
+};
+
+static void export_line(struct sync_export *ex) {
+  printk("sync ");
+  for (uint8_t i = 0; i < ex->len; i++) {
+    printk("%02x", ex->line[i]);
+  }
+  printk("\n");
+  ex->len = 0;
+}
+
+static int export_uid(const uint8_t *uid, size_t len, uint8_t faecher,
+                      void *user_data) {
+  struct sync_export *ex = user_data;
+  uint8_t rec[UIDSYNC_RECORD_MAX] = {len, faecher};
+
+  memcpy(&rec[2], uid, len);
+  ex->count++;
+  ex->crc = crc32_ieee_update(ex->crc, rec, len + 2);
+  if (!ex->print) {
+    return 0;
+  }
+
+  /* Nur ganze Datensätze in einer Zeile */
+  if (ex->len + len + 2 > sizeof(ex->line)) {
+    export_line(ex);
+  }
+  memcpy(&ex->line[ex->len], rec, len + 2);
+  ex->len += len + 2;
+  return 0;
+}
+
+int uidsync_export(void) {
+  struct sync_export ex = {0};
+  int ret;
+
+  /* Anzahl und CRC vorab, damit die Ausgabe wieder eingespielt werden kann */
+  ret = eeprom_foreach_uid(export_uid, &ex);
+  if (ret < 0) {
+    return ret;
+  }
+  printk("sync begin %u %u %08x\n", config_get()->uid_version, ex.count,
+         ex.crc);
+
+  ex = (struct sync_export){.print = true};
+  ret = eeprom_foreach_uid(export_uid, &ex);
+  if (ret < 0) {
+    return ret;
+  }
+  if (ex.len > 0) {
+    export_line(&ex);
+  }
+  printk("sync end\n");
+  return 0;
+}
+
+void uidsync_print(void) {
+  printk("UID sync: version %u, %s %u/%u, runs %u, failed %u, last: "
+         "%u unchanged, %u changed, %u removed, %u ms\n",
+         config_get()->uid_version, sync.active ? "receiving" : "idle",
+         sync.received, sync.count, sync_stats.runs, sync_stats.failed,
+         sync_stats.unchanged, sync_stats.changed, sync_stats.removed,
+         sync_stats.time_ms);
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef UIDSYNC_H
+#define UIDSYNC_H
+
+#include "eeprom.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Abgleich der UID-Tabelle mit einer vollständigen Kartenliste.
+ *
+ * Die Liste besteht aus Datensätzen
+ *   Länge der UID (1), Fächer (1), UID
+ * ohne Trennzeichen. uidsync_begin() bekommt Version, Anzahl und CRC32
+ * (IEEE) über alle Datensätze, danach folgen die Datensätze in Teilen mit
+ * uidsync_data(), jeder Teil enthält nur ganze Datensätze. Jede UID wird
+ * gleich beim Empfang mit der Tabelle verglichen, geschrieben wird nur, was
+ * sich geändert hat. Erst uidsync_end() löscht die nicht enthaltenen UIDs
+ * und übernimmt die Version, und nur wenn Anzahl und CRC stimmen. Ein
+ * abgebrochener Abgleich lässt also höchstens zusätzliche Karten der neuen
+ * Liste zurück und kann einfach wiederholt werden.
+ *
+ * Sortiert der Sender die Liste nach Bucket (scripts/uid_sync.py), liegen
+ * aufeinanderfolgende Änderungen meist in derselben EEPROM-Seite und werden
+ * mit einem Seitenzugriff geschrieben. */
+
+/* Längster Datensatz */
+#define UIDSYNC_RECORD_MAX (2 + UID_MAX_LEN)
+
+/**
+ * @brief Abgleich starten
+ *
+ * Ein laufender Abgleich mit anderen Parametern wird abgebrochen, die
+ * Wiederholung eines Starts mit denselben Parametern ändert nichts.
+ *
+ * @return 0
+ */
+int uidsync_begin(uint16_t version, uint16_t count, uint32_t crc);
+
+/**
+ * @brief Datensätze übernehmen
+ *
+ * @param first Index des ersten Datensatzes. Ein schon empfangener Teil
+ *              wird ignoriert, eine Lücke mit -EAGAIN abgelehnt.
+ * @return Anzahl bisher empfangener Datensätze, sonst negativer Fehler
+ */
+int uidsync_data(uint16_t first, const uint8_t *data, size_t len);
+
+/* Anzahl bisher empfangener Datensätze */
+uint16_t uidsync_received(void);
+
+/**
+ * @brief Abgleich abschließen
+ *
+ * @return 0 wenn die Liste übernommen wurde (auch bei einer Wiederholung),
+ *         -EBADMSG bei falscher Anzahl oder CRC, sonst negativer Fehler
+ */
+int uidsync_end(void);
+
+void uidsync_abort(void);
+
+/* Tabelle im Format der Konsolenbefehle ausgeben, siehe cmd_sync */
+int uidsync_export(void);
+
+void uidsync_print(void);
+
+#endif // UIDSYNC_H
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "writeback.h"
+#include <zephyr/kernel.h>
+
+/* Lange EEPROM-Zugriffe laufen in einer eigenen Workqueue mit niedriger
+   Priorität. Die System-Workqueue führt die Motorregelung aus und darf nicht
+   blockieren. Auch die Busrahmen werden hier bearbeitet (bus.c), bis hinunter
+   zum Schreiben einer UID-Seite. */
+#define WRITEBACK_WQ_STACK_SIZE 768
+#define WRITEBACK_WQ_PRIORITY 10
+#define WRITEBACK_MAX_RECORDS 4
+/* Nach einem Fehler erneut versuchen */
+#define WRITEBACK_RETRY_MS 5000
+/* writeback_flush: Durchläufe und Pause, z.B. solange der Motor läuft */
+#define WRITEBACK_FLUSH_ROUNDS 5
+#define WRITEBACK_FLUSH_RETRY_MS 200
+
+K_THREAD_STACK_DEFINE(writeback_wq_stack, WRITEBACK_WQ_STACK_SIZE);
+static struct k_work_q writeback_wq;
+
+static struct writeback *writeback_records[WRITEBACK_MAX_RECORDS];
+static uint8_t writeback_count;
+
+/* Leere Arbeit: ist sie ausgeführt, ist alles davor Eingereihte fertig */
+static void writeback_barrier_handler(struct k_work *work) {}
+static K_WORK_DEFINE(writeback_barrier, writeback_barrier_handler);
+
+static void writeback_handler(struct k_work *work) {
+  struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+  struct writeback *wb = CONTAINER_OF(dwork, struct writeback, work);
+  int ret;
+
+  /* Vor dem Schreiben zurücksetzen, damit eine Änderung während des
+     Schreibens ein weiteres Schreiben auslöst */
+  if (!atomic_clear(&wb->dirty)) {
+    return;
+  }
+
+  ret = wb->commit(wb);
+  if (ret < 0) {
+    /* -EBUSY: Schreiben gerade nicht möglich, kein Fehler */
+    if (ret != -EBUSY) {
+      wb->errors++;
+    }
+    atomic_set(&wb->dirty, 1);
+    k_work_schedule_for_queue(&writeback_wq, &wb->work,
+                              K_MSEC(WRITEBACK_RETRY_MS));
+    return;
+  }
+  wb->commits++;
+}
+
+void writeback_init(void) {
+  k_work_queue_start(&writeback_wq, writeback_wq_stack,
+                     K_THREAD_STACK_SIZEOF(writeback_wq_stack),
+                     WRITEBACK_WQ_PRIORITY, NULL);
+  k_thread_name_set(&writeback_wq.thread, "storage_wq");
+}
+
+int writeback_register(struct writeback *wb, writeback_commit_t commit) {
+  if (writeback_count >= WRITEBACK_MAX_RECORDS) {
+    return -ENOMEM;
+  }
+
+  k_work_init_delayable(&wb->work, writeback_handler);
+  wb->commit = commit;
+  atomic_clear(&wb->dirty);
+  writeback_records[writeback_count++] = wb;
+  return 0;
+}
+
+void writeback_mark(struct writeback *wb) {
+  atomic_set(&wb->dirty, 1);
+  /* Ist das Schreiben schon geplant, bleibt der Zeitpunkt (Sammeln) */
+  k_work_schedule_for_queue(&writeback_wq, &wb->work,
+                            K_MSEC(CONFIG_PAKETKASTEN_WRITEBACK_DELAY_MS));
+}
+
+int writeback_submit(struct k_work *work) {
+  return k_work_submit_to_queue(&writeback_wq, work);
+}
+
+static bool writeback_dirty(bool start) {
+  bool dirty = false;
+
+  for (int i = 0; i < writeback_count; i++) {
+    if (atomic_get(&writeback_records[i]->dirty)) {
+      dirty = true;
+      if (start) {
+        /* Auch einen nach einem Fehler verzögerten Versuch vorziehen */
+        k_work_reschedule_for_queue(&writeback_wq,
+                                    &writeback_records[i]->work, K_NO_WAIT);
+      }
+    }
+  }
+  return dirty;
+}
+
+/* Die Workqueue wird nicht gesperrt, Busrahmen aus dem ISR werden weiter
+   angenommen */
+int writeback_flush(void) {
+  struct k_work_sync sync;
+
+  for (int round = 0; round < WRITEBACK_FLUSH_ROUNDS; round++) {
+    if (round > 0) {
+      k_msleep(WRITEBACK_FLUSH_RETRY_MS);
+    }
+    writeback_dirty(true);
+    k_work_submit_to_queue(&writeback_wq, &writeback_barrier);
+    k_work_flush(&writeback_barrier, &sync);
+    if (!writeback_dirty(false)) {
+      return 0;
+    }
+  }
+  return -EBUSY;
+}
+
+void writeback_print_stats(void) {
+  for (int i = 0; i < writeback_count; i++) {
+    printk("Writeback %d: dirty %d, commits %u, errors %u\n", i,
+           (int)atomic_get(&writeback_records[i]->dirty),
+           writeback_records[i]->commits, writeback_records[i]->errors);
+  }
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2025 Conny Marco Menebröcker
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef WRITEBACK_H
+#define WRITEBACK_H
+
+#include <zephyr/kernel.h>
+
+struct writeback;
+
+/* Schreibt den aktuellen RAM-Stand, läuft in der Speicher-Workqueue. -EBUSY
+   verschiebt das Schreiben ohne Fehler. */
+typedef int (*writeback_commit_t)(struct writeback *wb);
+
+/* Ein zurückgestellter Datensatz. Änderungen werden im RAM gemacht und nur
+   markiert, geschrieben wird gesammelt nach CONFIG_PAKETKASTEN_WRITEBACK_DELAY_MS. */
+struct writeback {
+  struct k_work_delayable work;
+  writeback_commit_t commit;
+  atomic_t dirty;
+  uint32_t commits;
+  uint32_t errors;
+};
+
+/**
+ * @brief Speicher-Workqueue starten
+ *
+ * Muss vor allen anderen Speichermodulen aufgerufen werden.
+ */
+void writeback_init(void);
+
+/**
+ * @brief Datensatz anmelden
+ *
+ * Angemeldete Datensätze werden von writeback_flush() geschrieben.
+ *
+ * @return 0 bei Erfolg, -ENOMEM wenn keine Anmeldung mehr frei ist
+ */
+int writeback_register(struct writeback *wb, writeback_commit_t commit);
+
+/* Datensatz als geändert markieren, mehrere Änderungen ergeben ein Schreiben */
+void writeback_mark(struct writeback *wb);
+
+/* Arbeit sofort in der Speicher-Workqueue ausführen */
+int writeback_submit(struct k_work *work);
+
+/**
+ * @brief Alle geänderten Datensätze sofort schreiben
+ *
+ * Blockiert, bis alle vorher eingereihten Arbeiten der Speicher-Workqueue
+ * ausgeführt sind. Fehlgeschlagene Datensätze werden einige Male erneut
+ * versucht. Wird vor dem Abschalten der Peripherieversorgung aufgerufen.
+ *
+ * @return 0 wenn nichts mehr offen ist, -EBUSY wenn noch Datensätze
+ *         geändert sind
+ */
+int writeback_flush(void);
+
+void writeback_print_stats(void);
+
+#endif // WRITEBACK_H